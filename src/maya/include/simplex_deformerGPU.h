@@ -0,0 +1,73 @@
+/*
+Copyright 2016, Blur Studio
+
+This file is part of Simplex.
+
+Simplex is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Simplex is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Simplex.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <maya/MTypes.h>
+
+// The GPU deformer interface this is written against arrived in Maya 2020
+#if MAYA_API_VERSION >= 20200000
+
+#include <vector>
+
+#include <maya/MPxGPUDeformer.h>
+#include <maya/MGPUDeformerRegistry.h>
+#include <maya/MOpenCLAutoPtr.h>
+#include <maya/MString.h>
+
+class simplex_deformer;
+
+// The OpenCL override for simplex_deformer, so meshes downstream of it
+// stay on Maya's GPU deformer chain. The shape deltas are uploaded once
+// and kept resident until they change, and every evaluation only sends
+// the solved weights. The solve itself still runs on the CPU node
+class simplex_deformerGPU : public MPxGPUDeformer
+{
+public:
+	simplex_deformerGPU() {}
+	virtual ~simplex_deformerGPU();
+
+	virtual MPxGPUDeformer::DeformerStatus evaluate(MDataBlock& block, const MEvaluationNode& evaluationNode,
+			const MPlug& plug, const MGPUDeformerData& inputData, MGPUDeformerData& outputData);
+	virtual void terminate();
+
+	static MGPUDeformerRegistrationInfo* getGPUDeformerInfo();
+	static bool validateNodeInGraph(MDataBlock& block, const MEvaluationNode& evaluationNode, const MPlug& plug, MStringArray* messages);
+	static bool validateNodeValues(MDataBlock& block, const MEvaluationNode& evaluationNode, const MPlug& plug, MStringArray* messages);
+
+	static const MString registrantId;
+
+private:
+	bool uploadDeltas(const simplex_deformer &node);
+
+	// The deltas regrouped by point, so each work item sums its own point:
+	// point i's offsets are entries pointOffsets[i] to pointOffsets[i+1]
+	MAutoCLMem clPointOffsets;
+	MAutoCLMem clEntryShapes;
+	MAutoCLMem clEntryDeltas;
+	MAutoCLMem clWeights;
+	MAutoCLKernel kernel;
+
+	unsigned int deltaPoints = 0;
+	size_t uploadedVersion = 0;
+	size_t weightCapacity = 0;
+	std::vector<float> hostWeights;
+};
+
+#endif
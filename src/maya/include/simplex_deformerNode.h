@@ -0,0 +1,125 @@
+/*
+Copyright 2016, Blur Studio
+
+This file is part of Simplex.
+
+Simplex is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Simplex is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Simplex.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <maya/MPxDeformerNode.h>
+#include <maya/MTypeId.h>
+#include <maya/MEvaluationNode.h>
+
+#include "simplex.h"
+#include "simplexCache.h"
+#include "shapeDeltas.h"
+
+// A deformer that runs the solver itself and applies the solved weights
+// straight to the geometry, instead of feeding a separate blendShape.
+// Each shape's offsets are stored on the node as a sparse list of point
+// indices and delta vectors, under the shape's index in shapeDeltas.
+// The same offsets are applied to every geometry the node deforms
+class simplex_deformer : public MPxDeformerNode
+{
+public:
+	simplex_deformer(): deltas(std::make_shared<const simplex::ShapeDeltas>()) {}
+	virtual ~simplex_deformer() {}
+
+	virtual MStatus deform(MDataBlock& data, MItGeometry& iter, const MMatrix& mat, unsigned int multiIndex);
+	virtual MStatus preEvaluation(const MDGContext& context, const MEvaluationNode& evaluationNode);
+	virtual MStatus setDependentsDirty(const MPlug& plug, MPlugArray& plugArray);
+	static void* creator();
+	static MStatus initialize();
+
+public:
+	static MObject aSliders;
+	static MObject aDefinition;
+	static MObject aExactSolve;
+	static MObject aShapeDeltas;
+	static MObject aDeltaIndices;
+	static MObject aDeltaValues;
+
+	static MTypeId id;
+
+	// Bring the deltas and the normal context's weights up to date
+	// The GPU override shares these with the CPU deformer through here,
+	// so they must only be called from the normal context
+	MStatus update(MDataBlock& data);
+	const simplex::ShapeDeltas &getDeltas() const { return *deltas; }
+	// Changes every time the deltas are rebuilt
+	size_t getDeltasVersion() const { return deltasVersion; }
+	const std::vector<double> &getWeights() const { return cache; }
+	// What the normal context's solves measured, plus the build of the definition
+	// Clearing only resets the solves, the definition is shared
+	simplex::SolveProfile getProfile();
+	void clearProfile();
+
+private:
+	// Everything a deform in a non-normal context needs. Those can
+	// run alongside the normal context, so they never touch its state
+	struct ContextDeform {
+		simplex::SolverState state;
+		std::vector<double> inVec;
+		simplex::SparseWeights weights;
+		std::vector<float> accum;
+		std::vector<unsigned int> members;
+	};
+
+	MStatus readDeltas(MDataBlock& data, simplex::ShapeDeltas &out);
+	std::shared_ptr<const simplex::Simplex> acquireSimplex(MDataBlock& data, MStatus &status);
+	// Bring the normal context's solver up to date with the definition
+	MStatus updateSimplex(MDataBlock& data);
+	// Read what gets passed to the solver
+	MStatus readSolveInputs(MDataBlock& data, std::vector<double> &inVec, bool &exact);
+	MStatus solveWeights(MDataBlock& data, simplex::SolverState &solveState, std::vector<double> &weights);
+	// Solve and sum the offsets for a non-normal context, without touching the normal one
+	MStatus accumulateContext(MDataBlock& data, ContextDeform &deform, float env, size_t &pointCount);
+	// Add the summed offsets to the points being deformed
+	MStatus addOffsets(MDataBlock& data, MItGeometry& iter, unsigned int multiIndex,
+		const std::vector<float> &offsets, size_t pointCount, std::vector<unsigned int> &memberScratch);
+	std::unique_ptr<ContextDeform> takeContextDeform();
+	void giveContextDeform(std::unique_ptr<ContextDeform> deform);
+
+	// Shared with every other node using the same definition
+	// Guarded by rigMutex along with deltas, because other contexts
+	// read them while the normal context may be replacing them
+	std::shared_ptr<const simplex::Simplex> sPointer;
+	// Only ever replaced as a whole, never edited, so other contexts can keep using the old one
+	std::shared_ptr<const simplex::ShapeDeltas> deltas;
+	std::mutex rigMutex;
+	size_t deltasVersion = 0;
+
+	// Only used by the normal context
+	simplex::SolverState state;
+	std::vector<double> cache; // the normal context's solved weights
+	// Scratch for deform, kept to avoid reallocating every evaluation
+	std::vector<float> accum;
+	std::vector<unsigned int> members;
+
+	std::atomic<bool> simplexIsValid{false};
+	bool cacheIsValid = false;
+	std::atomic<bool> deltasAreValid{false};
+	bool jsErrorReported = false;
+
+	// Reused between non-normal context deforms, one per concurrent evaluation
+	std::mutex contextMutex;
+	std::vector<std::unique_ptr<ContextDeform>> contextDeforms;
+};
@@ -19,6 +19,12 @@ along with Simplex.  If not, see <http://www.gnu.org/licenses/>.
 
 #pragma once
 
+#include <atomic>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
 #include <vector>
 
 #include <maya/MPxNode.h>
@@ -26,10 +32,17 @@ along with Simplex.  If not, see <http://www.gnu.org/licenses/>.
 #include <maya/MFnStringData.h>
 #include <maya/MFnTypedAttribute.h>
 #include <maya/MTypeId.h> 
+#include <maya/MTime.h>
 #include <maya/MEvaluationNode.h>
 #include <maya/MFnMessageAttribute.h>
+#if MAYA_API_VERSION >= 20200000
+#include <maya/MObjectArray.h>
+#include <maya/MNodeCacheDisablingInfo.h>
+#include <maya/MNodeCacheSetupInfo.h>
+#endif
 
 #include "simplex.h"
+#include "simplexCache.h"
  
 class simplex_maya : public MPxNode
 {
@@ -40,6 +53,11 @@ public:
 	virtual	MStatus	compute( const MPlug& plug, MDataBlock& data );
 	virtual MStatus preEvaluation(const  MDGContext& context, const MEvaluationNode& evaluationNode);
 	virtual MStatus setDependentsDirty(const MPlug& plug, MPlugArray& plugArray);
+	virtual SchedulingType schedulingType() const;
+#if MAYA_API_VERSION >= 20200000
+	virtual void getCacheSetup(const MEvaluationNode& evalNode, MNodeCacheDisablingInfo& disablingInfo,
+			MNodeCacheSetupInfo& cacheSetupInfo, MObjectArray& monitoredAttributes) const;
+#endif
 	static	void*	creator();
 	static	MStatus	initialize();
 
@@ -49,15 +67,87 @@ public:
 	static MObject	aDefinition;
 	static MObject	aMinorUpdate;
 	static MObject	aExactSolve;
+	static MObject	aResultCacheSize;
+	static MObject	aResultCacheQuantum;
 
 	static	MTypeId	id;
 
+	// What this node's solves measured, plus the build of its definition
+	// Clearing only resets the solves, the definition is shared
+	simplex::SolveProfile getProfile();
+	void clearProfile();
+	// The result cache is shared with every node using the same definition
+	simplex::SolveCacheStats getResultCacheStats();
+
+	// Wait for any definitions still building in the background,
+	// so none of them are left running when the plugin unloads
+	static void waitForBuilds();
 
 private:
-	simplex::Simplex * sPointer;
+	// Everything a solve in a non-normal context needs. Those can
+	// run alongside the normal context, so they never touch the cache
+	struct ContextSolve {
+		simplex::SolverState state;
+		std::vector<double> inVec;
+		simplex::SparseWeights outWeights;
+	};
+
+	// A definition being parsed and built on a worker thread
+	struct PendingBuild {
+		std::string definition;
+		std::shared_future<std::shared_ptr<const simplex::Simplex>> rig;
+	};
+
+	std::shared_ptr<const simplex::Simplex> acquireSimplex(MDataBlock& data, MStatus &status);
+	// Bring the normal context's solver up to date with the definition
+	// With minorUpdate on, a definition that isn't built yet is built in the
+	// background, and the old solver keeps solving until it's ready
+	MStatus updateSimplex(MDataBlock& data);
+	void startBuild(std::string_view definition);
+	MStatus applyResultCache(MDataBlock& data);
+	MStatus readDirtySliders(MDataBlock& data);
+	void sliderDirtied(const MPlug& plug);
+	// Pass published to only write the weights that changed since the last call
+	MStatus writeWeights(MDataBlock& data, const std::vector<double> &weights, std::vector<double> *published);
+	// Write a sparse solve of shapeCount weights, where the unlisted ones are 0.0
+	MStatus writeWeights(MDataBlock& data, const simplex::SparseWeights &weights, size_t shapeCount);
+	std::unique_ptr<ContextSolve> takeContextSolve();
+	void giveContextSolve(std::unique_ptr<ContextSolve> solve);
+
+	// Shared with every other node using the same definition
+	// Guarded by rigMutex, because other contexts read it while the
+	// normal context may be replacing it
+	std::shared_ptr<const simplex::Simplex> sPointer;
+	std::mutex rigMutex;
+	std::atomic<bool> simplexIsValid{false};
+	// Only used by the normal context
+	std::shared_ptr<PendingBuild> pending;
+
+	// Only used by the normal context
+	simplex::SolverState state;
 	std::vector<double> cache;
-	bool simplexIsValid = false;
 	bool cacheIsValid = false;
+	// The slider values, kept between computes so only dirty ones are re-read
+	std::vector<double> inVec;
+	std::vector<unsigned> dirtySliders;
+	bool inputsValid = false;
+	// The last value written to each output weight, NaN when it never was
+	// That's only what the datablock holds while nothing else writes to it,
+	// so it's cleared on a new time, or after another context evaluates
+	std::vector<double> published;
+	unsigned publishedCount = 0;
+	MTime publishedTime;
+	std::atomic<bool> publishedStale{false};
+	// Set once cached playback takes this node, which turns off the changed-only writes
+	mutable std::atomic<bool> evaluationCached{false};
     bool jsErrorReported = false;
+	// The result cache settings this node last asked for, and the solver it asked
+	size_t cacheCapacity = 0;
+	double cacheQuantum = 0.0;
+	const simplex::Simplex *cacheRig = nullptr;
+
+	// Reused between non-normal context solves, one per concurrent evaluation
+	std::mutex contextMutex;
+	std::vector<std::unique_ptr<ContextSolve>> contextSolves;
 };
 
@@ -0,0 +1,40 @@
+/*
+Copyright 2016, Blur Studio
+
+This file is part of Simplex.
+
+Simplex is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Simplex is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Simplex.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <maya/MArgList.h>
+#include <maya/MPxCommand.h>
+#include <maya/MSyntax.h>
+
+// Reports the solver timings and counters of a simplex_maya or
+// simplex_deformer node as a json object string
+//     simplexProfile [-reset] node
+// -reset zeroes the node's solve counters after reading them
+// The counters are only collected when the plugin is built with profiling
+class simplex_profileCmd : public MPxCommand
+{
+public:
+	virtual MStatus doIt(const MArgList& args);
+	virtual bool isUndoable() const { return false; }
+	static void* creator();
+	static MSyntax newSyntax();
+
+	static const char *name;
+};
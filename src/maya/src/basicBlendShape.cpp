@@ -28,14 +28,21 @@ blendShape -edit -t pTorus1 0 pTorus2 1.0 basicBlendShape1;
 */
 
 #include "basicBlendShape.h"
+#include "shapeDeltas.h"
 
 #include <maya/MFloatArray.h>
+#include <maya/MIntArray.h>
 #include <maya/MPoint.h>
 #include <maya/MPointArray.h>
 
 #include <maya/MItGeometry.h>
 #include <maya/MFnPointArrayData.h>
 #include <maya/MFnComponentListData.h>
+#include <maya/MFnSingleIndexedComponent.h>
+#include <maya/MThreadPool.h>
+
+#include <algorithm> // for min
+#include <vector>
 
 
 MTypeId basicBlendShape::id(0x00122706);
@@ -49,6 +56,71 @@ MStatus basicBlendShape::initialize() {
 }
 
 
+namespace {
+
+// Meshes with fewer points than this aren't worth splitting across threads
+const unsigned int pointsPerTask = 8192;
+
+// One point range of the accumulation. The ranges don't overlap,
+// so every task writes to its own part of accum and the points
+struct AccumulateTask {
+	const simplex::ShapeDeltas *deltas;
+	const std::vector<double> *weights;
+	float *accum;
+	MPointArray *points;
+	size_t begin;
+	size_t end;
+};
+
+MThreadRetVal accumulateTask(void *data){
+	AccumulateTask *task = static_cast<AccumulateTask *>(data);
+	std::fill(task->accum + 3 * task->begin, task->accum + 3 * task->end, 0.0f);
+	task->deltas->accumulate(task->weights->data(), task->weights->size(), 1.0f, task->accum, task->begin, task->end);
+	MPointArray &pts = *task->points;
+	for (size_t i = task->begin; i < task->end; ++i){
+		const float *d = task->accum + 3 * i;
+		MPoint &pt = pts[(unsigned int)i];
+		pt.x += d[0];
+		pt.y += d[1];
+		pt.z += d[2];
+	}
+	return 0;
+}
+
+void accumulateRegion(void *data, MThreadRootTask *root){
+	std::vector<AccumulateTask> &tasks = *static_cast<std::vector<AccumulateTask> *>(data);
+	for (size_t i = 0; i < tasks.size(); ++i){
+		MThreadPool::createTask(accumulateTask, &tasks[i], root);
+	}
+	MThreadPool::executeAndJoin(root);
+}
+
+// The per-point path, for components that aren't a flat list of indices
+void applyTargetPerPoint(MDataHandle geomData, MObject comp, const MPointArray &pts, float defWgt, MArrayDataHandle &targetWeightsMH){
+	unsigned int ptIndex = 0;
+	MItGeometry iter(geomData, comp, false);
+	for (; !iter.isDone(); iter.next(), ++ptIndex) {
+		MPoint pt = iter.position();
+		unsigned int compIndex = iter.index();
+		float wgt = defWgt;
+		if (targetWeightsMH.jumpToElement(compIndex)) {
+			wgt *= targetWeightsMH.inputValue().asFloat();
+		}
+		pt += pts[ptIndex] * wgt;
+		iter.setPosition(pt);
+	}
+}
+
+struct SlowTarget {
+	MObject comp;
+	MPointArray pts;
+	float weight;
+	unsigned int group;
+};
+
+} // namespace
+
+
 MStatus
 basicBlendShape::deformData(MDataBlock& block,
 					  MDataHandle geomData,
@@ -91,7 +163,23 @@ basicBlendShape::deformData(MDataBlock& block,
 	}
 	MDataHandle inputTargetH = inputTargetMH.inputValue();
 	MArrayDataHandle inputTargetGroupMH = inputTargetH.child(inputTargetGroup);
+
+	// Pack every active target into one set of contiguous deltas, with the
+	// per-component target weights already multiplied in. Target w is
+	// stored as shape w+1, because ShapeDeltas treats shape 0 as the rest
+	simplex::ShapeDeltas deltas;
+	std::vector<double> shapeWeights(numWeights + 1, 0.0);
+	std::vector<SlowTarget> slowTargets;
+	std::vector<uint32_t> indices;
+	std::vector<float> xyz;
+	std::vector<float> compWeights;
+	MIntArray elements;
 	for (unsigned int w=0; w<numWeights; ++w) {
+		float defWgt = weights[w];
+		if (defWgt == 0.0f) {
+			continue;
+		}
+
 		// inputPointsTarget is computed on pull,
 		// so can't just read it out of the datablock
 		MPlug plug(thisMObject(), inputPointsTarget);
@@ -111,26 +199,90 @@ basicBlendShape::deformData(MDataBlock& block,
 			continue;
 		}
 		MObject comp = compList[0];
+		if (!comp.hasFn(MFn::kSingleIndexedComponent)) {
+			SlowTarget slow;
+			slow.comp = comp;
+			slow.pts = pts;
+			slow.weight = defWgt;
+			slow.group = w;
+			slowTargets.push_back(slow);
+			continue;
+		}
+		MFnSingleIndexedComponent(comp).getElements(elements);
+		unsigned int count = std::min(elements.length(), pts.length());
 
-		// iterate over the components
-		float defWgt = weights[w];
+		// Read the sparse per-component weights in one pass, instead
+		// of jumping to each component's element in turn
 		inputTargetGroupMH.jumpToArrayElement(w);
 		MArrayDataHandle targetWeightsMH = inputTargetGroupMH.inputValue().child(targetWeights);
-		unsigned int ptIndex = 0;
-		MItGeometry iter(geomData, comp, false);
-		for (; !iter.isDone(); iter.next(), ++ptIndex) {
-			MPoint pt = iter.position();
-			unsigned int compIndex = iter.index();
-			float wgt = defWgt;
-			if (targetWeightsMH.jumpToElement(compIndex)) {
-				wgt *= targetWeightsMH.inputValue().asFloat();
+		compWeights.clear();
+		for (unsigned int p = 0; p < targetWeightsMH.elementCount(); ++p) {
+			targetWeightsMH.jumpToArrayElement(p);
+			unsigned int compIndex = targetWeightsMH.elementIndex();
+			if (compIndex >= compWeights.size()) {
+				compWeights.resize(compIndex + 1, 1.0f);
 			}
-			pt += pts[ptIndex] * wgt;
-			iter.setPosition(pt);
+			compWeights[compIndex] = targetWeightsMH.inputValue().asFloat();
 		}
+
+		indices.resize(count);
+		xyz.resize(3 * count);
+		for (unsigned int i = 0; i < count; ++i) {
+			uint32_t compIndex = (uint32_t)elements[i];
+			float wgt = (compIndex < compWeights.size()) ? compWeights[compIndex] : 1.0f;
+			indices[i] = compIndex;
+			xyz[3 * i] = (float)pts[i].x * wgt;
+			xyz[3 * i + 1] = (float)pts[i].y * wgt;
+			xyz[3 * i + 2] = (float)pts[i].z * wgt;
+		}
+		deltas.addShape(w + 1, indices.data(), xyz.data(), count);
+		shapeWeights[w + 1] = defWgt;
 	}
 
-    return returnStatus;
-}
+	if (!deltas.empty()) {
+		// Fetch every position once, add all the targets, and write them back once
+		MItGeometry iter(geomData, false);
+		MPointArray positions;
+		returnStatus = iter.allPositions(positions);
+		if (!returnStatus) {
+			return returnStatus;
+		}
 
+		size_t pointCount = std::min((size_t)positions.length(), deltas.pointCount());
+		std::vector<float> accum(3 * deltas.pointCount());
+		std::vector<AccumulateTask> tasks;
+		for (size_t begin = 0; begin < pointCount; begin += pointsPerTask) {
+			AccumulateTask task;
+			task.deltas = &deltas;
+			task.weights = &shapeWeights;
+			task.accum = accum.data();
+			task.points = &positions;
+			task.begin = begin;
+			task.end = std::min(begin + pointsPerTask, pointCount);
+			tasks.push_back(task);
+		}
 
+		if (tasks.size() > 1 && MThreadPool::init()) {
+			MThreadPool::newParallelRegion(accumulateRegion, &tasks);
+			MThreadPool::release();
+		}
+		else {
+			for (size_t i = 0; i < tasks.size(); ++i) {
+				accumulateTask(&tasks[i]);
+			}
+		}
+
+		returnStatus = iter.setAllPositions(positions);
+		if (!returnStatus) {
+			return returnStatus;
+		}
+	}
+
+	for (size_t i = 0; i < slowTargets.size(); ++i) {
+		inputTargetGroupMH.jumpToArrayElement(slowTargets[i].group);
+		MArrayDataHandle targetWeightsMH = inputTargetGroupMH.inputValue().child(targetWeights);
+		applyTargetPerPoint(geomData, slowTargets[i].comp, slowTargets[i].pts, slowTargets[i].weight, targetWeightsMH);
+	}
+
+    return returnStatus;
+}
@@ -18,7 +18,10 @@ along with Simplex.  If not, see <http://www.gnu.org/licenses/>.
 */
 
 #include "simplex_mayaNode.h"
+#include "simplex_deformerNode.h"
+#include "simplex_deformerGPU.h"
 #include "basicBlendShape.h"
+#include "simplex_profileCmd.h"
 #include "version.h"
 #include <maya/MFnPlugin.h>
 #include <maya/MObject.h>
@@ -41,6 +44,38 @@ MStatus initializePlugin(MObject obj)
 		return status;
 	}
 
+	status = plugin.registerNode(
+		"simplex_deformer",
+		simplex_deformer::id,
+		&simplex_deformer::creator,
+		&simplex_deformer::initialize,
+		MPxNode::kDeformerNode
+	);
+
+	if (!status) {
+		status.perror("registerNode simplex_deformer");
+		return status;
+	}
+
+#if MAYA_API_VERSION >= 20200000
+	status = MGPUDeformerRegistry::registerGPUDeformerCreator(
+		"simplex_deformer",
+		simplex_deformerGPU::registrantId,
+		simplex_deformerGPU::getGPUDeformerInfo()
+	);
+
+	if (!status) {
+		status.perror("registerGPUDeformerCreator simplex_deformer");
+		return status;
+	}
+	// Let the GPU override be dropped when the envelope is zero
+	MGPUDeformerRegistry::addConditionalAttribute(
+		"simplex_deformer",
+		simplex_deformerGPU::registrantId,
+		MPxDeformerNode::envelope
+	);
+#endif
+
     status = plugin.registerNode(
         "basicBlendShape",
         basicBlendShape::id,
@@ -53,6 +88,17 @@ MStatus initializePlugin(MObject obj)
 		status.perror("registerNode basicBlendShape");
 		return status;
 	}
+
+	status = plugin.registerCommand(
+		simplex_profileCmd::name,
+		&simplex_profileCmd::creator,
+		&simplex_profileCmd::newSyntax
+	);
+
+	if (!status) {
+		status.perror("registerCommand simplexProfile");
+		return status;
+	}
 	return status;
 }
 
@@ -61,18 +107,44 @@ MStatus uninitializePlugin(MObject obj)
 	MStatus status;
 	MFnPlugin plugin(obj);
 
+	// The background builds run plugin code, so they have to finish first
+	simplex_maya::waitForBuilds();
+
 	status = plugin.deregisterNode(simplex_maya::id);
 	if (!status) {
 		status.perror("deregisterNode simplex_maya");
 		return status;
 	}
 
+#if MAYA_API_VERSION >= 20200000
+	status = MGPUDeformerRegistry::deregisterGPUDeformerCreator(
+		"simplex_deformer",
+		simplex_deformerGPU::registrantId
+	);
+	if (!status) {
+		status.perror("deregisterGPUDeformerCreator simplex_deformer");
+		return status;
+	}
+#endif
+
+	status = plugin.deregisterNode(simplex_deformer::id);
+	if (!status) {
+		status.perror("deregisterNode simplex_deformer");
+		return status;
+	}
+
 	status = plugin.deregisterNode(basicBlendShape::id);
 	if (!status) {
 		status.perror("deregisterNode basicBlendShape");
 		return status;
 	}
 
+	status = plugin.deregisterCommand(simplex_profileCmd::name);
+	if (!status) {
+		status.perror("deregisterCommand simplexProfile");
+		return status;
+	}
+
 	return status;
 }
 
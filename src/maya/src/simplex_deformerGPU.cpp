@@ -0,0 +1,249 @@
+/*
+Copyright 2016, Blur Studio
+
+This file is part of Simplex.
+
+Simplex is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Simplex is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Simplex.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "simplex_deformerGPU.h"
+
+#if MAYA_API_VERSION >= 20200000
+
+#include "simplex_deformerNode.h"
+
+#include <maya/MDataBlock.h>
+#include <maya/MDataHandle.h>
+#include <maya/MFnDependencyNode.h>
+#include <maya/MOpenCLInfo.h>
+#include <maya/MPlug.h>
+#include <maya/MStringArray.h>
+#include <clew/clew_cl.h>
+
+#include <cstdint>
+#include <vector>
+
+const MString simplex_deformerGPU::registrantId("simplexGPU");
+
+namespace {
+
+// One work item per point. Points past the end of the
+// deltas don't move, so they're just copied through
+const char *kernelSource =
+"__kernel void simplexDeform(\n"
+"	__global float *outPositions,\n"
+"	__global const float *inPositions,\n"
+"	__global const uint *pointOffsets,\n"
+"	__global const uint *entryShapes,\n"
+"	__global const float *entryDeltas,\n"
+"	__global const float *weights,\n"
+"	const float envelope,\n"
+"	const uint deltaPoints,\n"
+"	const uint positionCount)\n"
+"{\n"
+"	uint i = get_global_id(0);\n"
+"	if (i >= positionCount) return;\n"
+"	float3 pos = vload3(i, inPositions);\n"
+"	if (i < deltaPoints){\n"
+"		float3 sum = (float3)(0.0f, 0.0f, 0.0f);\n"
+"		uint end = pointOffsets[i + 1];\n"
+"		for (uint e = pointOffsets[i]; e < end; ++e){\n"
+"			sum += weights[entryShapes[e]] * vload3(e, entryDeltas);\n"
+"		}\n"
+"		pos += envelope * sum;\n"
+"	}\n"
+"	vstore3(pos, i, outPositions);\n"
+"}\n";
+
+class simplex_deformerGPUInfo : public MGPUDeformerRegistrationInfo {
+public:
+	virtual MPxGPUDeformer* createGPUDeformer(){
+		return new simplex_deformerGPU();
+	}
+	virtual bool validateNodeInGraph(MDataBlock& block, const MEvaluationNode& evaluationNode, const MPlug& plug, MStringArray* messages){
+		return simplex_deformerGPU::validateNodeInGraph(block, evaluationNode, plug, messages);
+	}
+	virtual bool validateNodeValues(MDataBlock& block, const MEvaluationNode& evaluationNode, const MPlug& plug, MStringArray* messages){
+		return simplex_deformerGPU::validateNodeValues(block, evaluationNode, plug, messages);
+	}
+};
+
+bool createBuffer(MAutoCLMem &mem, cl_mem_flags flags, size_t size, void *data){
+	cl_int err = CL_SUCCESS;
+	// OpenCL doesn't allow empty buffers
+	if (size == 0) size = sizeof(cl_uint);
+	cl_mem buffer = clCreateBuffer(MOpenCLInfo::getOpenCLContext(), flags, size, data, &err);
+	if (err != CL_SUCCESS) return false;
+	mem.attach(buffer);
+	return true;
+}
+
+} // namespace
+
+simplex_deformerGPU::~simplex_deformerGPU(){
+	terminate();
+}
+
+MGPUDeformerRegistrationInfo* simplex_deformerGPU::getGPUDeformerInfo(){
+	static simplex_deformerGPUInfo info;
+	return &info;
+}
+
+bool simplex_deformerGPU::validateNodeInGraph(MDataBlock&, const MEvaluationNode&, const MPlug&, MStringArray*){
+	return true;
+}
+
+bool simplex_deformerGPU::validateNodeValues(MDataBlock&, const MEvaluationNode&, const MPlug&, MStringArray*){
+	return true;
+}
+
+void simplex_deformerGPU::terminate(){
+	clPointOffsets.reset();
+	clEntryShapes.reset();
+	clEntryDeltas.reset();
+	clWeights.reset();
+	if (!kernel.isNull())
+		MOpenCLInfo::releaseOpenCLKernel(kernel);
+	kernel.reset();
+	deltaPoints = 0;
+	uploadedVersion = 0;
+	weightCapacity = 0;
+}
+
+bool simplex_deformerGPU::uploadDeltas(const simplex_deformer &node){
+	// Regroup the shape-major runs by point. Zero padding between
+	// runs doesn't move anything, so it isn't uploaded
+	const simplex::ShapeDeltas &deltas = node.getDeltas();
+	const std::vector<size_t> &shapeRuns = deltas.getShapeRuns();
+	const std::vector<simplex::ShapeDeltas::Run> &runs = deltas.getRuns();
+	const std::vector<float> &values = deltas.getDeltas();
+
+	auto isZero = [&values](size_t d){
+		return values[3 * d] == 0.0f && values[3 * d + 1] == 0.0f && values[3 * d + 2] == 0.0f;
+	};
+
+	size_t pointCount = deltas.pointCount();
+	std::vector<cl_uint> pointOffsets(pointCount + 1, 0);
+	for (size_t s = 1; s < deltas.shapeCount(); ++s){
+		for (size_t r = shapeRuns[s]; r < shapeRuns[s + 1]; ++r){
+			for (uint32_t p = 0; p < runs[r].length; ++p){
+				if (!isZero(runs[r].offset + p))
+					++pointOffsets[runs[r].start + p + 1];
+			}
+		}
+	}
+	for (size_t i = 0; i < pointCount; ++i){
+		pointOffsets[i + 1] += pointOffsets[i];
+	}
+
+	size_t entryCount = pointOffsets[pointCount];
+	std::vector<cl_uint> entryShapes(entryCount);
+	std::vector<float> entryDeltas(3 * entryCount);
+	std::vector<cl_uint> fill(pointOffsets.begin(), pointOffsets.end() - 1);
+	for (size_t s = 1; s < deltas.shapeCount(); ++s){
+		for (size_t r = shapeRuns[s]; r < shapeRuns[s + 1]; ++r){
+			for (uint32_t p = 0; p < runs[r].length; ++p){
+				size_t d = runs[r].offset + p;
+				if (isZero(d)) continue;
+				cl_uint e = fill[runs[r].start + p]++;
+				entryShapes[e] = (cl_uint)s;
+				entryDeltas[3 * e] = values[3 * d];
+				entryDeltas[3 * e + 1] = values[3 * d + 1];
+				entryDeltas[3 * e + 2] = values[3 * d + 2];
+			}
+		}
+	}
+
+	cl_mem_flags flags = CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR;
+	if (!createBuffer(clPointOffsets, flags, pointOffsets.size() * sizeof(cl_uint), pointOffsets.data())) return false;
+	if (!createBuffer(clEntryShapes, flags, entryShapes.size() * sizeof(cl_uint), entryShapes.data())) return false;
+	if (!createBuffer(clEntryDeltas, flags, entryDeltas.size() * sizeof(float), entryDeltas.data())) return false;
+	deltaPoints = (unsigned int)pointCount;
+	uploadedVersion = node.getDeltasVersion();
+	return true;
+}
+
+MPxGPUDeformer::DeformerStatus simplex_deformerGPU::evaluate(MDataBlock& block, const MEvaluationNode&,
+		const MPlug& plug, const MGPUDeformerData& inputData, MGPUDeformerData& outputData){
+	simplex_deformer *node = dynamic_cast<simplex_deformer *>(MFnDependencyNode(plug.node()).userNode());
+	if (!node) return kDeformerFailure;
+
+	// The CPU node does the solve, and tracks when the deltas change
+	if (!node->update(block)) return kDeformerFailure;
+	if (uploadedVersion != node->getDeltasVersion()){
+		if (!uploadDeltas(*node)) return kDeformerFailure;
+	}
+
+	MGPUDeformerBuffer inputPositions = inputData.getBuffer(sPositionsName());
+	if (!inputPositions.isValid()) return kDeformerFailure;
+	MGPUDeformerBuffer outputPositions = createOutputBuffer(inputPositions);
+	if (!outputPositions.isValid()) return kDeformerFailure;
+	cl_uint positionCount = inputPositions.elementCount();
+
+	float envelope = block.inputValue(MPxDeformerNode::envelope).asFloat();
+
+	// Only the weights change from one evaluation to the next
+	const std::vector<double> &weights = node->getWeights();
+	hostWeights.assign(weights.begin(), weights.end());
+	// Deltas stored for shapes the definition doesn't have get no weight
+	size_t shapeCount = node->getDeltas().shapeCount();
+	if (hostWeights.size() < shapeCount) hostWeights.resize(shapeCount, 0.0f);
+	if (hostWeights.empty()) hostWeights.push_back(0.0f);
+	if (hostWeights.size() > weightCapacity){
+		if (!createBuffer(clWeights, CL_MEM_READ_ONLY, hostWeights.size() * sizeof(float), nullptr)) return kDeformerFailure;
+		weightCapacity = hostWeights.size();
+	}
+	cl_command_queue queue = MOpenCLInfo::getMayaDefaultOpenCLCommandQueue();
+	cl_int err = clEnqueueWriteBuffer(queue, clWeights.get(), CL_TRUE, 0,
+			hostWeights.size() * sizeof(float), hostWeights.data(), 0, nullptr, nullptr);
+	if (err != CL_SUCCESS) return kDeformerFailure;
+
+	if (kernel.isNull()){
+		kernel = MOpenCLInfo::getOpenCLKernelFromString(MString(kernelSource), "simplexDeformGPU", "simplexDeform");
+		if (kernel.isNull()) return kDeformerFailure;
+	}
+
+	// Points the deltas don't reach aren't in the offsets buffer
+	cl_uint reach = deltaPoints < positionCount ? deltaPoints : positionCount;
+	cl_uint arg = 0;
+	err |= clSetKernelArg(kernel.get(), arg++, sizeof(cl_mem), (void *)outputPositions.buffer().getReadOnlyRef());
+	err |= clSetKernelArg(kernel.get(), arg++, sizeof(cl_mem), (void *)inputPositions.buffer().getReadOnlyRef());
+	err |= clSetKernelArg(kernel.get(), arg++, sizeof(cl_mem), (void *)clPointOffsets.getReadOnlyRef());
+	err |= clSetKernelArg(kernel.get(), arg++, sizeof(cl_mem), (void *)clEntryShapes.getReadOnlyRef());
+	err |= clSetKernelArg(kernel.get(), arg++, sizeof(cl_mem), (void *)clEntryDeltas.getReadOnlyRef());
+	err |= clSetKernelArg(kernel.get(), arg++, sizeof(cl_mem), (void *)clWeights.getReadOnlyRef());
+	err |= clSetKernelArg(kernel.get(), arg++, sizeof(cl_float), (void *)&envelope);
+	err |= clSetKernelArg(kernel.get(), arg++, sizeof(cl_uint), (void *)&reach);
+	err |= clSetKernelArg(kernel.get(), arg++, sizeof(cl_uint), (void *)&positionCount);
+	if (err != CL_SUCCESS) return kDeformerFailure;
+
+	size_t localWorkSize = 256;
+	size_t retSize = 0;
+	err = clGetKernelWorkGroupInfo(kernel.get(), MOpenCLInfo::getOpenCLDeviceId(),
+			CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &localWorkSize, &retSize);
+	if (err != CL_SUCCESS || retSize == 0 || localWorkSize == 0) localWorkSize = 256;
+	size_t globalWorkSize = ((positionCount + localWorkSize - 1) / localWorkSize) * localWorkSize;
+
+	MAutoCLEvent syncEvent;
+	const cl_event *waitEvent = inputPositions.bufferReadyEvent().getReadOnlyRef();
+	err = clEnqueueNDRangeKernel(queue, kernel.get(), 1, nullptr, &globalWorkSize, &localWorkSize,
+			(*waitEvent) ? 1 : 0, (*waitEvent) ? waitEvent : nullptr, syncEvent.getReferenceForAssignment());
+	if (err != CL_SUCCESS) return kDeformerFailure;
+
+	outputPositions.setBufferReadyEvent(syncEvent);
+	outputData.setBuffer(outputPositions);
+	return kDeformerSuccess;
+}
+
+#endif
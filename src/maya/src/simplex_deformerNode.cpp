@@ -0,0 +1,446 @@
+/*
+Copyright 2016, Blur Studio
+
+This file is part of Simplex.
+
+Simplex is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Simplex is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Simplex.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "simplex_deformerNode.h"
+
+#include <maya/MDataBlock.h>
+#include <maya/MDataHandle.h>
+#include <maya/MArrayDataHandle.h>
+#include <maya/MFnCompoundAttribute.h>
+#include <maya/MFnIntArrayData.h>
+#include <maya/MFnMesh.h>
+#include <maya/MFnNumericAttribute.h>
+#include <maya/MFnStringData.h>
+#include <maya/MFnTypedAttribute.h>
+#include <maya/MFnVectorArrayData.h>
+#include <maya/MIntArray.h>
+#include <maya/MItGeometry.h>
+#include <maya/MPlug.h>
+#include <maya/MPointArray.h>
+#include <maya/MVectorArray.h>
+
+#include <algorithm> // for min
+#include <iostream>
+#include <string>
+
+#define CHECKSTAT(s)  if (!(s)) { (s).perror("simplex_deformer"); return (s);}
+
+// For linux and apple
+typedef unsigned int UINT;
+
+MTypeId simplex_deformer::id(0x001226C9);
+
+MObject simplex_deformer::aSliders;
+MObject simplex_deformer::aDefinition;
+MObject simplex_deformer::aExactSolve;
+MObject simplex_deformer::aShapeDeltas;
+MObject simplex_deformer::aDeltaIndices;
+MObject simplex_deformer::aDeltaValues;
+
+MStatus simplex_deformer::readDeltas(MDataBlock& data, simplex::ShapeDeltas &out){
+	MStatus status;
+	MArrayDataHandle deltaArray = data.inputArrayValue(aShapeDeltas, &status);
+	CHECKSTAT(status);
+
+	out.clear();
+	std::vector<uint32_t> indices;
+	std::vector<float> xyz;
+	// Sparse array elements come in logical index order, which addShape needs
+	for (UINT physIdx = 0; physIdx < deltaArray.elementCount(); ++physIdx){
+		deltaArray.jumpToArrayElement(physIdx);
+		UINT shapeIdx = deltaArray.elementIndex();
+		MDataHandle shapeData = deltaArray.inputValue(&status);
+		CHECKSTAT(status);
+
+		MFnIntArrayData indexData(shapeData.child(aDeltaIndices).data());
+		MFnVectorArrayData valueData(shapeData.child(aDeltaValues).data());
+		MIntArray idxArray = indexData.array();
+		MVectorArray valArray = valueData.array();
+		UINT count = std::min(idxArray.length(), valArray.length());
+
+		indices.clear();
+		xyz.clear();
+		for (UINT i = 0; i < count; ++i){
+			if (idxArray[i] < 0) continue;
+			indices.push_back((uint32_t)idxArray[i]);
+			xyz.push_back((float)valArray[i].x);
+			xyz.push_back((float)valArray[i].y);
+			xyz.push_back((float)valArray[i].z);
+		}
+		out.addShape(shapeIdx, indices.data(), xyz.data(), indices.size());
+	}
+	return MS::kSuccess;
+}
+
+std::shared_ptr<const simplex::Simplex> simplex_deformer::acquireSimplex(MDataBlock& data, MStatus &status){
+	MDataHandle jsonData = data.inputValue(aDefinition, &status);
+	if (!status) return std::shared_ptr<const simplex::Simplex>();
+	const MString &ss = jsonData.asString();
+	int ssLen = 0;
+	const char *ssBuf = ss.asChar(ssLen);
+	return simplex::SimplexCache::acquire(ssBuf, (size_t)ssLen);
+}
+
+MStatus simplex_deformer::updateSimplex(MDataBlock& data){
+	MStatus status;
+	if (!simplexIsValid){
+		std::shared_ptr<const simplex::Simplex> rig = acquireSimplex(data, status);
+		CHECKSTAT(status);
+		{
+			std::lock_guard<std::mutex> lock(rigMutex);
+			this->sPointer = rig;
+		}
+		simplexIsValid = true;
+		if (rig->hasParseError){
+			if (!this->jsErrorReported){
+				std::cerr << "JSON PARSE ERROR: " << rig->parseError <<
+					" \n    At offset: " << std::to_string(rig->parseErrorOffset) << "\n";
+				this->jsErrorReported = true;
+			}
+			return MS::kFailure;
+		}
+	}
+	if (this->sPointer->hasParseError)
+		return MS::kFailure;
+	return MS::kSuccess;
+}
+
+MStatus simplex_deformer::readSolveInputs(MDataBlock& data, std::vector<double> &inVec, bool &exact){
+	MStatus status;
+	MArrayDataHandle inputData = data.inputArrayValue(aSliders, &status);
+	CHECKSTAT(status);
+	inVec.assign(inputData.elementCount(), 0.0);
+	for (UINT physIdx = 0; physIdx < inputData.elementCount(); ++physIdx){
+		inputData.jumpToArrayElement(physIdx);
+		auto valueHandle = inputData.inputValue(&status);
+		CHECKSTAT(status);
+		UINT trueIdx = inputData.elementIndex();
+		if (trueIdx >= inVec.size()){
+			inVec.resize(trueIdx+1);
+		}
+		inVec[trueIdx] = valueHandle.asDouble();
+	}
+
+	MDataHandle exactSolve = data.inputValue(aExactSolve, &status);
+	CHECKSTAT(status);
+	exact = exactSolve.asBool();
+	return MS::kSuccess;
+}
+
+std::unique_ptr<simplex_deformer::ContextDeform> simplex_deformer::takeContextDeform(){
+	std::lock_guard<std::mutex> lock(contextMutex);
+	if (contextDeforms.empty())
+		return std::unique_ptr<ContextDeform>(new ContextDeform());
+	std::unique_ptr<ContextDeform> deform = std::move(contextDeforms.back());
+	contextDeforms.pop_back();
+	return deform;
+}
+
+void simplex_deformer::giveContextDeform(std::unique_ptr<ContextDeform> deform){
+	std::lock_guard<std::mutex> lock(contextMutex);
+	contextDeforms.push_back(std::move(deform));
+}
+
+simplex::SolveProfile simplex_deformer::getProfile(){
+	simplex::SolveProfile out;
+	{
+		std::lock_guard<std::mutex> lock(rigMutex);
+		if (sPointer) out = sPointer->getBuildProfile();
+	}
+	out.merge(state.profile);
+	// Any deform that's running right now isn't included
+	std::lock_guard<std::mutex> lock(contextMutex);
+	for (auto cit = contextDeforms.begin(); cit != contextDeforms.end(); ++cit){
+		out.merge((*cit)->state.profile);
+	}
+	return out;
+}
+
+void simplex_deformer::clearProfile(){
+	state.profile.clear();
+	std::lock_guard<std::mutex> lock(contextMutex);
+	for (auto cit = contextDeforms.begin(); cit != contextDeforms.end(); ++cit){
+		(*cit)->state.profile.clear();
+	}
+}
+
+MStatus simplex_deformer::solveWeights(MDataBlock& data, simplex::SolverState &solveState, std::vector<double> &weights){
+	MStatus status = updateSimplex(data);
+	if (!status) return status;
+	std::vector<double> inVec;
+	bool exact = true;
+	status = readSolveInputs(data, inVec, exact);
+	if (!status) return status;
+
+	weights.resize(this->sPointer->shapeLen());
+	this->sPointer->solveIncremental(solveState, inVec.data(), inVec.size(), weights.data(), exact);
+	return MS::kSuccess;
+}
+
+MStatus simplex_deformer::update(MDataBlock& data){
+	MStatus status;
+	if (!deltasAreValid){
+		// Built on the side and swapped in, because other contexts may still be reading the old ones
+		std::shared_ptr<simplex::ShapeDeltas> fresh = std::make_shared<simplex::ShapeDeltas>();
+		status = readDeltas(data, *fresh);
+		CHECKSTAT(status);
+		{
+			std::lock_guard<std::mutex> lock(rigMutex);
+			deltas = fresh;
+		}
+		deltasAreValid = true;
+		++deltasVersion;
+	}
+	// Solve once per evaluation, not once per deformed geometry
+	if (!cacheIsValid && !deltas->empty()){
+		status = solveWeights(data, state, cache);
+		if (!status) return status;
+		cacheIsValid = true;
+	}
+	return MS::kSuccess;
+}
+
+MStatus simplex_deformer::accumulateContext(MDataBlock& data, ContextDeform &deform, float env, size_t &pointCount){
+	MStatus status;
+	// The normal context's solver and deltas are reused when they're current,
+	// anything else is read here and dropped afterwards
+	std::shared_ptr<const simplex::Simplex> rig;
+	std::shared_ptr<const simplex::ShapeDeltas> shapes;
+	{
+		std::lock_guard<std::mutex> lock(rigMutex);
+		if (simplexIsValid) rig = this->sPointer;
+		if (deltasAreValid) shapes = this->deltas;
+	}
+	if (!shapes){
+		std::shared_ptr<simplex::ShapeDeltas> local = std::make_shared<simplex::ShapeDeltas>();
+		status = readDeltas(data, *local);
+		CHECKSTAT(status);
+		shapes = local;
+	}
+	pointCount = 0;
+	if (shapes->empty())
+		return MS::kSuccess;
+	if (!rig){
+		rig = acquireSimplex(data, status);
+		CHECKSTAT(status);
+	}
+	if (rig->hasParseError)
+		return MS::kFailure;
+
+	bool exact = true;
+	status = readSolveInputs(data, deform.inVec, exact);
+	if (!status) return status;
+	// That's always a full solve, so it only lists the active shapes
+	rig->solveSparse(deform.state, deform.inVec.data(), deform.inVec.size(), deform.weights, exact);
+
+	pointCount = shapes->pointCount();
+	deform.accum.assign(3 * pointCount, 0.0f);
+	shapes->accumulate(deform.weights, env, deform.accum.data());
+	return MS::kSuccess;
+}
+
+MStatus simplex_deformer::addOffsets(MDataBlock& data, MItGeometry& iter, unsigned int multiIndex,
+		const std::vector<float> &offsets, size_t pointCount, std::vector<unsigned int> &memberScratch){
+	MStatus status;
+	MPointArray pts;
+	status = iter.allPositions(pts);
+	CHECKSTAT(status);
+
+	// When the whole mesh is deformed the positions line up with the
+	// vertex indices. Otherwise look up which point each position is
+	bool wholeMesh = false;
+	// The input was already evaluated to get here, so read it without pulling
+	MArrayDataHandle inputArray = data.outputArrayValue(input, &status);
+	CHECKSTAT(status);
+	if (inputArray.jumpToElement(multiIndex)){
+		MDataHandle geomData = inputArray.outputValue(&status).child(inputGeom);
+		MObject geom = geomData.data();
+		if (geom.hasFn(MFn::kMesh)){
+			MFnMesh meshFn(geom);
+			wholeMesh = (meshFn.numVertices() == (int)pts.length());
+		}
+	}
+
+	UINT count = pts.length();
+	if (wholeMesh){
+		UINT limit = std::min(count, (UINT)pointCount);
+		for (UINT i = 0; i < limit; ++i){
+			const float *d = &offsets[3 * i];
+			pts[i].x += d[0];
+			pts[i].y += d[1];
+			pts[i].z += d[2];
+		}
+	}
+	else {
+		memberScratch.clear();
+		for (iter.reset(); !iter.isDone(); iter.next()){
+			memberScratch.push_back((unsigned int)iter.index());
+		}
+		for (UINT i = 0; i < count && i < memberScratch.size(); ++i){
+			if (memberScratch[i] >= pointCount) continue;
+			const float *d = &offsets[3 * memberScratch[i]];
+			pts[i].x += d[0];
+			pts[i].y += d[1];
+			pts[i].z += d[2];
+		}
+	}
+	return iter.setAllPositions(pts);
+}
+
+MStatus simplex_deformer::deform(MDataBlock& data, MItGeometry& iter, const MMatrix& /*mat*/, unsigned int multiIndex){
+	MStatus status;
+	MDataHandle envData = data.inputValue(envelope, &status);
+	CHECKSTAT(status);
+	float env = envData.asFloat();
+	if (env == 0.0f)
+		return MS::kSuccess;
+
+	// Other contexts (like background evaluation) can run alongside the normal
+	// one, so they solve and sum into pooled scratch of their own, and never
+	// replace the solver, deltas or weights the normal context and GPU override use
+	if (!data.context().isNormal()){
+		std::unique_ptr<ContextDeform> deform = takeContextDeform();
+		size_t pointCount = 0;
+		status = accumulateContext(data, *deform, env, pointCount);
+		if (status && pointCount)
+			status = addOffsets(data, iter, multiIndex, deform->accum, pointCount, deform->members);
+		giveContextDeform(std::move(deform));
+		return status;
+	}
+
+	status = update(data);
+	if (!status) return status;
+	if (deltas->empty())
+		return MS::kSuccess;
+
+	// Add up every shape with a non-zero weight in one pass over the
+	// packed offsets, then apply the sum with a single bulk get and set
+	size_t pointCount = deltas->pointCount();
+	accum.assign(3 * pointCount, 0.0f);
+	deltas->accumulate(cache.data(), cache.size(), env, accum.data());
+	return addOffsets(data, iter, multiIndex, accum, pointCount, members);
+}
+
+MStatus simplex_deformer::preEvaluation(const MDGContext& context, const MEvaluationNode& evaluationNode){
+	MStatus status;
+	if (context.isNormal()){
+		if (evaluationNode.dirtyPlugExists(aDefinition, &status) && status){
+			this->simplexIsValid = false;
+			this->cacheIsValid = false;
+		}
+		if (evaluationNode.dirtyPlugExists(aSliders, &status) && status){
+			this->cacheIsValid = false;
+		}
+		if (evaluationNode.dirtyPlugExists(aExactSolve, &status) && status){
+			this->cacheIsValid = false;
+		}
+		if (evaluationNode.dirtyPlugExists(aShapeDeltas, &status) && status){
+			this->deltasAreValid = false;
+		}
+	}
+	return MPxDeformerNode::preEvaluation(context, evaluationNode);
+}
+
+MStatus simplex_deformer::setDependentsDirty(const MPlug& plug, MPlugArray& plugArray){
+	if (plug == aDefinition){
+		this->simplexIsValid = false;
+		this->cacheIsValid = false;
+		this->jsErrorReported = false;
+	}
+	if (plug == aSliders || plug == aExactSolve){
+		this->cacheIsValid = false;
+	}
+	if (plug == aShapeDeltas || plug == aDeltaIndices || plug == aDeltaValues){
+		this->deltasAreValid = false;
+	}
+	return MPxDeformerNode::setDependentsDirty(plug, plugArray);
+}
+
+void* simplex_deformer::creator(){
+	return new simplex_deformer();
+}
+
+MStatus simplex_deformer::initialize(){
+	MFnNumericAttribute nAttr;
+	MFnTypedAttribute tAttr;
+	MFnCompoundAttribute cAttr;
+	MFnStringData sData;
+	MStatus status, status2;
+
+	simplex_deformer::aExactSolve = nAttr.create("exactSolve", "es", MFnNumericData::kBoolean, true, &status);
+	CHECKSTAT(status);
+	nAttr.setKeyable(false);
+	nAttr.setReadable(true);
+	nAttr.setWritable(true);
+	status = simplex_deformer::addAttribute(simplex_deformer::aExactSolve);
+	CHECKSTAT(status);
+
+	simplex_deformer::aDefinition = tAttr.create("definition", "d", MFnData::kString, sData.create(&status2), &status);
+	CHECKSTAT(status);
+	CHECKSTAT(status2);
+	tAttr.setStorable(true);
+	tAttr.setKeyable(true);
+	status = simplex_deformer::addAttribute(simplex_deformer::aDefinition);
+	CHECKSTAT(status);
+
+	// Input sliders
+	simplex_deformer::aSliders = nAttr.create("sliders", "s", MFnNumericData::kDouble, 0.0, &status);
+	CHECKSTAT(status);
+	nAttr.setKeyable(true);
+	nAttr.setReadable(false);
+	nAttr.setWritable(true);
+	nAttr.setArray(true);
+	nAttr.setUsesArrayDataBuilder(true);
+	status = simplex_deformer::addAttribute(simplex_deformer::aSliders);
+	CHECKSTAT(status);
+
+	// The per-shape offsets, stored under each shape's index
+	simplex_deformer::aDeltaIndices = tAttr.create("deltaIndices", "di", MFnData::kIntArray, MObject::kNullObj, &status);
+	CHECKSTAT(status);
+	tAttr.setStorable(true);
+	simplex_deformer::aDeltaValues = tAttr.create("deltaValues", "dv", MFnData::kVectorArray, MObject::kNullObj, &status);
+	CHECKSTAT(status);
+	tAttr.setStorable(true);
+	simplex_deformer::aShapeDeltas = cAttr.create("shapeDeltas", "sd", &status);
+	CHECKSTAT(status);
+	status = cAttr.addChild(simplex_deformer::aDeltaIndices);
+	CHECKSTAT(status);
+	status = cAttr.addChild(simplex_deformer::aDeltaValues);
+	CHECKSTAT(status);
+	cAttr.setArray(true);
+	cAttr.setUsesArrayDataBuilder(true);
+	status = simplex_deformer::addAttribute(simplex_deformer::aShapeDeltas);
+	CHECKSTAT(status);
+
+	// Set data dependencies
+	status = attributeAffects(aSliders, outputGeom);
+	CHECKSTAT(status);
+	status = attributeAffects(aDefinition, outputGeom);
+	CHECKSTAT(status);
+	status = attributeAffects(aExactSolve, outputGeom);
+	CHECKSTAT(status);
+	status = attributeAffects(aShapeDeltas, outputGeom);
+	CHECKSTAT(status);
+	status = attributeAffects(aDeltaIndices, outputGeom);
+	CHECKSTAT(status);
+	status = attributeAffects(aDeltaValues, outputGeom);
+	CHECKSTAT(status);
+
+	return MS::kSuccess;
+}
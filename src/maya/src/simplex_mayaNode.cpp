@@ -22,11 +22,23 @@ along with Simplex.  If not, see <http://www.gnu.org/licenses/>.
 #include <maya/MDataBlock.h>
 #include <maya/MDataHandle.h>
 #include <maya/MGlobal.h>
+#include <maya/MAnimControl.h>
+#include <maya/MEvaluationNodeIterator.h>
+#include <maya/MFnDependencyNode.h>
+#include <maya/MUuid.h>
+#include <chrono>
+#include <cmath> // for fabs
+#include <condition_variable>
+#include <limits>
 #include <string>
+#include <thread>
 #include <iostream>
 
 #define CHECKSTAT(s)  if (!(s)) { (s).perror("attributeAffects"); return (s);}
 
+// Output weights that move less than this aren't worth dirtying a blendShape over
+#define WEIGHT_EPSILON 1.0e-7
+
 // For linux and apple
 typedef unsigned int UINT;
 
@@ -38,85 +50,393 @@ MObject	simplex_maya::aWeights;
 MObject	simplex_maya::aDefinition;
 MObject	simplex_maya::aMinorUpdate;
 MObject	simplex_maya::aExactSolve;
+MObject	simplex_maya::aResultCacheSize;
+MObject	simplex_maya::aResultCacheQuantum;
+
+
+simplex_maya::simplex_maya() {}
+simplex_maya::~simplex_maya() {}
+
+namespace {
 
+// Read the slider values into inVec, sized to the highest connected index
+MStatus readSliders(MDataBlock& data, std::vector<double> &inVec){
+	MStatus status;
+	MArrayDataHandle inputData = data.inputArrayValue(simplex_maya::aSliders, &status);
+	CHECKSTAT(status);
 
-simplex_maya::simplex_maya() {
-	this->sPointer = new simplex::Simplex();
+	inVec.assign(inputData.elementCount(), 0.0);
+	for (UINT physIdx = 0; physIdx < inputData.elementCount(); ++physIdx){
+		inputData.jumpToArrayElement(physIdx);
+		auto valueHandle = inputData.inputValue(&status);
+		CHECKSTAT(status);
+		UINT trueIdx = inputData.elementIndex();
+		if (trueIdx >= inVec.size()){
+			inVec.resize(trueIdx+1);
+		}
+		inVec[trueIdx] = valueHandle.asDouble();
+	}
+	return MS::kSuccess;
 }
-simplex_maya::~simplex_maya() {
-	delete this->sPointer;
+
+// The background builds that haven't finished yet
+struct BuildCount {
+	std::mutex mutex;
+	std::condition_variable done;
+	size_t running = 0;
+};
+
+BuildCount &buildCount(){
+	static BuildCount builds;
+	return builds;
 }
 
-MStatus simplex_maya::compute(const MPlug& plug, MDataBlock& data) {
+} // namespace
+
+MStatus simplex_maya::writeWeights(MDataBlock& data, const std::vector<double> &weights, std::vector<double> *published){
 	MStatus status;
-	if( plug == aWeights ) {
-		MArrayDataHandle inputData = data.inputArrayValue(aSliders, &status);
+	MArrayDataHandle outputArrayHandle = data.outputArrayValue(simplex_maya::aWeights, &status);
+	CHECKSTAT(status);
+	UINT count = outputArrayHandle.elementCount();
+	if (published && count != publishedCount){
+		// Any new elements haven't been written to yet
+		published->clear();
+		publishedCount = count;
+	}
+	for (UINT physIdx = 0; physIdx < count; ++physIdx){
+		outputArrayHandle.jumpToArrayElement(physIdx);
+		UINT trueIdx = outputArrayHandle.elementIndex();
+		if (trueIdx >= weights.size())
+			continue; // because the cache size can change
+		double val = weights[trueIdx];
+		if (published){
+			// Only touch the weights that moved since they were last written
+			if (trueIdx >= published->size())
+				published->resize(trueIdx + 1, std::numeric_limits<double>::quiet_NaN());
+			double &prev = (*published)[trueIdx];
+			if (fabs(val - prev) <= WEIGHT_EPSILON)
+				continue;
+			prev = val;
+		}
+		auto outHandle = outputArrayHandle.outputValue(&status);
+		CHECKSTAT(status);
+		outHandle.setDouble(val);
+	}
+	outputArrayHandle.setAllClean();
+	return MS::kSuccess;
+}
+
+MStatus simplex_maya::writeWeights(MDataBlock& data, const simplex::SparseWeights &weights, size_t shapeCount){
+	MStatus status;
+	MArrayDataHandle outputArrayHandle = data.outputArrayValue(simplex_maya::aWeights, &status);
+	CHECKSTAT(status);
+	UINT count = outputArrayHandle.elementCount();
+	// The elements usually come in logical index order, so walk
+	// the sorted shape list alongside them instead of searching it
+	size_t pos = 0;
+	UINT prevIdx = 0;
+	for (UINT physIdx = 0; physIdx < count; ++physIdx){
+		outputArrayHandle.jumpToArrayElement(physIdx);
+		UINT trueIdx = outputArrayHandle.elementIndex();
+		if (trueIdx >= shapeCount)
+			continue; // because the cache size can change
+		if (trueIdx < prevIdx)
+			pos = 0;
+		prevIdx = trueIdx;
+		while (pos < weights.size() && weights.indices[pos] < trueIdx)
+			++pos;
+		double val = 0.0;
+		if (pos < weights.size() && weights.indices[pos] == trueIdx)
+			val = weights.weights[pos];
+
+		auto outHandle = outputArrayHandle.outputValue(&status);
 		CHECKSTAT(status);
+		outHandle.setDouble(val);
+	}
+	outputArrayHandle.setAllClean();
+	return MS::kSuccess;
+}
 
-		std::vector<double> inVec;
-		inVec.resize(inputData.elementCount());
+MStatus simplex_maya::readDirtySliders(MDataBlock& data){
+	if (!inputsValid){
+		inputsValid = true;
+		dirtySliders.clear();
+		return readSliders(data, inVec);
+	}
 
-		// Read the input value from the handle.
-		for (UINT physIdx = 0; physIdx < inputData.elementCount(); ++physIdx){
-			inputData.jumpToArrayElement(physIdx);
+	MStatus status;
+	MArrayDataHandle inputData = data.inputArrayValue(aSliders, &status);
+	CHECKSTAT(status);
+	for (auto it = dirtySliders.begin(); it != dirtySliders.end(); ++it){
+		if (*it >= inVec.size()){
+			inVec.resize(*it + 1, 0.0);
+		}
+		// A disconnected or removed element reads as 0, like it does in a full read
+		if (inputData.jumpToElement(*it)){
 			auto valueHandle = inputData.inputValue(&status);
 			CHECKSTAT(status);
-			UINT trueIdx = inputData.elementIndex();
-			if (trueIdx >= inVec.size()){
-				inVec.resize(trueIdx+1);
-			}
-			inVec[trueIdx] = valueHandle.asDouble();
+			inVec[*it] = valueHandle.asDouble();
+		}
+		else {
+			inVec[*it] = 0.0;
 		}
+	}
+	dirtySliders.clear();
+	return MS::kSuccess;
+}
 
-		if (!simplexIsValid || !this->sPointer->loaded){
-			MDataHandle jsonData = data.inputValue(aDefinition, &status);
-			CHECKSTAT(status);
-			MString ss = jsonData.asString();
-			std::string sss(ss.asChar(), ss.length());
-			this->sPointer->clear();
-			this->sPointer->parseJSON(sss);
-			this->sPointer->build();
-
-			simplexIsValid = true;
-			if (this->sPointer->hasParseError){
-                if (!this->jsErrorReported){
-                    cerr << "JSON PARSE ERROR: " << this->sPointer->parseError <<
-                        " \n    At offset: " << std::to_string(this->sPointer->parseErrorOffset) << "\n";
-                    this->jsErrorReported = true;
-                }
+void simplex_maya::sliderDirtied(const MPlug& plug){
+	this->cacheIsValid = false;
+	if (!this->inputsValid)
+		return;
+	// Once the list outgrows the sliders, a full read is cheaper anyway
+	if (plug.isElement() && this->dirtySliders.size() < this->inVec.size()){
+		this->dirtySliders.push_back(plug.logicalIndex());
+	}
+	else {
+		// The whole array needs to be read
+		this->inputsValid = false;
+		this->dirtySliders.clear();
+	}
+}
+
+std::shared_ptr<const simplex::Simplex> simplex_maya::acquireSimplex(MDataBlock& data, MStatus &status){
+	MDataHandle jsonData = data.inputValue(aDefinition, &status);
+	if (!status) return std::shared_ptr<const simplex::Simplex>();
+	// Nodes with the same definition share one parsed and built solver
+	const MString &ss = jsonData.asString();
+	int ssLen = 0;
+	const char *ssBuf = ss.asChar(ssLen);
+	return simplex::SimplexCache::acquire(ssBuf, (size_t)ssLen);
+}
+
+MStatus simplex_maya::updateSimplex(MDataBlock& data){
+	MStatus status;
+	MDataHandle jsonData = data.inputValue(aDefinition, &status);
+	CHECKSTAT(status);
+	const MString &ss = jsonData.asString();
+	int ssLen = 0;
+	const char *ssBuf = ss.asChar(ssLen);
+	std::string_view definition(ssBuf, (size_t)ssLen);
+
+	// Another node may have built it already
+	std::shared_ptr<const simplex::Simplex> rig = simplex::SimplexCache::find(definition);
+	bool building = pending && pending->definition == definition;
+	if (!rig && building && pending->rig.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+		rig = pending->rig.get();
+
+	if (!rig){
+		MDataHandle minorData = data.inputValue(aMinorUpdate, &status);
+		CHECKSTAT(status);
+		// Without a working solver to fall back on, there's nothing to serve
+		// in the meantime, so the first load still blocks
+		if (minorData.asBool() && this->sPointer && !this->sPointer->hasParseError){
+			if (!building)
+				startBuild(definition);
+			return MS::kSuccess;
+		}
+		// Wait on the build that's already running rather than starting another
+		rig = building ? pending->rig.get() : simplex::SimplexCache::acquire(definition);
+	}
+
+	// Any build of an older definition is abandoned
+	pending.reset();
+	{
+		std::lock_guard<std::mutex> lock(rigMutex);
+		this->sPointer = rig;
+	}
+	simplexIsValid = true;
+	cacheIsValid = false;
+	published.clear();
+	if (rig->hasParseError){
+		if (!this->jsErrorReported){
+			cerr << "JSON PARSE ERROR: " << rig->parseError <<
+				" \n    At offset: " << std::to_string(rig->parseErrorOffset) << "\n";
+			this->jsErrorReported = true;
+		}
+		return MS::kFailure;
+	}
+	return MS::kSuccess;
+}
+
+void simplex_maya::startBuild(std::string_view definition){
+	auto build = std::make_shared<PendingBuild>();
+	build->definition = std::string(definition);
+	auto promise = std::make_shared<std::promise<std::shared_ptr<const simplex::Simplex>>>();
+	build->rig = promise->get_future().share();
+	pending = build;
+
+	// Once it's built, the weights are dirtied so the next evaluation swaps it in
+	// The node is found by uuid when that runs, in case it was renamed or deleted
+	MFnDependencyNode fnNode(thisMObject());
+	MString refresh("{ string $simplexNodes[] = `ls \"");
+	refresh += fnNode.uuid().asString();
+	refresh += "\"`; if (size($simplexNodes)) dgdirty ($simplexNodes[0] + \".weights\"); }";
+
+	BuildCount &builds = buildCount();
+	{
+		std::lock_guard<std::mutex> lock(builds.mutex);
+		++builds.running;
+	}
+	std::thread([build, promise, refresh](){
+		promise->set_value(simplex::SimplexCache::acquire(build->definition));
+		MGlobal::executeCommandOnIdle(refresh);
+
+		BuildCount &builds = buildCount();
+		std::lock_guard<std::mutex> lock(builds.mutex);
+		--builds.running;
+		builds.done.notify_all();
+	}).detach();
+}
+
+void simplex_maya::waitForBuilds(){
+	BuildCount &builds = buildCount();
+	std::unique_lock<std::mutex> lock(builds.mutex);
+	builds.done.wait(lock, [&builds]{ return builds.running == 0; });
+}
+
+MStatus simplex_maya::applyResultCache(MDataBlock& data){
+	MStatus status;
+	MDataHandle sizeData = data.inputValue(aResultCacheSize, &status);
+	CHECKSTAT(status);
+	MDataHandle quantumData = data.inputValue(aResultCacheQuantum, &status);
+	CHECKSTAT(status);
+	int size = sizeData.asInt();
+	size_t capacity = (size > 0) ? (size_t)size : 0;
+	double quantum = quantumData.asDouble();
+
+	// The cache belongs to the shared solver. It's only configured when this
+	// node's settings change, or it gets a new solver while it wants a cache,
+	// so nodes with different settings don't keep emptying it for each other
+	bool changed = capacity != cacheCapacity || quantum != cacheQuantum;
+	if (changed || (cacheRig != this->sPointer.get() && capacity != 0))
+		this->sPointer->resultCache().configure(capacity, quantum);
+	cacheCapacity = capacity;
+	cacheQuantum = quantum;
+	cacheRig = this->sPointer.get();
+	return MS::kSuccess;
+}
+
+simplex::SolveCacheStats simplex_maya::getResultCacheStats(){
+	std::lock_guard<std::mutex> lock(rigMutex);
+	if (!sPointer) return simplex::SolveCacheStats();
+	return sPointer->resultCache().getStats();
+}
+
+std::unique_ptr<simplex_maya::ContextSolve> simplex_maya::takeContextSolve(){
+	std::lock_guard<std::mutex> lock(contextMutex);
+	if (contextSolves.empty())
+		return std::unique_ptr<ContextSolve>(new ContextSolve());
+	std::unique_ptr<ContextSolve> solve = std::move(contextSolves.back());
+	contextSolves.pop_back();
+	return solve;
+}
+
+void simplex_maya::giveContextSolve(std::unique_ptr<ContextSolve> solve){
+	std::lock_guard<std::mutex> lock(contextMutex);
+	contextSolves.push_back(std::move(solve));
+}
+
+simplex::SolveProfile simplex_maya::getProfile(){
+	simplex::SolveProfile out;
+	{
+		std::lock_guard<std::mutex> lock(rigMutex);
+		if (sPointer) out = sPointer->getBuildProfile();
+	}
+	out.merge(state.profile);
+	// Any solve that's running right now isn't included
+	std::lock_guard<std::mutex> lock(contextMutex);
+	for (auto cit = contextSolves.begin(); cit != contextSolves.end(); ++cit){
+		out.merge((*cit)->state.profile);
+	}
+	return out;
+}
+
+void simplex_maya::clearProfile(){
+	state.profile.clear();
+	std::lock_guard<std::mutex> lock(contextMutex);
+	for (auto cit = contextSolves.begin(); cit != contextSolves.end(); ++cit){
+		(*cit)->state.profile.clear();
+	}
+}
+
+MStatus simplex_maya::compute(const MPlug& plug, MDataBlock& data) {
+	MStatus status;
+	if( plug == aWeights ) {
+		MDataHandle exactSolve = data.inputValue(aExactSolve, &status);
+		CHECKSTAT(status);
+		// The shared solver can't hold this node's setting, so it's passed to the solve
+		bool exact = exactSolve.asBool();
+
+		if (!data.context().isNormal()){
+			// Background and cached playback evaluation. The normal context's
+			// solver is reused when it's current, but its cache is left alone
+			std::shared_ptr<const simplex::Simplex> rig;
+			if (simplexIsValid){
+				std::lock_guard<std::mutex> lock(rigMutex);
+				rig = this->sPointer;
+			}
+			if (!rig){
+				rig = acquireSimplex(data, status);
+				CHECKSTAT(status);
+			}
+			if (rig->hasParseError)
 				return MS::kFailure;
+
+			std::unique_ptr<ContextSolve> solve = takeContextSolve();
+			status = readSliders(data, solve->inVec);
+			if (status){
+				// These are full solves, so only visit the shapes that are active
+				rig->solveSparse(solve->state, solve->inVec.data(), solve->inVec.size(), solve->outWeights, exact);
+				status = writeWeights(data, solve->outWeights, rig->shapeLen());
 			}
+			giveContextSolve(std::move(solve));
+			// Switching contexts can leave the normal datablock holding
+			// values this node didn't write, so don't trust what it last wrote
+			publishedStale = true;
+			CHECKSTAT(status);
+			data.setClean(plug);
+			return MS::kSuccess;
 		}
 
-		if (this->sPointer->loaded){
-            MDataHandle exactSolve = data.inputValue(aExactSolve, &status);
-			CHECKSTAT(status);
-            this->sPointer->setExactSolve(exactSolve.asBool());
-        }
+		// Only re-read the sliders that were dirtied since the last compute
+		status = readDirtySliders(data);
+		CHECKSTAT(status);
+
+		// While a new definition builds in the background, the old solver keeps serving
+		if (!simplexIsValid){
+			status = updateSimplex(data);
+			if (!status) return status;
+		}
 
-		inVec.resize(this->sPointer->sliderLen());
+		status = applyResultCache(data);
+		CHECKSTAT(status);
+
+		// The output datablock only still holds what this node last wrote
+		// if nothing else set it in between. A new time may have had its
+		// weights restored without a compute, and so may a compute that's
+		// pulled without anything to solve, so every weight is written again
+		MTime now = MAnimControl::currentTime();
+		if (publishedStale.exchange(false) || now != publishedTime)
+			published.clear();
+		publishedTime = now;
 
 		if (!cacheIsValid){
 			cacheIsValid = true;
-			this->sPointer->clearValues();
-			cache = this->sPointer->solve(inVec);
+			cache.resize(this->sPointer->shapeLen());
+			// The cache still holds the last solve, so only
+			// the shapes downstream of the changed sliders are updated
+			// Extra inputs past the slider count are ignored by the solve
+			this->sPointer->solveIncremental(state, inVec.data(), inVec.size(), cache.data(), exact);
 		}
-
-		// Set the output weights
-		MArrayDataHandle outputArrayHandle = data.outputArrayValue(simplex_maya::aWeights, &status);
-		CHECKSTAT(status);
-		for (UINT physIdx = 0; physIdx < outputArrayHandle.elementCount(); ++physIdx){
-			outputArrayHandle.jumpToArrayElement(physIdx);
-			UINT trueIdx = outputArrayHandle.elementIndex();
-			auto outHandle = outputArrayHandle.outputValue(&status);
-			CHECKSTAT(status);
-			if (trueIdx < cache.size()) {
-				// because the cache size can change
-				outHandle.setDouble(cache[trueIdx]);
-			}
+		else {
+			published.clear();
 		}
 
-		outputArrayHandle.setAllClean();
+		// Set the output weights that changed, unless the evaluation
+		// cache may have restored some of them behind this node's back
+		status = writeWeights(data, cache, evaluationCached ? nullptr : &published);
+		CHECKSTAT(status);
 		data.setClean(plug);
 	}
 	else {
@@ -128,6 +448,7 @@ MStatus simplex_maya::compute(const MPlug& plug, MDataBlock& data) {
 
 MStatus simplex_maya::preEvaluation(const  MDGContext& context, const MEvaluationNode& evaluationNode){
     MStatus status;
+    // Other contexts don't use the cached solve, so there's nothing to invalidate
     if (context.isNormal()){
         if (evaluationNode.dirtyPlugExists(aDefinition, &status) && status){
             this->simplexIsValid = false;
@@ -135,17 +456,49 @@ MStatus simplex_maya::preEvaluation(const  MDGContext& context, const MEvaluatio
         }
         if (evaluationNode.dirtyPlugExists(aSliders, &status) && status){
             this->cacheIsValid = false;
+            // Collect which sliders changed, so compute only reads those
+            MEvaluationNodeIterator dirtyIt = evaluationNode.iterator(&status);
+            if (status){
+                for (; !dirtyIt.isDone(); dirtyIt.next()){
+                    MPlug dirtyPlug = dirtyIt.plug();
+                    if (dirtyPlug == aSliders)
+                        sliderDirtied(dirtyPlug);
+                }
+            }
+            else {
+                this->inputsValid = false;
+            }
         }
         if (evaluationNode.dirtyPlugExists(aExactSolve, &status) && status){
             this->cacheIsValid = false;
         }
-    }
-    else {
-        return MS::kFailure;
+        // A new quantum changes the results
+        if (evaluationNode.dirtyPlugExists(aResultCacheQuantum, &status) && status){
+            this->cacheIsValid = false;
+        }
     }
 	return MS::kSuccess;
 }
 
+MPxNode::SchedulingType simplex_maya::schedulingType() const {
+	// The shared solvers are read-only, and all of the
+	// mutable state belongs to this node or one of its contexts
+	return MPxNode::kParallel;
+}
+
+#if MAYA_API_VERSION >= 20200000
+void simplex_maya::getCacheSetup(const MEvaluationNode& evalNode, MNodeCacheDisablingInfo& disablingInfo,
+		MNodeCacheSetupInfo& cacheSetupInfo, MObjectArray& monitoredAttributes) const {
+	MPxNode::getCacheSetup(evalNode, disablingInfo, cacheSetupInfo, monitoredAttributes);
+	// The weights only depend on the inputs, so they can always be cached
+	cacheSetupInfo.setPreference(MNodeCacheSetupInfo::kWantToCacheByDefault, true);
+	// A cached frame's weights are restored into the datablock without a
+	// compute, so from now on the normal context writes all of them
+	if (!disablingInfo.getCacheDisabled())
+		evaluationCached = true;
+}
+#endif
+
 MStatus simplex_maya::setDependentsDirty(const MPlug& plug, MPlugArray& plugArray){
 	if (plug == aDefinition){
 		this->simplexIsValid = false;
@@ -153,9 +506,9 @@ MStatus simplex_maya::setDependentsDirty(const MPlug& plug, MPlugArray& plugArra
 		this->jsErrorReported = false;
 	}
 	if (plug == aSliders){
-		this->cacheIsValid = false;
+		sliderDirtied(plug);
 	}
-	if (plug == aExactSolve){
+	if (plug == aExactSolve || plug == aResultCacheQuantum){
 		this->cacheIsValid = false;
 	}
 	return MPxNode::setDependentsDirty(plug, plugArray);
@@ -171,7 +524,8 @@ MStatus simplex_maya::initialize(){
 	MFnStringData	sData;
 	MStatus	status, status2;
 
-	// Input sliders
+	// Build changed definitions in the background instead of blocking
+	// the evaluation, for live editing. Turning it off waits on the build
 	simplex_maya::aMinorUpdate = nAttr.create("minorUpdate", "mu", MFnNumericData::kBoolean, false, &status);
 	CHECKSTAT(status);
 	nAttr.setKeyable(false);
@@ -188,6 +542,29 @@ MStatus simplex_maya::initialize(){
 	status = simplex_maya::addAttribute(simplex_maya::aExactSolve);
 	CHECKSTAT(status);
 
+	// Remember the weights of this many recent poses, without solving them again
+	// The cache is shared by every node with the same definition, so the
+	// node whose settings changed last decides them. Zero turns it off
+	simplex_maya::aResultCacheSize = nAttr.create("resultCacheSize", "rcs", MFnNumericData::kInt, 0, &status);
+	CHECKSTAT(status);
+	nAttr.setKeyable(false);
+	nAttr.setReadable(true);
+	nAttr.setWritable(true);
+	nAttr.setMin(0);
+	status = simplex_maya::addAttribute(simplex_maya::aResultCacheSize);
+	CHECKSTAT(status);
+
+	// Snap the sliders to multiples of this before solving, so nearby poses share
+	// a cached result. Zero only reuses a result for the exact same values
+	simplex_maya::aResultCacheQuantum = nAttr.create("resultCacheQuantum", "rcq", MFnNumericData::kDouble, 0.0, &status);
+	CHECKSTAT(status);
+	nAttr.setKeyable(false);
+	nAttr.setReadable(true);
+	nAttr.setWritable(true);
+	nAttr.setMin(0.0);
+	status = simplex_maya::addAttribute(simplex_maya::aResultCacheQuantum);
+	CHECKSTAT(status);
+
 	simplex_maya::aDefinition = tAttr.create("definition", "d", MFnData::kString, sData.create(&status2), &status);
 	CHECKSTAT(status);
 	CHECKSTAT(status2);
@@ -223,6 +600,12 @@ MStatus simplex_maya::initialize(){
 	CHECKSTAT(status);
 	status = attributeAffects(aDefinition, aWeights);
 	CHECKSTAT(status);
+	status = attributeAffects(aMinorUpdate, aWeights);
+	CHECKSTAT(status);
+	status = attributeAffects(aResultCacheSize, aWeights);
+	CHECKSTAT(status);
+	status = attributeAffects(aResultCacheQuantum, aWeights);
+	CHECKSTAT(status);
 
 	return MS::kSuccess;
 }
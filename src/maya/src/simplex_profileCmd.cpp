@@ -0,0 +1,100 @@
+/*
+Copyright 2016, Blur Studio
+
+This file is part of Simplex.
+
+Simplex is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Simplex is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Simplex.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "simplex_profileCmd.h"
+#include "simplex_mayaNode.h"
+#include "simplex_deformerNode.h"
+
+#include <maya/MArgDatabase.h>
+#include <maya/MFnDependencyNode.h>
+#include <maya/MObject.h>
+#include <maya/MSelectionList.h>
+#include <maya/MString.h>
+
+#include <string>
+
+#define resetFlag "-r"
+#define resetFlagLong "-reset"
+
+const char *simplex_profileCmd::name = "simplexProfile";
+
+void* simplex_profileCmd::creator() {
+	return new simplex_profileCmd();
+}
+
+MSyntax simplex_profileCmd::newSyntax() {
+	MSyntax syntax;
+	syntax.addFlag(resetFlag, resetFlagLong);
+	syntax.setObjectType(MSyntax::kSelectionList, 1, 1);
+	syntax.useSelectionAsDefault(true);
+	return syntax;
+}
+
+MStatus simplex_profileCmd::doIt(const MArgList& args) {
+	MStatus status;
+	MArgDatabase argData(syntax(), args, &status);
+	if (!status) return status;
+
+	MSelectionList list;
+	argData.getObjects(list);
+	MObject node;
+	status = list.getDependNode(0, node);
+	if (!status) return status;
+
+	MFnDependencyNode fnNode(node, &status);
+	if (!status) return status;
+
+	bool reset = argData.isFlagSet(resetFlag);
+	simplex::SolveProfile profile;
+	simplex::SolveCacheStats cacheStats;
+	bool hasCache = false;
+	MPxNode *user = fnNode.userNode();
+	if (simplex_maya *sm = dynamic_cast<simplex_maya *>(user)) {
+		profile = sm->getProfile();
+		cacheStats = sm->getResultCacheStats();
+		hasCache = true;
+		if (reset) sm->clearProfile();
+	}
+	else if (simplex_deformer *sd = dynamic_cast<simplex_deformer *>(user)) {
+		profile = sd->getProfile();
+		if (reset) sd->clearProfile();
+	}
+	else {
+		displayError("simplexProfile needs a simplex_maya or simplex_deformer node");
+		return MS::kInvalidParameter;
+	}
+
+	std::string out = "{\"enabled\": ";
+	out += simplex::SolveProfile::enabled() ? "true" : "false";
+	for (size_t i = 0; i < simplex::SolveProfile::fieldCount; ++i) {
+		out += ", \"";
+		out += simplex::SolveProfile::fieldName(i);
+		out += "\": ";
+		out += std::to_string(profile.field(i));
+	}
+	if (hasCache) {
+		out += ", \"cacheHits\": " + std::to_string(cacheStats.hits);
+		out += ", \"cacheMisses\": " + std::to_string(cacheStats.misses);
+		out += ", \"cacheEvictions\": " + std::to_string(cacheStats.evictions);
+		out += ", \"cacheEntries\": " + std::to_string(cacheStats.entries);
+	}
+	out += "}";
+	setResult(MString(out.c_str()));
+	return MS::kSuccess;
+}
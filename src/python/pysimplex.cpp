@@ -2,22 +2,59 @@
 #include <structmember.h>
 
 #include "simplex.h"
+#include <memory>
 #include <string>
-#include <codecvt>
+#include <cstring>
 #include <vector>
-#include <locale>
+#include <mutex>
+
+// The buffer protocol only joined the limited API in 3.11. Builds for
+// an older limited API only take arrays through __array_interface__,
+// so the memoryviews the array solves return can't be passed back as `out`
+#if !defined(Py_LIMITED_API) || Py_LIMITED_API >= 0x030B0000
+#define PYSIMPLEX_HAS_BUFFER
+#endif
+
+// Reading the utf8 of a str without a copy joined the limited API in 3.10
+#if !defined(Py_LIMITED_API) || Py_LIMITED_API >= 0x030A0000
+#define PYSIMPLEX_HAS_UTF8
+#endif
+
+// The built solver is never edited once it's made, so share() can hand it
+// to other instances. Setting a new definition replaces it instead
+struct PySolver {
+    std::shared_ptr<const simplex::Simplex> rig;
+    bool exact = true;
+    // Reused by one solve at a time. Solves that find it busy use their own
+    std::mutex stateMutex;
+    simplex::SolverState state;
+};
 
 typedef struct {
     PyObject_HEAD // No Semicolon for this Macro;
     PyObject *definition;
-    simplex::Simplex *sPointer;
+    PySolver *solver;
 } PySimplex;
 
+// Run a solve with the instance's state, or a temporary one if another thread has it
+template <typename F>
+static void
+withState(PySolver *solver, F solve){
+    std::unique_lock<std::mutex> lock(solver->stateMutex, std::try_to_lock);
+    if (lock.owns_lock()){
+        solve(solver->state);
+    }
+    else {
+        simplex::SolverState local;
+        solve(local);
+    }
+}
+
 static void
 PySimplex_dealloc(PySimplex* self) {
     Py_XDECREF(self->definition);
-    if (self->sPointer != NULL)
-		delete self->sPointer;
+    if (self->solver != NULL)
+        delete self->solver;
     PyObject_Del(self);
 }
 
@@ -26,12 +63,13 @@ PySimplex_new(PyTypeObject *type, PyObject *args, PyObject *kwds) {
 
     PySimplex *self = PyObject_New(PySimplex, type);
     if (self != NULL) {
+        self->solver = new PySolver();
+        self->solver->rig = std::make_shared<const simplex::Simplex>();
         self->definition = PyUnicode_FromString("");
         if (self->definition == NULL) {
             Py_DECREF(self);
             return NULL;
         }
-        self->sPointer = new simplex::Simplex();
     }
 
     return (PyObject *)self;
@@ -47,34 +85,57 @@ static int
 PySimplex_setdefinition(PySimplex* self, PyObject* jsValue, void* closure){
     if (jsValue == NULL || jsValue == Py_None){
         jsValue = PyUnicode_FromString("");
+        if (jsValue == NULL) return -1;
+    }
+    else {
+        Py_INCREF(jsValue);
     }
 
     if (! PyUnicode_Check(jsValue)) {
+        Py_DECREF(jsValue);
         PyErr_SetString(PyExc_TypeError, "The simplex definition must be a string");
         return -1;
     }
 
+    // Parse straight from the str's own utf8
+    const char *simDef = NULL;
+    Py_ssize_t simDefLen = 0;
+#ifdef PYSIMPLEX_HAS_UTF8
+    PyObject *utf8 = NULL;
+    simDef = PyUnicode_AsUTF8AndSize(jsValue, &simDefLen);
+#else
+    PyObject *utf8 = PyUnicode_AsUTF8String(jsValue);
+    if (utf8 != NULL && PyBytes_AsStringAndSize(utf8, (char **)&simDef, &simDefLen) == -1)
+        simDef = NULL;
+#endif
+    if (simDef == NULL){
+        Py_XDECREF(utf8);
+        Py_DECREF(jsValue);
+        return -1;
+    }
+
+    // Build a new solver rather than editing this one, which may be shared
+    // The result cache settings carry over, but not what it held
+    std::shared_ptr<simplex::Simplex> rig = std::make_shared<simplex::Simplex>();
+    rig->resultCache() = self->solver->rig->resultCache();
+    Py_BEGIN_ALLOW_THREADS
+    rig->parseJSON(simDef, (size_t)simDefLen);
+    rig->build();
+    Py_END_ALLOW_THREADS
+    Py_XDECREF(utf8);
+
+    // Nothing waits for running solves here. Every solve copies the
+    // shared_ptr while it holds the GIL, so it keeps the old solver alive
+    self->solver->rig = rig;
     PyObject *tmp = self->definition;
-    Py_INCREF(jsValue);
     self->definition = jsValue;
     Py_DECREF(tmp);
-
-    // Get the unicode as a wstring, and a wstring to string converter
-    std::wstring simDefw = std::wstring(PyUnicode_AsWideCharString(self->definition, NULL));
-    std::wstring_convert<std::codecvt_utf8<wchar_t>> myconv;
-    std::string simDef = myconv.to_bytes(simDefw);
-
-    // set the definition in the solver
-    self->sPointer->clear();
-    self->sPointer->parseJSON(simDef);
-    self->sPointer->build();
-
     return 0;
 }
 
 static PyObject *
 PySimplex_getexactsolve(PySimplex* self, void* closure){
-    if (self->sPointer->getExactSolve()){
+    if (self->solver->exact){
         Py_RETURN_TRUE;
     }
     Py_RETURN_FALSE;
@@ -88,16 +149,17 @@ PySimplex_setexactsolve(PySimplex* self, PyObject* exact, void* closure){
         return -1;
     }
 
-    self->sPointer->setExactSolve((truthy == 1));
+    // Only for this instance. Each solve reads it before releasing the GIL
+    self->solver->exact = (truthy == 1);
     return 0;
 }
 
 static int
 PySimplex_init(PySimplex *self, PyObject *args, PyObject *kwds) {
-    PyObject *jsValue=NULL, *tmp=NULL;
+    PyObject *jsValue=NULL;
 
     char jsValueLiteral[] = "jsValue";
-    static char *kwlist[] = {jsValueLiteral, NULL};
+    char *kwlist[] = {jsValueLiteral, NULL};
 
     if (! PyArg_ParseTupleAndKeywords(args, kwds, "|O", kwlist, &jsValue))
         return -1;
@@ -105,27 +167,130 @@ PySimplex_init(PySimplex *self, PyObject *args, PyObject *kwds) {
     return PySimplex_setdefinition(self, jsValue, NULL);
 }
 
+// Load a solver saved with toBinary into a new instance of cls
+// The definition is left empty, since the binary doesn't keep the json
 static PyObject *
-PySimplex_solve(PySimplex* self, PyObject* vec){
-    if (! PySequence_Check(vec)){
-        PyErr_SetString(PyExc_TypeError, "Input must be a list or tuple");
+newFromBinary(PyObject *cls, const char *data, size_t size, const char *path){
+    std::shared_ptr<simplex::Simplex> rig = std::make_shared<simplex::Simplex>();
+    bool ok;
+    Py_BEGIN_ALLOW_THREADS
+    ok = path ? rig->parseBinaryFile(path) : rig->parseBinary(data, size);
+    Py_END_ALLOW_THREADS
+    if (!ok){
+        PyErr_SetString(PyExc_ValueError, rig->parseError.c_str());
         return NULL;
     }
 
-    PyObject *item;
-    std::vector<double> stdVec, outVec;
-    for (Py_ssize_t i=0; i<PySequence_Size(vec); ++i){
-        item = PySequence_GetItem(vec, i);
+    PySimplex *self = (PySimplex *)PySimplex_new((PyTypeObject *)cls, NULL, NULL);
+    if (self == NULL) return NULL;
+    self->solver->rig = rig;
+    return (PyObject *)self;
+}
+
+static PyObject *
+PySimplex_fromBinary(PyObject *cls, PyObject *data){
+    char *buf = NULL;
+    Py_ssize_t size = 0;
+    if (PyBytes_Check(data)){
+        if (PyBytes_AsStringAndSize(data, &buf, &size) == -1) return NULL;
+    }
+    else if (PyByteArray_Check(data)){
+        // The parse runs without the GIL, and a bytearray can be resized meanwhile
+#ifdef PYSIMPLEX_HAS_BUFFER
+        // Holding an export makes any resize fail until the parse is done
+        Py_buffer view;
+        if (PyObject_GetBuffer(data, &view, PyBUF_SIMPLE) == -1) return NULL;
+        PyObject *ret = newFromBinary(cls, (const char *)view.buf, (size_t)view.len, NULL);
+        PyBuffer_Release(&view);
+        return ret;
+#else
+        // Nothing stops a resize without the buffer protocol, so parse a copy
+        std::string copy(PyByteArray_AsString(data), (size_t)PyByteArray_Size(data));
+        return newFromBinary(cls, copy.data(), copy.size(), NULL);
+#endif
+    }
+    else {
+        PyErr_SetString(PyExc_TypeError, "The binary data must be bytes or a bytearray");
+        return NULL;
+    }
+    return newFromBinary(cls, buf, (size_t)size, NULL);
+}
+
+static PyObject *
+PySimplex_fromFile(PyObject *cls, PyObject *path){
+    if (! PyUnicode_Check(path)) {
+        PyErr_SetString(PyExc_TypeError, "The path must be a string");
+        return NULL;
+    }
+    PyObject *bytes = PyUnicode_EncodeFSDefault(path);
+    if (bytes == NULL) return NULL;
+    PyObject *ret = newFromBinary(cls, NULL, 0, PyBytes_AsString(bytes));
+    Py_DECREF(bytes);
+    return ret;
+}
+
+static PyObject *
+PySimplex_toBinary(PySimplex* self, PyObject* Py_UNUSED(ignored)){
+    std::string out;
+    if (!self->solver->rig->toBinary(out)){
+        PyErr_SetString(PyExc_ValueError, "There is no loaded definition to save");
+        return NULL;
+    }
+    return PyBytes_FromStringAndSize(out.data(), (Py_ssize_t)out.size());
+}
+
+static PyObject *
+PySimplex_share(PySimplex* self, PyObject* Py_UNUSED(ignored)){
+    PySimplex *other = (PySimplex *)PySimplex_new(Py_TYPE(self), NULL, NULL);
+    if (other == NULL) return NULL;
+    other->solver->rig = self->solver->rig;
+    other->solver->exact = self->solver->exact;
+    PyObject *tmp = other->definition;
+    Py_INCREF(self->definition);
+    other->definition = self->definition;
+    Py_DECREF(tmp);
+    return (PyObject *)other;
+}
+
+// Read a list or tuple of numbers into out
+// Returns 1 on success, and -1 with an exception set on failure
+static int
+sequenceToDoubles(PyObject *vec, std::vector<double> &out){
+    if (! PySequence_Check(vec)){
+        PyErr_SetString(PyExc_TypeError, "Input must be a list or tuple");
+        return -1;
+    }
+    Py_ssize_t size = PySequence_Size(vec);
+    if (size < 0) return -1;
+    out.clear();
+    out.reserve((size_t)size);
+    for (Py_ssize_t i=0; i<size; ++i){
+        PyObject *item = PySequence_GetItem(vec, i);
+        if (item == NULL) return -1;
         if (! PyNumber_Check(item)) {
+            Py_DECREF(item);
             PyErr_SetString(PyExc_TypeError, "Input list can contain only numbers");
-            return NULL;
+            return -1;
         }
-        stdVec.push_back(PyFloat_AsDouble(PyNumber_Float(item)));
+        double value = PyFloat_AsDouble(item);
         Py_DECREF(item);
+        if (value == -1.0 && PyErr_Occurred()) return -1;
+        out.push_back(value);
     }
+    return 1;
+}
+
+static PyObject *
+PySimplex_solve(PySimplex* self, PyObject* vec){
+    std::vector<double> stdVec, outVec;
+    if (sequenceToDoubles(vec, stdVec) == -1)
+        return NULL;
 
-	self->sPointer->clearValues();
-    outVec = self->sPointer->solve(stdVec);
+    PySolver *solver = self->solver;
+    outVec.resize(solver->rig->shapeLen());
+    withState(solver, [&](simplex::SolverState &state){
+        solver->rig->solve(state, stdVec.data(), stdVec.size(), outVec.data(), solver->exact);
+    });
 
     PyObject *out = PyList_New(outVec.size());
     for (size_t i=0; i<outVec.size(); ++i){
@@ -134,6 +299,526 @@ PySimplex_solve(PySimplex* self, PyObject* vec){
     return out;
 }
 
+static PyObject *
+PySimplex_solveSparse(PySimplex* self, PyObject* vec){
+    std::vector<double> stdVec;
+    if (sequenceToDoubles(vec, stdVec) == -1)
+        return NULL;
+
+    simplex::SparseWeights weights;
+    PySolver *solver = self->solver;
+    withState(solver, [&](simplex::SolverState &state){
+        solver->rig->solveSparse(state, stdVec.data(), stdVec.size(), weights, solver->exact);
+    });
+
+    PyObject *out = PyList_New(weights.size());
+    if (out == NULL) return NULL;
+    for (size_t i=0; i<weights.size(); ++i){
+        PyObject *pair = Py_BuildValue("(nd)", (Py_ssize_t)weights.indices[i], weights.weights[i]);
+        if (pair == NULL){
+            Py_DECREF(out);
+            return NULL;
+        }
+        PyList_SetItem(out, i, pair);
+    }
+    return out;
+}
+
+static PyObject *
+PySimplex_solveJacobian(PySimplex* self, PyObject* vec){
+    std::vector<double> stdVec, outVec;
+    if (sequenceToDoubles(vec, stdVec) == -1)
+        return NULL;
+
+    simplex::SparseJacobian jac;
+    PySolver *solver = self->solver;
+    outVec.resize(solver->rig->shapeLen());
+    withState(solver, [&](simplex::SolverState &state){
+        solver->rig->solveJacobian(state, stdVec.data(), stdVec.size(), outVec.data(), jac, solver->exact);
+    });
+
+    PyObject *weights = PyList_New(outVec.size());
+    if (weights == NULL) return NULL;
+    for (size_t i=0; i<outVec.size(); ++i){
+        PyList_SetItem(weights, i, PyFloat_FromDouble(outVec[i]));
+    }
+
+    PyObject *entries = PyList_New(jac.size());
+    if (entries == NULL){
+        Py_DECREF(weights);
+        return NULL;
+    }
+    for (size_t i=0; i<jac.size(); ++i){
+        const simplex::JacobianEntry &e = jac.entries[i];
+        PyObject *triple = Py_BuildValue("(nnd)", (Py_ssize_t)e.shape, (Py_ssize_t)e.slider, e.value);
+        if (triple == NULL){
+            Py_DECREF(weights);
+            Py_DECREF(entries);
+            return NULL;
+        }
+        PyList_SetItem(entries, i, triple);
+    }
+    PyObject *out = Py_BuildValue("(NN)", weights, entries);
+    return out;
+}
+
+// A borrowed, C-contiguous block of float64 or float32 values from another python object
+// A 1d array is a single row
+typedef struct {
+    void *data;
+    Py_ssize_t rows;
+    Py_ssize_t cols;
+    int ndim;
+    bool isFloat; // float32 instead of float64
+#ifdef PYSIMPLEX_HAS_BUFFER
+    Py_buffer buffer;
+    bool hasBuffer;
+#endif
+} ArrayView;
+
+static void
+releaseArrayView(ArrayView *view){
+#ifdef PYSIMPLEX_HAS_BUFFER
+    if (view->hasBuffer){
+        PyBuffer_Release(&view->buffer);
+        view->hasBuffer = false;
+    }
+#endif
+}
+
+// Fill in the shape, or set an exception for anything but 1 or 2 dimensions
+static int
+setArrayShape(ArrayView *view, Py_ssize_t ndim, Py_ssize_t first, Py_ssize_t second){
+    if (ndim != 1 && ndim != 2){
+        PyErr_SetString(PyExc_ValueError, "Arrays must be 1 or 2 dimensional");
+        return -1;
+    }
+    view->ndim = (int)ndim;
+    view->rows = (ndim == 2) ? first : 1;
+    view->cols = (ndim == 2) ? second : first;
+    return 1;
+}
+
+// Read the pointer out of numpy's __array_interface__
+// This works with the limited API, so it's always available
+static int
+getArrayInterfaceView(PyObject *obj, bool writable, ArrayView *view){
+    PyObject *iface = PyObject_GetAttrString(obj, "__array_interface__");
+    if (iface == NULL){
+        PyErr_Clear();
+        return 0;
+    }
+    int ret = -1;
+    PyObject *typestr = NULL, *shape = NULL, *data = NULL, *strides = NULL;
+    Py_ssize_t ndim, first, second = 0;
+
+    if (!PyDict_Check(iface)) goto fail;
+    typestr = PyDict_GetItemString(iface, "typestr");
+    shape = PyDict_GetItemString(iface, "shape");
+    data = PyDict_GetItemString(iface, "data");
+    strides = PyDict_GetItemString(iface, "strides");
+
+    if (typestr == NULL || !PyUnicode_Check(typestr)) goto fail;
+    if (PyUnicode_CompareWithASCIIString(typestr, "<f8") == 0 || PyUnicode_CompareWithASCIIString(typestr, "=f8") == 0){
+        view->isFloat = false;
+    }
+    else if (PyUnicode_CompareWithASCIIString(typestr, "<f4") == 0 || PyUnicode_CompareWithASCIIString(typestr, "=f4") == 0){
+        view->isFloat = true;
+    }
+    else {
+        PyErr_SetString(PyExc_TypeError, "Arrays must contain float64 or float32 values");
+        goto fail;
+    }
+
+    if (strides != NULL && strides != Py_None){
+        PyErr_SetString(PyExc_TypeError, "Arrays must be C-contiguous");
+        goto fail;
+    }
+
+    if (data == NULL || !PyTuple_Check(data) || PyTuple_Size(data) != 2) goto fail;
+    if (writable && PyObject_IsTrue(PyTuple_GetItem(data, 1))){
+        PyErr_SetString(PyExc_TypeError, "Output array must be writable");
+        goto fail;
+    }
+    view->data = PyLong_AsVoidPtr(PyTuple_GetItem(data, 0));
+    if (PyErr_Occurred()) goto fail;
+
+    if (shape == NULL || !PyTuple_Check(shape)) goto fail;
+    ndim = PyTuple_Size(shape);
+    if (ndim < 1 || ndim > 2){
+        setArrayShape(view, ndim, 0, 0);
+        goto fail;
+    }
+    first = PyLong_AsSsize_t(PyTuple_GetItem(shape, 0));
+    if (ndim == 2)
+        second = PyLong_AsSsize_t(PyTuple_GetItem(shape, 1));
+    if (PyErr_Occurred()) goto fail;
+    ret = setArrayShape(view, ndim, first, second);
+
+fail:
+    if (ret == -1 && !PyErr_Occurred())
+        PyErr_SetString(PyExc_TypeError, "Invalid __array_interface__");
+    Py_DECREF(iface);
+    return ret;
+}
+
+// Get a 1d or 2d view without copying.
+// Returns 1 on success, and -1 with an exception set on failure
+static int
+getArrayView(PyObject *obj, bool writable, ArrayView *view){
+    view->data = NULL;
+    view->rows = 0;
+    view->cols = 0;
+    view->ndim = 0;
+    view->isFloat = false;
+#ifdef PYSIMPLEX_HAS_BUFFER
+    view->hasBuffer = false;
+    if (PyObject_CheckBuffer(obj)){
+        int flags = PyBUF_C_CONTIGUOUS | PyBUF_FORMAT;
+        if (writable) flags |= PyBUF_WRITABLE;
+        if (PyObject_GetBuffer(obj, &view->buffer, flags) == -1)
+            return -1;
+        view->hasBuffer = true;
+        const char *fmt = view->buffer.format;
+        if (fmt != NULL && fmt[0] != '\0' && strchr("<=", fmt[0]) != NULL)
+            ++fmt;
+        if (fmt != NULL && view->buffer.itemsize == sizeof(double) && strcmp(fmt, "d") == 0){
+            view->isFloat = false;
+        }
+        else if (fmt != NULL && view->buffer.itemsize == sizeof(float) && strcmp(fmt, "f") == 0){
+            view->isFloat = true;
+        }
+        else {
+            PyErr_SetString(PyExc_TypeError, "Arrays must contain float64 or float32 values");
+            releaseArrayView(view);
+            return -1;
+        }
+        int ndim = view->buffer.ndim;
+        Py_ssize_t first = (ndim >= 1) ? view->buffer.shape[0] : 0;
+        Py_ssize_t second = (ndim >= 2) ? view->buffer.shape[1] : 0;
+        if (setArrayShape(view, ndim, first, second) == -1){
+            releaseArrayView(view);
+            return -1;
+        }
+        view->data = view->buffer.buf;
+        return 1;
+    }
+#endif
+    int ret = getArrayInterfaceView(obj, writable, view);
+    if (ret == 0){
+        PyErr_SetString(PyExc_TypeError, "Expected a numpy array, or an object supporting the buffer protocol");
+        return -1;
+    }
+    return ret;
+}
+
+// Solve with the GIL released, so other python threads can run meanwhile
+template <typename T>
+static void
+solveUnlocked(PySimplex *self, const T *in, size_t frames, size_t n, T *out, Py_ssize_t threads){
+    PySolver *solver = self->solver;
+    // Held onto, in case the definition is replaced during the solve
+    std::shared_ptr<const simplex::Simplex> rig = solver->rig;
+    bool exact = solver->exact;
+    Py_BEGIN_ALLOW_THREADS
+    if (threads == 1){
+        withState(solver, [&](simplex::SolverState &state){
+            rig->solveBatch(state, in, frames, n, out, exact);
+        });
+    }
+    else {
+        rig->solveBatchParallel(in, frames, n, out, (size_t)threads, exact);
+    }
+    Py_END_ALLOW_THREADS
+}
+
+// Build a memoryview of a new (rows, cols) or (cols,) array over a bytearray
+// numpy.asarray can wrap that without a copy. memoryview can't cast to a shape
+// with a zero in it, so an empty output is left as a flat, empty view instead
+static PyObject *
+newOutputView(size_t rows, size_t cols, bool matrix, const char *fmt, size_t itemSize, void **data){
+    PyObject *bytes = PyByteArray_FromStringAndSize(NULL, (Py_ssize_t)(rows * cols * itemSize));
+    if (bytes == NULL) return NULL;
+    PyObject *mview = PyMemoryView_FromObject(bytes);
+    *data = PyByteArray_AsString(bytes);
+    Py_DECREF(bytes);
+    if (mview == NULL) return NULL;
+    PyObject *ret;
+    if (rows * cols == 0)
+        ret = PyObject_CallMethod(mview, "cast", "s", fmt);
+    else if (matrix)
+        ret = PyObject_CallMethod(mview, "cast", "s(nn)", fmt, (Py_ssize_t)rows, (Py_ssize_t)cols);
+    else
+        ret = PyObject_CallMethod(mview, "cast", "s(n)", fmt, (Py_ssize_t)cols);
+    Py_DECREF(mview);
+    return ret;
+}
+
+// Solve an array into an output of the same dtype and number of dimensions
+// With a 2d input the output is (frames, shapes), and with a 1d one it's (shapes,)
+static PyObject *
+solveArrays(PySimplex* self, PyObject *inObj, PyObject *outObj, Py_ssize_t threads, bool allowVector){
+    if (threads < 0){
+        PyErr_SetString(PyExc_ValueError, "threads must not be negative");
+        return NULL;
+    }
+
+    ArrayView inView;
+    if (getArrayView(inObj, false, &inView) == -1)
+        return NULL;
+
+    size_t frames = (size_t)inView.rows;
+    size_t shapeLen = self->solver->rig->shapeLen();
+    size_t itemSize = inView.isFloat ? sizeof(float) : sizeof(double);
+    PyObject *ret = NULL;
+    ArrayView outView;
+    outView.data = NULL;
+#ifdef PYSIMPLEX_HAS_BUFFER
+    outView.hasBuffer = false;
+#endif
+
+    if (inView.ndim == 1 && !allowVector){
+        PyErr_SetString(PyExc_ValueError, "Arrays must be 2 dimensional");
+        goto done;
+    }
+
+    if (outObj == NULL || outObj == Py_None){
+        ret = newOutputView(frames, shapeLen, inView.ndim == 2, inView.isFloat ? "f" : "d", itemSize, &outView.data);
+        if (ret == NULL) goto done;
+    }
+    else {
+        if (getArrayView(outObj, true, &outView) == -1) goto done;
+        if (outView.isFloat != inView.isFloat){
+            PyErr_SetString(PyExc_TypeError, "Output array must have the same dtype as the input");
+            goto done;
+        }
+        if (outView.ndim != inView.ndim || (size_t)outView.rows != frames || (size_t)outView.cols != shapeLen){
+            PyErr_SetString(PyExc_ValueError, (inView.ndim == 2) ?
+                "Output array must have the shape (frames, shapes)" : "Output array must have the shape (shapes,)");
+            goto done;
+        }
+        Py_INCREF(outObj);
+        ret = outObj;
+    }
+
+    if (inView.isFloat)
+        solveUnlocked(self, (const float *)inView.data, frames, (size_t)inView.cols, (float *)outView.data, threads);
+    else
+        solveUnlocked(self, (const double *)inView.data, frames, (size_t)inView.cols, (double *)outView.data, threads);
+
+done:
+    releaseArrayView(&inView);
+    releaseArrayView(&outView);
+    return ret;
+}
+
+static PyObject *
+PySimplex_solveArray(PySimplex* self, PyObject* args, PyObject* kwds){
+    PyObject *inObj = NULL, *outObj = NULL;
+
+    char inLiteral[] = "inputs";
+    char outLiteral[] = "out";
+    char *kwlist[] = {inLiteral, outLiteral, NULL};
+
+    if (! PyArg_ParseTupleAndKeywords(args, kwds, "O|O", kwlist, &inObj, &outObj))
+        return NULL;
+    return solveArrays(self, inObj, outObj, 1, true);
+}
+
+static PyObject *
+PySimplex_solveBatch(PySimplex* self, PyObject* args, PyObject* kwds){
+    PyObject *inObj = NULL, *outObj = NULL;
+    Py_ssize_t threads = 1;
+
+    char inLiteral[] = "inputs";
+    char outLiteral[] = "out";
+    char threadsLiteral[] = "threads";
+    char *kwlist[] = {inLiteral, outLiteral, threadsLiteral, NULL};
+
+    if (! PyArg_ParseTupleAndKeywords(args, kwds, "O|On", kwlist, &inObj, &outObj, &threads))
+        return NULL;
+    return solveArrays(self, inObj, outObj, threads, false);
+}
+
+// Fit a 2d (frames, shapes) float64 array of target weights into (frames, sliders) slider values
+static PyObject *
+PySimplex_fitBatch(PySimplex* self, PyObject* args, PyObject* kwds){
+    PyObject *inObj = NULL, *outObj = NULL, *startObj = NULL;
+    Py_ssize_t threads = 1, iterations = 20;
+    simplex::FitOptions options;
+
+    char inLiteral[] = "targets";
+    char outLiteral[] = "out";
+    char startLiteral[] = "start";
+    char threadsLiteral[] = "threads";
+    char iterationsLiteral[] = "iterations";
+    char toleranceLiteral[] = "tolerance";
+    char lowerLiteral[] = "lower";
+    char upperLiteral[] = "upper";
+    char *kwlist[] = {inLiteral, outLiteral, startLiteral, threadsLiteral, iterationsLiteral,
+        toleranceLiteral, lowerLiteral, upperLiteral, NULL};
+
+    if (! PyArg_ParseTupleAndKeywords(args, kwds, "O|OOnnddd", kwlist, &inObj, &outObj, &startObj,
+                &threads, &iterations, &options.tolerance, &options.lower, &options.upper))
+        return NULL;
+    if (threads < 0 || iterations < 0){
+        PyErr_SetString(PyExc_ValueError, "threads and iterations must not be negative");
+        return NULL;
+    }
+    if (!(options.lower <= options.upper)){
+        PyErr_SetString(PyExc_ValueError, "lower must not be greater than upper");
+        return NULL;
+    }
+    options.maxIterations = (size_t)iterations;
+
+    ArrayView inView;
+    if (getArrayView(inObj, false, &inView) == -1)
+        return NULL;
+
+    PySolver *solver = self->solver;
+    std::shared_ptr<const simplex::Simplex> rig = solver->rig;
+    bool exact = solver->exact;
+    size_t frames = (size_t)inView.rows;
+    size_t sliderLen = rig->sliderLen();
+    const double *start = NULL;
+    PyObject *ret = NULL;
+    ArrayView outView, startView;
+    outView.data = NULL;
+    startView.data = NULL;
+#ifdef PYSIMPLEX_HAS_BUFFER
+    outView.hasBuffer = false;
+    startView.hasBuffer = false;
+#endif
+
+    if (inView.isFloat){
+        PyErr_SetString(PyExc_TypeError, "Fit targets must contain float64 values");
+        goto done;
+    }
+    if (inView.ndim != 2){
+        PyErr_SetString(PyExc_ValueError, "Arrays must be 2 dimensional");
+        goto done;
+    }
+
+    if (startObj != NULL && startObj != Py_None){
+        if (getArrayView(startObj, false, &startView) == -1) goto done;
+        if (startView.isFloat || startView.ndim != 1 || (size_t)startView.cols != sliderLen){
+            PyErr_SetString(PyExc_ValueError, "Start array must be float64 with the shape (sliders,)");
+            goto done;
+        }
+        start = (const double *)startView.data;
+    }
+
+    if (outObj == NULL || outObj == Py_None){
+        ret = newOutputView(frames, sliderLen, true, "d", sizeof(double), &outView.data);
+        if (ret == NULL) goto done;
+    }
+    else {
+        if (getArrayView(outObj, true, &outView) == -1) goto done;
+        if (outView.isFloat){
+            PyErr_SetString(PyExc_TypeError, "Output array must contain float64 values");
+            goto done;
+        }
+        if (outView.ndim != 2 || (size_t)outView.rows != frames || (size_t)outView.cols != sliderLen){
+            PyErr_SetString(PyExc_ValueError, "Output array must have the shape (frames, sliders)");
+            goto done;
+        }
+        // Don't overwrite the start values before they're read
+        if (start != NULL && (const double *)outView.data < start + sliderLen &&
+                start < (const double *)outView.data + frames * sliderLen){
+            PyErr_SetString(PyExc_ValueError, "Start array must not overlap the output array");
+            goto done;
+        }
+        Py_INCREF(outObj);
+        ret = outObj;
+    }
+
+    {
+        const double *in = (const double *)inView.data;
+        size_t n = (size_t)inView.cols;
+        double *out = (double *)outView.data;
+        Py_BEGIN_ALLOW_THREADS
+        if (threads == 1){
+            withState(solver, [&](simplex::SolverState &state){
+                rig->fitBatch(state, in, frames, n, start, out, options, NULL, exact);
+            });
+        }
+        else {
+            rig->fitBatchParallel(in, frames, n, start, out, options, NULL, (size_t)threads, exact);
+        }
+        Py_END_ALLOW_THREADS
+    }
+
+done:
+    releaseArrayView(&inView);
+    releaseArrayView(&outView);
+    releaseArrayView(&startView);
+    return ret;
+}
+
+static PyObject *
+PySimplex_profile(PySimplex* self, PyObject* Py_UNUSED(ignored)){
+    // Any shared instances built the same solver, so their build is included too
+    simplex::SolveProfile profile = self->solver->rig->getBuildProfile();
+    {
+        std::lock_guard<std::mutex> lock(self->solver->stateMutex);
+        profile.merge(self->solver->state.profile);
+    }
+    PyObject *out = PyDict_New();
+    if (out == NULL) return NULL;
+
+    PyObject *enabled = simplex::SolveProfile::enabled() ? Py_True : Py_False;
+    if (PyDict_SetItemString(out, "enabled", enabled) == -1){
+        Py_DECREF(out);
+        return NULL;
+    }
+    for (size_t i=0; i<simplex::SolveProfile::fieldCount; ++i){
+        PyObject *val = PyLong_FromUnsignedLongLong(profile.field(i));
+        if (val == NULL || PyDict_SetItemString(out, simplex::SolveProfile::fieldName(i), val) == -1){
+            Py_XDECREF(val);
+            Py_DECREF(out);
+            return NULL;
+        }
+        Py_DECREF(val);
+    }
+    return out;
+}
+
+static PyObject *
+PySimplex_clearProfile(PySimplex* self, PyObject* Py_UNUSED(ignored)){
+    std::lock_guard<std::mutex> lock(self->solver->stateMutex);
+    self->solver->state.profile.clear();
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+PySimplex_setResultCache(PySimplex* self, PyObject* args, PyObject* kwds){
+    Py_ssize_t capacity = 0;
+    double quantum = 0.0;
+
+    char capacityLiteral[] = "capacity";
+    char quantumLiteral[] = "quantum";
+    char *kwlist[] = {capacityLiteral, quantumLiteral, NULL};
+
+    if (! PyArg_ParseTupleAndKeywords(args, kwds, "n|d", kwlist, &capacity, &quantum))
+        return NULL;
+    if (capacity < 0 || quantum < 0.0){
+        PyErr_SetString(PyExc_ValueError, "capacity and quantum must not be negative");
+        return NULL;
+    }
+    self->solver->rig->resultCache().configure((size_t)capacity, quantum);
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+PySimplex_resultCacheStats(PySimplex* self, PyObject* Py_UNUSED(ignored)){
+    const simplex::SolveCache &cache = self->solver->rig->resultCache();
+    simplex::SolveCacheStats stats = cache.getStats();
+    return Py_BuildValue("{s:n,s:d,s:n,s:n,s:n,s:n}",
+        "capacity", (Py_ssize_t)cache.getCapacity(), "quantum", cache.getQuantum(),
+        "hits", (Py_ssize_t)stats.hits, "misses", (Py_ssize_t)stats.misses,
+        "evictions", (Py_ssize_t)stats.evictions, "entries", (Py_ssize_t)stats.entries);
+}
+
 static PyGetSetDef PySimplex_getseters[] = {
     {(char*)"definition",
      (getter)PySimplex_getdefinition, (setter)PySimplex_setdefinition,
@@ -151,6 +836,73 @@ static PyMethodDef PySimplex_methods[] = {
     {(char*)"solve", (PyCFunction)PySimplex_solve, METH_O,
      (char*)"Supply an input list to the solver, and recieve and output list"
     },
+    {(char*)"solveSparse", (PyCFunction)PySimplex_solveSparse, METH_O,
+     (char*)"Supply an input list to the solver, and recieve a list of (shapeIndex, weight)\n"
+            "tuples for only the shapes with a non-zero weight, in shape order"
+    },
+    {(char*)"solveJacobian", (PyCFunction)PySimplex_solveJacobian, METH_O,
+     (char*)"Solve an input list, and also get the derivatives of the weights with respect\n"
+            "to the sliders. Returns the output list, and a list of (shapeIndex, sliderIndex,\n"
+            "derivative) tuples for only the non-zero derivatives, sorted by shape then slider"
+    },
+    {(char*)"solveArray", (PyCFunction)(void(*)(void))PySimplex_solveArray, METH_VARARGS | METH_KEYWORDS,
+     (char*)"Solve a 1d (sliders,) or 2d (frames, sliders) float64 or float32 array without copying it.\n"
+            "Writes into `out` if it's given, otherwise returns a new (shapes,) or (frames, shapes)\n"
+            "memoryview with the same dtype as the input. An empty result is a flat, empty memoryview.\n"
+            "Builds for the limited API before 3.11 only take numpy arrays (anything with an\n"
+            "__array_interface__), so a returned memoryview can't be passed back as `out` there.\n"
+            "The GIL is released during the solve"
+    },
+    {(char*)"solveBatch", (PyCFunction)(void(*)(void))PySimplex_solveBatch, METH_VARARGS | METH_KEYWORDS,
+     (char*)"Solve a 2d (frames, sliders) float64 or float32 array without copying it.\n"
+            "Writes into `out` if it's given, otherwise returns a new (frames, shapes) memoryview,\n"
+            "or a flat, empty one when there are no frames or shapes. As with solveArray, builds for\n"
+            "the limited API before 3.11 only take numpy arrays.\n"
+            "Frames are split across `threads` worker threads, where 0 means one per cpu.\n"
+            "The GIL is released during the solve"
+    },
+    {(char*)"fitBatch", (PyCFunction)(void(*)(void))PySimplex_fitBatch, METH_VARARGS | METH_KEYWORDS,
+     (char*)"Search for the slider values that give a 2d (frames, shapes) float64 array of target weights.\n"
+            "Writes into `out` if it's given, otherwise returns a new (frames, sliders) memoryview,\n"
+            "or a flat, empty one when there are no frames or sliders.\n"
+            "The first frame starts from the (sliders,) `start` array, or zero, and every other frame\n"
+            "starts from the one before it. The values are kept between `lower` and `upper`, and each\n"
+            "frame runs up to `iterations` steps, until its slope or step is under `tolerance`.\n"
+            "Frames are split across `threads` worker threads, where 0 means one per cpu.\n"
+            "The GIL is released during the fit"
+    },
+    {(char*)"profile", (PyCFunction)PySimplex_profile, METH_NOARGS,
+     (char*)"Get a dict of the solver timings (in nanoseconds) and counters.\n"
+            "These are only collected when pysimplex is built with profiling enabled.\n"
+            "Threaded solveBatch calls, and array solves that ran alongside another one aren't included"
+    },
+    {(char*)"clearProfile", (PyCFunction)PySimplex_clearProfile, METH_NOARGS,
+     (char*)"Reset the solve timings and counters to zero. The build timings are kept"
+    },
+    {(char*)"setResultCache", (PyCFunction)(void(*)(void))PySimplex_setResultCache, METH_VARARGS | METH_KEYWORDS,
+     (char*)"Keep the weights of the last `capacity` distinct inputs, and copy them out\n"
+            "when an input comes up again. With a `quantum`, inputs are snapped to multiples\n"
+            "of it first, so nearby poses share a result. A capacity of 0 turns it off.\n"
+            "The cache is shared with the instances made by share(), and is emptied here"
+    },
+    {(char*)"resultCacheStats", (PyCFunction)PySimplex_resultCacheStats, METH_NOARGS,
+     (char*)"Get a dict of the result cache settings, and its hits, misses and evictions"
+    },
+    {(char*)"toBinary", (PyCFunction)PySimplex_toBinary, METH_NOARGS,
+     (char*)"Save the built solver as bytes, for fromBinary and fromFile"
+    },
+    {(char*)"fromBinary", (PyCFunction)PySimplex_fromBinary, METH_O | METH_CLASS,
+     (char*)"Make a solver from the bytes toBinary gave, with none of the parsing or building.\n"
+            "The definition is left empty"
+    },
+    {(char*)"fromFile", (PyCFunction)PySimplex_fromFile, METH_O | METH_CLASS,
+     (char*)"Same as fromBinary, memory mapping a file written out from toBinary"
+    },
+    {(char*)"share", (PyCFunction)PySimplex_share, METH_NOARGS,
+     (char*)"Make a new solver that shares this one's built definition, without copying it.\n"
+            "Each has its own solve state and exactSolve, so they can solve on separate threads.\n"
+            "Setting a definition on either one only replaces it on that one"
+    },
     {NULL}  // Sentinel
 };
 
@@ -32,17 +32,37 @@ namespace simplex {
 class Progression;
 class Slider;
 class Simplex;
+class SimplexBinary;
 
-typedef std::pair<Slider*, double> ComboPair;
+// A slider index, and the slider value of the state
+// Sliders are solved first, so a slider's SolverState slot is its index
+typedef std::pair<size_t, double> ComboPair;
 typedef std::vector<ComboPair> ComboPairs;
 
 ComboSolve getSolveType(const rapidjson::Value &val);
+// The solve type a definition names. Anything unknown is None
+ComboSolve getSolveType(const std::string &name);
 bool getSolvePairs(const rapidjson::Value &val, Simplex *simp, ComboPairs &state, bool &isFloater);
+// Whether a state with these slider values has to be solved as a floater
+bool isFloaterState(const ComboPairs &state);
+// Shift the slider indices past a removed slider down by one
+void sliderRemoved(ComboPairs &state, size_t index);
 
 bool solveState(const std::vector<double> &vals, const std::vector<double> &tars, ComboSolve solveType, bool exact, double &value);
-bool solveState(const ComboPairs &stateList, ComboSolve solveType, bool exact, double &value);
+// Read the slider values at their slots in ctrlValues
+bool solveState(const ComboPairs &stateList, const double *ctrlValues, ComboSolve solveType, bool exact, double &value);
+// Solve the offset state (startList value - startList target) against the deltaList targets
+bool solveState(const ComboPairs &startList, const ComboPairs &deltaList, const double *ctrlValues, ComboSolve solveType, bool exact, double &value);
+
+// The same solves, also giving the derivative of the value with respect to each
+// slider in the state, as (slider, derivative) pairs without the zero ones
+// The gradient is left empty when the state doesn't solve
+bool solveStateGradient(const ComboPairs &stateList, const double *ctrlValues, ComboSolve solveType, bool exact, double &value, ComboPairs &gradient);
+bool solveStateGradient(const ComboPairs &startList, const ComboPairs &deltaList, const double *ctrlValues, ComboSolve solveType, bool exact, double &value, ComboPairs &gradient);
 
 class Combo : public ShapeController {
+	friend class ComboTable; // lets the table read the solve parameters
+	friend class SimplexBinary;
 	private:
 		bool isFloater;
 		bool exact;
@@ -55,13 +75,14 @@ class Combo : public ShapeController {
 		ComboPairs stateList;
 		bool sliderType() const override { return false; }
 		void setExact(bool e){exact = e;}
-		Combo(const std::string &name, Progression* prog, size_t index,
+		bool getIsFloater() const { return isFloater; }
+		ComboSolve getSolveType() const { return solveType; }
+		Combo(const std::string &name, size_t prog, size_t index,
 			const ComboPairs &stateList, bool isFloater, ComboSolve solveType);
-		void storeValue(
-				const std::vector<double> &values,
-				const std::vector<double> &posValues,
-				const std::vector<double> &clamped,
-				const std::vector<bool> &inverses) override;
+		void storeValue(SolverState &state) const override;
+		// The derivative of the stored value with respect to the sliders
+		// Floaters get theirs from their TriSpace instead
+		void storeGradient(const SolverState &state, bool exact, ComboPairs &gradient) const;
 		static bool parseJSONv1(const rapidjson::Value &val, size_t index, Simplex *simp);
 		static bool parseJSONv2(const rapidjson::Value &val, size_t index, Simplex *simp);
 		static bool parseJSONv3(const rapidjson::Value &val, size_t index, Simplex *simp);
@@ -0,0 +1,82 @@
+/*
+Copyright 2016, Blur Studio
+
+This file is part of Simplex.
+
+Simplex is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Simplex is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Simplex.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "enums.h"
+
+#include <vector>
+
+namespace simplex {
+
+class Combo;
+
+// Per-row accumulators for solving a ComboTable
+// Sized to fit the largest table, and owned by a SolverState
+class ComboScratch {
+	public:
+		std::vector<double> mn;
+		std::vector<double> mx;
+		std::vector<double> mul;
+		std::vector<double> sum;
+		std::vector<unsigned char> valid;
+		std::vector<double> value;
+
+		void resize(size_t rows);
+};
+
+// A group of combos that share a solve type and slider count, stored as
+// a structure-of-arrays. Each column j holds the j'th slider of every row
+// contiguously, so the whole group is solved with straight, branch-free
+// loops that the compiler can vectorize instead of chasing Slider pointers
+class ComboTable {
+	public:
+		// Solves the whole table with the slider count and solve type baked in
+		typedef void (*Kernel)(const ComboTable &table, double *ctrlValues, bool exact);
+
+		ComboSolve solveType;
+		size_t arity;
+		// Picked by finalize() for the common small arities, so their loops
+		// are fully unrolled. Null means the generic loops are used
+		Kernel kernel = nullptr;
+
+		// The SolverState slot of the combo for each row
+		std::vector<size_t> rows;
+		// Column-major slider indices and target signs (+1.0 or -1.0)
+		std::vector<unsigned> sliders;
+		std::vector<double> signs;
+
+		ComboTable(ComboSolve solveType, size_t arity): solveType(solveType), arity(arity) {}
+		size_t size() const { return rows.size(); }
+		void addRow(Combo *combo);
+		void finalize();
+
+		// Compute every combo in the table from the slider values at the front
+		// of ctrlValues, and store the successful ones back into ctrlValues
+		void solve(double *ctrlValues, bool exact, ComboScratch &scratch) const;
+		// The runtime-sized loops that handle any arity
+		void solveGeneric(double *ctrlValues, bool exact, ComboScratch &scratch) const;
+		// Same as above for a single row, with the same arithmetic
+		void solveRow(size_t row, double *ctrlValues, bool exact) const;
+
+		// Group the solvable combos into tables
+		static std::vector<ComboTable> buildTables(std::vector<Combo> &combos);
+};
+
+} // end namespace simplex
@@ -31,9 +31,9 @@ namespace simplex {
 class Slider;
 class Floater : public Combo {
 	public:
-		friend class TriSpace; // lets the trispace set the value for this guy
-		Floater(const std::string &name, Progression* prog, size_t index,
-			const std::vector<std::pair<Slider*, double>> &stateList, bool isFloater) :
+		friend class TriSpace; // lets the trispace read the inverted state for this guy
+		Floater(const std::string &name, size_t prog, size_t index,
+			const ComboPairs &stateList, bool isFloater) :
 			Combo(name, prog, index, stateList, isFloater, ComboSolve::None) {
 		}
 };
@@ -0,0 +1,50 @@
+/*
+Copyright 2016, Blur Studio
+
+This file is part of Simplex.
+
+Simplex is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Simplex is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Simplex.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <string>
+
+namespace simplex {
+
+// A read-only view of a whole file, memory mapped where the platform allows
+class MappedFile {
+	private:
+		const char *ptr;
+		size_t len;
+#ifdef _WIN32
+		void *fileHandle;
+		void *mapHandle;
+#else
+		int fd;
+#endif
+	public:
+		MappedFile();
+		~MappedFile();
+		MappedFile(const MappedFile &) = delete;
+		MappedFile &operator=(const MappedFile &) = delete;
+
+		bool open(const std::string &path);
+		void close();
+		bool isOpen() const { return ptr != nullptr; }
+		const char *data() const { return ptr; }
+		size_t size() const { return len; }
+};
+
+} // end namespace simplex
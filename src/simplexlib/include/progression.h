@@ -31,25 +31,71 @@ along with Simplex.  If not, see <http://www.gnu.org/licenses/>.
 namespace simplex {
 
 class Simplex;
-class Shape;
+class SimplexBinary;
 
-typedef std::pair<Shape*, double> ProgPair;
+// A shape index, and the progression time where it's fully on
+typedef std::pair<size_t, double> ProgPair;
 typedef std::vector<ProgPair> ProgPairs;
 
+// The weighted shapes a progression outputs for a single value
+// A progression never outputs more than 4 shapes, so this is a fixed
+// size buffer that the caller owns, and evaluating never allocates
+class ProgOutput {
+	public:
+		static const size_t maxSize = 4;
+		ProgPair pairs[maxSize];
+		size_t count = 0;
+
+		void clear() { count = 0; }
+		void push(size_t shape, double weight) { pairs[count++] = std::make_pair(shape, weight); }
+		size_t size() const { return count; }
+		const ProgPair *begin() const { return pairs; }
+		const ProgPair *end() const { return pairs + count; }
+};
+
 class Progression : public ShapeBase {
+	friend class SimplexBinary; // lets the serializer read the interpolation type
 	private:
+		// A contiguous run of the sorted breakpoints that one evaluation
+		// interpolates over. A splitSpline has one run for each side of zero,
+		// every other type uses the same run for both
+		struct Span {
+			size_t first = 0;
+			size_t count = 0;
+			// Set when the breakpoints are evenly spaced, so the interval
+			// can be found directly instead of searched for
+			bool uniform = false;
+			double invStep = 0.0;
+		};
+
 		ProgPairs pairs;
 		ProgType interp;
-		static size_t getInterval(double tVal, const std::vector<double> &times, bool &outside);
-		ProgPairs getSplineOutput(double tVal, double mul=1.0) const;
-		ProgPairs getSplitSplineOutput(double tVal, double mul=1.0) const;
-		ProgPairs getLinearOutput(double tVal, double mul=1.0) const;
-
-		static ProgPairs getRawSplineOutput(const std::vector<const std::pair<Shape*, double>* > pairs, double tVal, double mul=1.0);
-		static ProgPairs getRawLinearOutput(const std::vector<const std::pair<Shape*, double>* > pairs, double tVal, double mul=1.0);
+		// The pairs split into separate arrays, built once when constructed
+		std::vector<size_t> shapes;
+		std::vector<double> times;
+		Span negSpan;
+		Span posSpan;
+
+		void buildTables();
+		Span makeSpan(size_t first, size_t count) const;
+		static size_t getInterval(double tVal, const double *times, size_t count, const Span &span, bool &outside);
+		static void getRawSplineOutput(const size_t *shapes, const double *times, size_t count, const Span &span, double tVal, double mul, ProgOutput &out);
+		static void getRawLinearOutput(const size_t *shapes, const double *times, size_t count, const Span &span, double tVal, double mul, ProgOutput &out);
+		static void getRawSplineDerivative(const size_t *shapes, const double *times, size_t count, const Span &span, double tVal, double mul, ProgOutput &out);
+		static void getRawLinearDerivative(const size_t *shapes, const double *times, size_t count, const Span &span, double tVal, double mul, ProgOutput &out);
 
 	public:
 		ProgPairs getOutput(double tVal, double mul=1.0) const;
+		// Same as above, but write into a caller-provided buffer
+		void getOutput(double tVal, double mul, ProgOutput &out) const;
+		// The derivative of getOutput's weights with respect to tVal, for
+		// the same shapes in the same order. At a breakpoint it's the
+		// derivative of the interval getOutput interpolates over
+		void getDerivative(double tVal, double mul, ProgOutput &out) const;
+		const ProgPairs &getPairs() const { return pairs; }
+		ProgType getInterp() const { return interp; }
+		// Replace the pairs and interpolation, and rebuild the tables
+		void setPairs(const ProgPairs &pairs, ProgType interp);
 
 		Progression(const std::string &name, const ProgPairs &pairs, ProgType interp);
 		static bool parseJSONv1(const rapidjson::Value &val, size_t index, Simplex *simp);
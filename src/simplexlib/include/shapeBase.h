@@ -34,6 +34,8 @@ class ShapeBase {
 		explicit ShapeBase(const std::string &name): name(name), index(0u), shapeRef(nullptr) {}
 		const std::string* getName() const {return &name;}
 		const size_t getIndex() const { return index; }
+		// For renumbering after an item before this one is removed
+		void setIndex(size_t idx) { index = idx; }
 		void setUserData(void *data) {shapeRef = data;}
 		void* getUserData(){return shapeRef;}
 };
@@ -20,6 +20,7 @@ along with Simplex.  If not, see <http://www.gnu.org/licenses/>.
 #pragma once
 
 #include "shapeBase.h"
+#include "progression.h"
 #include "rapidjson/document.h"
 
 #include <vector>
@@ -27,29 +28,37 @@ along with Simplex.  If not, see <http://www.gnu.org/licenses/>.
 
 namespace simplex {
 
-class Progression;
+class SolverState;
+class SimplexBinary;
 
 class ShapeController : public ShapeBase {
+	friend class SimplexBinary; // lets the serializer read the enabled state
 	protected:
 		bool enabled;
-		double value;
-		double multiplier;
-		Progression* prog;
+		size_t slot; // where this controller's value lives in a SolverState
+		size_t prog; // index of the progression in Simplex::progs
 	public:
-		ShapeController(const std::string &name, Progression* prog, size_t index):
-			ShapeBase(name, index), enabled(true), value(0.0), multiplier(1.0), prog(prog) {}
+		ShapeController(const std::string &name, size_t prog, size_t index):
+			ShapeBase(name, index), enabled(true), slot(0), prog(prog) {}
 
 		virtual bool sliderType() const { return true; }
-		void clearValue(){value = 0.0; multiplier=1.0;}
-		const double getValue() const { return value; }
-		const double getMultiplier() const { return multiplier; }
+		const size_t getSlot() const { return slot; }
+		void setSlot(size_t s){ slot = s; }
+		size_t getProgIndex() const { return prog; }
+		void setProgIndex(size_t p){ prog = p; }
 		void setEnabled(bool enable){enabled = enable;}
-		virtual void storeValue(
-				const std::vector<double> &values,
-				const std::vector<double> &posValues,
-				const std::vector<double> &clamped,
-				const std::vector<bool> &inverses) = 0;
-		void solve(std::vector<double> &accumulator, double &maxAct) const;
+		bool isEnabled() const { return enabled; }
+		virtual void storeValue(SolverState &state) const = 0;
+		// Add this controller's shape contributions for the given value to the accumulator
+		// The progression is the one at getProgIndex(), which the solve plan looks up
+		// The scratch pairs are reused so this doesn't allocate
+		// The accumulator can be float or double
+		template <typename T>
+		void solve(const Progression &prog, double value, double multiplier, T *accumulator, double &maxAct, ProgOutput &scratch) const;
+		// Same as above, but also list each shape the first time it's written to
+		// A shape is new when its stamp doesn't match, and it's zeroed before it's added to
+		void solve(const Progression &prog, double value, double multiplier, double *accumulator, double &maxAct, ProgOutput &scratch,
+				size_t *stamps, size_t stamp, std::vector<size_t> &touched) const;
 		static bool getEnabled(const rapidjson::Value &val);
 };
 
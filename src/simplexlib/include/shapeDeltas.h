@@ -0,0 +1,81 @@
+/*
+Copyright 2016, Blur Studio
+
+This file is part of Simplex.
+
+Simplex is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Simplex is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Simplex.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "sparseWeights.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace simplex {
+
+// Sparse per-shape point offsets, packed into contiguous arrays so a whole
+// set of solved weights can be applied with straight vectorized loops.
+// Each shape's offsets are stored as runs of consecutive point indices,
+// and every run is one multiply-add over a contiguous block of floats
+class ShapeDeltas {
+	public:
+		struct Run {
+			uint32_t start; // first point index
+			uint32_t length; // number of points
+			uint32_t offset; // first point in deltas
+		};
+
+	private:
+		std::vector<size_t> shapeRuns; // shapeCount()+1 offsets into runs
+		std::vector<Run> runs;
+		std::vector<float> deltas; // packed xyz
+		size_t points;
+
+		void accumulateShape(size_t shape, float w, float *accum, size_t begin, size_t end) const;
+
+	public:
+		ShapeDeltas(): points(0) {}
+
+		void clear();
+		// Add the offsets for one shape. Shapes must be added in increasing
+		// index order, and any that are skipped are left empty. The indices
+		// don't have to be sorted, and the last of any repeated index wins
+		// Returns false if the shape comes before one that was already added
+		bool addShape(size_t shape, const uint32_t *indices, const float *xyz, size_t count);
+
+		size_t shapeCount() const { return shapeRuns.empty() ? 0 : shapeRuns.size() - 1; }
+		// One more than the highest point index of any shape
+		size_t pointCount() const { return points; }
+		bool empty() const { return runs.empty(); }
+
+		const std::vector<size_t> &getShapeRuns() const { return shapeRuns; }
+		const std::vector<Run> &getRuns() const { return runs; }
+		const std::vector<float> &getDeltas() const { return deltas; }
+
+		// Add scale * weights[s] times each shape's offsets into accum, which
+		// holds 3 * pointCount() floats. Shapes with a zero weight are skipped
+		// The rest shape (index 0) never moves anything, so it's skipped too
+		void accumulate(const double *weights, size_t weightCount, float scale, float *accum) const;
+		// Same as above, limited to the points in [begin, end)
+		// so separate point ranges can be accumulated in parallel
+		void accumulate(const double *weights, size_t weightCount, float scale, float *accum, size_t begin, size_t end) const;
+		// Same as above, only visiting the shapes listed in a sparse solve
+		void accumulate(const SparseWeights &weights, float scale, float *accum) const;
+		void accumulate(const SparseWeights &weights, float scale, float *accum, size_t begin, size_t end) const;
+};
+
+} // end namespace simplex
@@ -26,17 +26,52 @@ along with Simplex.  If not, see <http://www.gnu.org/licenses/>.
 #include "floater.h"
 #include "trispace.h"
 #include "traversal.h"
+#include "solvePlan.h"
+#include "solverState.h"
+#include "solveCache.h"
+#include "sparseWeights.h"
+#include "sparseJacobian.h"
+#include "solveFit.h"
 
 #include "rapidjson/document.h"
 
 #include <vector>
 #include <string>
+#include <string_view>
 
 namespace simplex {
 
 class Simplex {
 	private:
 		bool exactSolve;
+		size_t buildId; // unique to each build(), so states can tell when they're stale
+		SolvePlan plan;
+		SolverState state; // for the overloads that don't take a state
+		SolveProfile buildProfile;
+		mutable SolveCache results;
+		// Store the value of every controller for the given input
+		// Returns false when the solver hasn't been built
+		// Takes float or double input
+		template <typename T>
+		bool storeValues(SolverState &state, const T *in, size_t n, bool exact) const;
+		// The controller solves for the activity mask. Only what can be
+		// active for the slider values is solved, rather than everything
+		void storeActiveValues(SolverState &state, bool exact) const;
+		// The dense solve, with the weights accumulated in T
+		template <typename T>
+		void solveDense(SolverState &state, const T *in, size_t n, T *out, bool exact) const;
+		template <typename T>
+		void solveBatchThreads(const T *in, size_t frames, size_t n, T *out, size_t threadCount, bool exact) const;
+		// The dense double solves, through the result cache
+		void solveCached(SolverState &state, const double *in, size_t n, double *out, bool exact, bool incremental) const;
+		void updateIncremental(SolverState &state, const double *in, size_t n, double *out, bool exact) const;
+		// Move single sliders onto and across their progression points,
+		// keeping any that lower err. Returns whether any slider moved
+		bool sweepSliders(SolverState &state, const std::vector<double> &goal, double *values, double &err,
+				const FitOptions &options, bool exact) const;
+		// Bring a built solver up to date after an edit. The spaces point
+		// into floaters, so they're only rebuilt when the floaters changed
+		void replan(bool floatersChanged);
 	public:
 		std::vector<Shape> shapes;
 		std::vector<Progression> progs;
@@ -53,21 +88,160 @@ class Simplex {
 		std::string parseError;
 		size_t parseErrorOffset;
 		const size_t sliderLen() const { return sliders.size(); }
+		const size_t shapeLen() const { return shapes.size(); }
 
-		Simplex():exactSolve(true), built(false), loaded(false), hasParseError(false), parseErrorOffset(0) {};
+		Simplex():exactSolve(true), buildId(0), built(false), loaded(false), hasParseError(false), parseErrorOffset(0) {};
 		explicit Simplex(const std::string &json);
 		explicit Simplex(const char* json);
 
 		void clearValues();
 		void clear();
 		bool parseJSON(const std::string &json);
+		// Parse straight from a buffer, without copying it. The
+		// length doesn't include any null terminator
+		bool parseJSON(std::string_view json);
+		bool parseJSON(const char *json);
+		bool parseJSON(const char *json, size_t length);
 		bool parseJSONversion(const rapidjson::Document &d, unsigned version);
 		void build();
 
+		// Load a solver saved with toBinary(). It's ready to solve right away,
+		// with none of the parsing or triangulation that build() does
+		bool parseBinary(const char *data, size_t size);
+		// Same as above, memory mapping the file instead of reading it
+		bool parseBinaryFile(const std::string &path);
+		// Save the built solver. Builds it first if needed
+		bool toBinary(std::string &out);
+		// Same as above for a solver that's already built, which returns false otherwise
+		bool toBinary(std::string &out) const;
+
+		// Edit the rig in place, for live editing without a full parse and build
+		// Everything refers to shapes, progressions and sliders by index, so
+		// an edit only renumbers the items after it. A built solver is
+		// re-planned right away, but only re-triangulated when the floaters change
+		// The adds put the new item at the end, and return false for bad references
+		bool addShape(const std::string &name);
+		bool addProgression(const std::string &name, const ProgPairs &pairs, ProgType interp);
+		bool addSlider(const std::string &name, size_t prog);
+		bool addCombo(const std::string &name, size_t prog, const ComboPairs &state, ComboSolve solveType);
+		bool setProgression(size_t index, const ProgPairs &pairs, ProgType interp);
+		bool setCombo(size_t index, const ComboPairs &state, ComboSolve solveType);
+		// The removes fail while anything still uses the item, except that
+		// removing a shape drops it from every progression. The rest shape stays
+		bool removeShape(size_t index);
+		bool removeProgression(size_t index);
+		bool removeSlider(size_t index);
+		bool removeCombo(size_t index);
+
+		// What build() measured, plus what the solves that don't take a state measured
+		// Solves into a separate state collect into that state's profile instead
+		SolveProfile getProfile() const;
+		const SolveProfile &getBuildProfile() const { return buildProfile; }
+		void clearProfile();
+
+		// Remembers the weights of recently solved slider values, so repeated
+		// poses are copied instead of solved. It's shared by everything solving
+		// with this Simplex, and is off until it's configured with a capacity
+		// Only the dense double solves and batches go through it
+		SolveCache &resultCache() const { return results; }
+
 		void setExactSolve(bool exact);
 		bool getExactSolve() { return exactSolve; }
 
 		std::vector<double> solve(const std::vector<double> &vec);
+
+		// Solve n input values into the shapeLen() long output buffer
+		// Missing inputs are treated as 0.0, and extras are ignored
+		// Doesn't allocate once the solver has been built
+		void solve(const double *in, size_t n, double *out);
+
+		// Solve into a list of just the shapes with a non-zero weight
+		// The weights match the ones a dense solve() gives
+		void solveSparse(const double *in, size_t n, SparseWeights &out);
+
+		// Re-solve only the controllers and shapes that depend on the inputs
+		// that changed since the last solve. The output buffer must still hold
+		// the result of that solve. Falls back to a full solve when there is
+		// nothing to compare against, or the definition or exactSolve changed
+		void solveIncremental(const double *in, size_t n, double *out);
+
+		// Solve a block of frames. The input has n values per frame, and
+		// the output gets shapeLen() values per frame, both packed row-major
+		void solveBatch(const double *in, size_t frames, size_t n, double *out);
+		// Same as above, with sliderLen() values per input frame
+		void solveBatch(const double *in, size_t frames, double *out);
+
+		// Size a state to fit this solver. The solves that take a state do
+		// this as needed, but calling it up front gets the allocation out of the way
+		void prepareState(SolverState &state) const;
+
+		// The same solves, but with all the per-call data stored in the given state.
+		// These need build() to have been called, and don't modify the Simplex,
+		// so many threads can solve at once as long as each uses its own state
+		void solve(SolverState &state, const double *in, size_t n, double *out) const;
+		void solveIncremental(SolverState &state, const double *in, size_t n, double *out) const;
+		void solveBatch(SolverState &state, const double *in, size_t frames, size_t n, double *out) const;
+
+		// Override exactSolve for just this call, so users sharing one
+		// Simplex can each pick their own setting
+		void solve(SolverState &state, const double *in, size_t n, double *out, bool exact) const;
+		void solveIncremental(SolverState &state, const double *in, size_t n, double *out, bool exact) const;
+		void solveBatch(SolverState &state, const double *in, size_t frames, size_t n, double *out, bool exact) const;
+		// The sparse solve doesn't leave a dense result to build on, so
+		// a following solveIncremental with the same state does a full solve
+		void solveSparse(SolverState &state, const double *in, size_t n, SparseWeights &out) const;
+		void solveSparse(SolverState &state, const double *in, size_t n, SparseWeights &out, bool exact) const;
+
+		// Solve, and also get the derivative of every shape weight with respect
+		// to every slider value, in place of solving once per slider to difference
+		// them. Every slider gets a column, including the ones past n, and where a
+		// weight isn't smooth the derivative is the one on the side the solve takes
+		void solveJacobian(const double *in, size_t n, double *out, SparseJacobian &jac);
+		void solveJacobian(SolverState &state, const double *in, size_t n, double *out, SparseJacobian &jac) const;
+		void solveJacobian(SolverState &state, const double *in, size_t n, double *out, SparseJacobian &jac, bool exact) const;
+
+		// The inverse of a solve. Search for the slider values whose weights
+		// come closest to n target weights, by damped Gauss-Newton on the
+		// Jacobian. Missing targets are treated as 0.0, and extras are ignored
+		// values holds the sliderLen() starting values, and gets the result
+		// It's a local search, so where the weights can't match the target it
+		// stops at the closest fit near the start, not necessarily the closest overall
+		// Returns whether the fit converged
+		bool fit(SolverState &state, const double *target, size_t n, double *values, const FitOptions &options, FitResult &result) const;
+		bool fit(SolverState &state, const double *target, size_t n, double *values, const FitOptions &options, FitResult &result, bool exact) const;
+		// Fit a block of frames with n targets each, into sliderLen() values per frame
+		// The first frame starts from start, or from zero when that's null,
+		// and every other frame starts from the result of the one before it
+		// A frame that doesn't reach its target from there also tries from start
+		// results gets one FitResult per frame, unless it's null
+		void fitBatch(SolverState &state, const double *targets, size_t frames, size_t n, const double *start,
+				double *out, const FitOptions &options, FitResult *results) const;
+		void fitBatch(SolverState &state, const double *targets, size_t frames, size_t n, const double *start,
+				double *out, const FitOptions &options, FitResult *results, bool exact) const;
+		// Split the frames across threadCount worker threads, like solveBatchParallel
+		// The first frame of each thread's run starts from start
+		void fitBatchParallel(const double *targets, size_t frames, size_t n, const double *start,
+				double *out, const FitOptions &options, FitResult *results, size_t threadCount=0) const;
+		void fitBatchParallel(const double *targets, size_t frames, size_t n, const double *start,
+				double *out, const FitOptions &options, FitResult *results, size_t threadCount, bool exact) const;
+
+		// Single precision solves, for float weights without a conversion pass
+		// The controllers are still solved in double, so the combo and space
+		// results don't change. Only the shape weights are stored and summed
+		// as floats, which is where most of the memory traffic is
+		void solve(const float *in, size_t n, float *out);
+		void solveBatch(const float *in, size_t frames, size_t n, float *out);
+		void solve(SolverState &state, const float *in, size_t n, float *out) const;
+		void solve(SolverState &state, const float *in, size_t n, float *out, bool exact) const;
+		void solveBatch(SolverState &state, const float *in, size_t frames, size_t n, float *out) const;
+		void solveBatch(SolverState &state, const float *in, size_t frames, size_t n, float *out, bool exact) const;
+
+		// Split the frames across threadCount worker threads, each with its own state
+		// A threadCount of 0 uses one thread per hardware thread
+		void solveBatchParallel(const double *in, size_t frames, size_t n, double *out, size_t threadCount=0) const;
+		void solveBatchParallel(const float *in, size_t frames, size_t n, float *out, size_t threadCount=0) const;
+		void solveBatchParallel(const double *in, size_t frames, size_t n, double *out, size_t threadCount, bool exact) const;
+		void solveBatchParallel(const float *in, size_t frames, size_t n, float *out, size_t threadCount, bool exact) const;
 };
 
 } // end namespace simplex
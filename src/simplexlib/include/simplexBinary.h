@@ -0,0 +1,47 @@
+/*
+Copyright 2016, Blur Studio
+
+This file is part of Simplex.
+
+Simplex is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Simplex is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Simplex.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <string>
+
+namespace simplex {
+
+class Simplex;
+
+// Bump this whenever the layout changes. Files with any other version are rejected
+const unsigned SIMPLEX_BINARY_VERSION = 1;
+
+// A precompiled form of a built Simplex.
+// The layout is a fixed header followed by flat, fixed-width records for
+// each object list, and the trispaces are stored already triangulated,
+// so loading is a single pass over the bytes with no JSON parsing,
+// triangulation or matrix decomposition
+class SimplexBinary {
+	public:
+		// Check for the magic number at the start of a buffer
+		static bool isBinary(const char *data, size_t size);
+		// The Simplex must be built
+		static void write(const Simplex &simp, std::string &out);
+		// Fill an empty Simplex. Failures are reported through the Simplex's parse error
+		// The data only needs to live for the duration of the call
+		static bool read(Simplex &simp, const char *data, size_t size);
+};
+
+} // end namespace simplex
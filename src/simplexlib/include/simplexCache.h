@@ -0,0 +1,48 @@
+/*
+Copyright 2016, Blur Studio
+
+This file is part of Simplex.
+
+Simplex is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Simplex is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Simplex.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "simplex.h"
+
+#include <memory>
+#include <string_view>
+
+namespace simplex {
+
+// A process-wide store of built solvers, keyed by their definition.
+// Everything that loads the same definition gets the same Simplex, and only
+// has to keep its own SolverState. A definition is parsed and built when it's
+// first asked for, and dropped from the store once its last user lets go.
+// All of this is safe to call from many threads at once
+class SimplexCache {
+	public:
+		// Get the built solver for a json definition. Definitions that fail to
+		// parse are shared as well, so check hasParseError and loaded on the result
+		static std::shared_ptr<const Simplex> acquire(const char *json, size_t length);
+		static std::shared_ptr<const Simplex> acquire(std::string_view json);
+		// Get the solver for a definition only if something is already using it
+		// Returns null instead of parsing and building it
+		static std::shared_ptr<const Simplex> find(std::string_view json);
+
+		// The number of distinct definitions currently in use
+		static size_t size();
+};
+
+} // end namespace simplex
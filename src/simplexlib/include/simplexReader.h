@@ -0,0 +1,42 @@
+/*
+Copyright 2016, Blur Studio
+
+This file is part of Simplex.
+
+Simplex is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Simplex is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Simplex.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <cstddef>
+
+namespace simplex {
+
+class Simplex;
+
+// Loads a JSON definition in a single SAX pass, without building a document.
+// Each element of the solver's sections is kept as a small record of just the
+// members the solver reads, and those are turned into shapes, progressions,
+// sliders, combos and traversals once the whole file has been read, because
+// files don't keep the sections in dependency order, and the encodingVersion
+// that decides how to read them can come anywhere
+class SimplexReader {
+	public:
+		// Accepts exactly what Simplex::parseJSONversion does for the same document
+		// A JSON syntax error is reported through the Simplex's parse error
+		// The json only needs to live for the duration of the call
+		static bool read(Simplex &simp, const char *json, size_t length);
+};
+
+} // end namespace simplex
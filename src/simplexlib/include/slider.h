@@ -20,6 +20,7 @@ along with Simplex.  If not, see <http://www.gnu.org/licenses/>.
 #pragma once
 
 #include "shapeController.h"
+#include "solverState.h"
 #include "rapidjson/document.h"
 
 #include <vector>
@@ -32,14 +33,15 @@ class Progression;
 
 class Slider : public ShapeController {
 	public:
-		Slider(const std::string &name, Progression* prog, size_t index) : ShapeController(name, prog, index){}
-		void storeValue(
-				const std::vector<double> &values,
-				const std::vector<double> &posValues,
-				const std::vector<double> &clamped,
-				const std::vector<bool> &inverses){
+		Slider(const std::string &name, size_t prog, size_t index) : ShapeController(name, prog, index){}
+		void storeValue(SolverState &state) const override {
 			if (!enabled) return;
-			this->value = values[this->index];
+			state.ctrlValues[this->slot] = state.values[this->index];
+		}
+		// The stored value is the raw input, so its derivative is one
+		void storeGradient(ComboPairs &gradient) const {
+			gradient.clear();
+			if (enabled) gradient.push_back(std::make_pair(this->index, 1.0));
 		}
 
 		static bool parseJSONv1(const rapidjson::Value &val, size_t index, Simplex *simp);
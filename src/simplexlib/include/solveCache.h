@@ -0,0 +1,87 @@
+/*
+Copyright 2016, Blur Studio
+
+This file is part of Simplex.
+
+Simplex is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Simplex is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Simplex.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace simplex {
+
+// What a SolveCache did since it was configured, or its stats were cleared
+struct SolveCacheStats {
+	size_t hits = 0;
+	size_t misses = 0;
+	size_t evictions = 0;
+	size_t entries = 0;
+};
+
+// A bounded store of recent solve results, keyed by the slider values
+// that gave them. The least recently used result is dropped once it's full.
+// With a quantum, the slider values are snapped to multiples of it before
+// they're solved, so every pose that snaps to the same values shares a result.
+// Without one, only the exact same values do.
+// Safe to use from many threads at once
+class SolveCache {
+	private:
+		struct Entry {
+			uint64_t hash;
+			std::vector<uint64_t> key;
+			std::vector<double> weights;
+		};
+
+		mutable std::mutex mutex;
+		std::atomic<size_t> capacity{0};
+		double quantum = 0.0;
+		std::list<Entry> entries; // most recently used first
+		std::unordered_multimap<uint64_t, std::list<Entry>::iterator> index;
+		SolveCacheStats stats;
+
+		static uint64_t hashKey(const std::vector<uint64_t> &key);
+	public:
+		SolveCache() {}
+		// Copies start out empty, with the same settings
+		SolveCache(const SolveCache &other);
+		SolveCache &operator=(const SolveCache &other);
+
+		// A capacity of 0 turns the cache off. Also empties it
+		void configure(size_t capacity, double quantum);
+		size_t getCapacity() const { return capacity.load(std::memory_order_relaxed); }
+		double getQuantum() const;
+		bool enabled() const { return getCapacity() != 0; }
+
+		// Build the key for an input of n values, padded to sliderCount with
+		// zeros, and the input that should be solved for it. The owner's buildId
+		// is part of the key, so results from an older build never match
+		void makeKey(size_t buildId, const double *in, size_t n, size_t sliderCount, bool exact,
+				std::vector<uint64_t> &key, std::vector<double> &snapped) const;
+		// Copy the stored result for the key into out, and count the hit or miss
+		bool find(const std::vector<uint64_t> &key, double *out, size_t outLen);
+		void store(const std::vector<uint64_t> &key, const double *weights, size_t outLen);
+
+		void clear();
+		SolveCacheStats getStats() const;
+		void clearStats();
+};
+
+} // end namespace simplex
@@ -0,0 +1,56 @@
+/*
+Copyright 2016, Blur Studio
+
+This file is part of Simplex.
+
+Simplex is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Simplex is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Simplex.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <cstddef>
+
+namespace simplex {
+
+// The settings for Simplex::fit, which searches for the slider values
+// whose solve best matches a set of target shape weights
+struct FitOptions {
+	// The most Gauss-Newton steps to take for one frame
+	size_t maxIterations = 20;
+	// Stop once no slider moves more than this in a step, or
+	// the error can't change faster than this in any free direction
+	double tolerance = 1.0e-6;
+	// Every slider is kept within these values
+	double lower = -1.0;
+	double upper = 1.0;
+	// The starting Levenberg-Marquardt damping. It's lowered after every
+	// step that improves the fit, and raised until a step does
+	double damping = 1.0e-3;
+	// A fit that settles without matching the target tries moving the sliders
+	// one at a time onto, and across, the points of their progressions, to get
+	// out of a nearby local minimum. This is the most times it does that per frame
+	size_t maxSweeps = 2;
+};
+
+// How a fit went
+struct FitResult {
+	size_t iterations = 0;
+	// The sum of the squared differences from the target weights
+	double error = 0.0;
+	// Whether it stopped on the tolerance, or at a point it can't improve on,
+	// rather than running out of iterations
+	bool converged = false;
+};
+
+} // end namespace simplex
@@ -0,0 +1,97 @@
+/*
+Copyright 2016, Blur Studio
+
+This file is part of Simplex.
+
+Simplex is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Simplex is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Simplex.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "comboTable.h"
+#include "traversalTable.h"
+
+#include <vector>
+
+namespace simplex {
+
+class Simplex;
+class ShapeController;
+class Progression;
+
+// A list of indices for each key, packed end to end
+class IndexMap {
+	public:
+		std::vector<size_t> offsets;
+		std::vector<size_t> items;
+
+		const size_t *begin(size_t key) const { return items.data() + offsets[key]; }
+		const size_t *end(size_t key) const { return items.data() + offsets[key + 1]; }
+		void clear();
+		void build(const std::vector<std::vector<size_t>> &lists);
+};
+
+// The flattened form of a built Simplex.
+// This is read-only once build() finishes. Everything that changes
+// per-solve lives in a SolverState instead
+class SolvePlan {
+	public:
+		// Every controller that contributes to the output, in accumulation order
+		// A controller's position in this list is its SolverState slot
+		std::vector<const ShapeController*> outputs;
+		// The progression of each output, looked up from its index
+		std::vector<const Progression*> outputProgs;
+
+		// The non-floater combos grouped by solve type and slider count
+		std::vector<ComboTable> comboTables;
+		size_t maxComboRows = 0;
+		// The (table, row) of every comboTables row, in table order
+		std::vector<std::pair<size_t, size_t>> comboRows;
+
+		// The enabled traversals, grouped the same way
+		std::vector<TraversalTable> traversalTables;
+		size_t maxTraversalRows = 0;
+		// The (table, row) of every traversal, by traversal index
+		// Disabled traversals have a table of size_t(-1)
+		std::vector<std::pair<size_t, size_t>> traversalRows;
+
+		// What has to be re-solved when a slider changes, keyed by slider index
+		// sliderCombos holds comboRows indices
+		IndexMap sliderCombos;
+		IndexMap sliderSpaces;
+		IndexMap sliderTraversals;
+
+		// The activity mask index. Keyed by 2 * slider, plus one for a negative
+		// target, these list the comboRows and the traversals whose state needs
+		// that slider on that side of zero. Traversals are keyed by their
+		// multiplier state, because a failed multiplier silences them
+		IndexMap comboReaders;
+		IndexMap traversalReaders;
+		// Rows that are solved every frame, whatever the sliders are doing
+		std::vector<size_t> forcedComboRows;
+		std::vector<size_t> forcedTraversals;
+		// The slots whose progression weights a shape other than the rest
+		// when the value is zero, so they can contribute while inactive
+		std::vector<size_t> activeAtZero;
+
+		// The shapes each slot's progression can write to, and the
+		// slots that can write to each shape, in ascending order
+		IndexMap ctrlShapes;
+		IndexMap shapeCtrls;
+
+		void clear();
+		void build(Simplex &simp);
+};
+
+} // end namespace simplex
@@ -0,0 +1,121 @@
+/*
+Copyright 2016, Blur Studio
+
+This file is part of Simplex.
+
+Simplex is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Simplex is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Simplex.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+namespace simplex {
+
+// The timed steps of a solve, in the order they run
+enum class SolvePhase {
+	rectify,
+	sliders,
+	combos,
+	spaces,
+	traversals,
+	shapes,
+	count
+};
+
+// Timings and counters for the solver. These are only collected when the
+// library is built with SIMPLEX_PROFILE defined (the "profiling" meson option)
+// Otherwise the instrumentation compiles away, and everything stays at zero
+class SolveProfile {
+	public:
+		static constexpr size_t phaseCount = size_t(SolvePhase::count);
+
+		// Collected by the solves, into the SolverState they use
+		uint64_t solves = 0;
+		uint64_t phaseNanos[phaseCount] = {};
+		uint64_t spacesSearched = 0; // spaces with an active span, that looked for a simplex
+		uint64_t simplicesTested = 0; // candidate simplices, each one a barycentric solve
+		uint64_t floatersSolved = 0; // floaters that got a value from a barycentric solve
+
+		// Collected by Simplex::build()
+		uint64_t builds = 0;
+		uint64_t buildSpacesNanos = 0; // grouping and triangulating the floaters
+		uint64_t buildPlanNanos = 0;
+		uint64_t builtSpaces = 0;
+		uint64_t builtSimplices = 0; // the candidate simplices across every space
+
+		static constexpr bool enabled(){
+#ifdef SIMPLEX_PROFILE
+			return true;
+#else
+			return false;
+#endif
+		}
+
+		void clear() { *this = SolveProfile(); }
+		void merge(const SolveProfile &other){
+			for (size_t i = 0; i < fieldCount; ++i) field(i) += other.field(i);
+		}
+
+		// Every value by name, for reporting them all without knowing the fields
+		static constexpr size_t fieldCount = 15;
+		static const char *fieldName(size_t index){
+			static const char *names[fieldCount] = {
+				"solves", "rectifyNanos", "slidersNanos", "combosNanos", "spacesNanos",
+				"traversalsNanos", "shapesNanos", "spacesSearched", "simplicesTested",
+				"floatersSolved", "builds", "buildSpacesNanos", "buildPlanNanos",
+				"builtSpaces", "builtSimplices",
+			};
+			return names[index];
+		}
+		uint64_t &field(size_t index){
+			uint64_t *fields[fieldCount] = {
+				&solves, &phaseNanos[0], &phaseNanos[1], &phaseNanos[2], &phaseNanos[3],
+				&phaseNanos[4], &phaseNanos[5], &spacesSearched, &simplicesTested,
+				&floatersSolved, &builds, &buildSpacesNanos, &buildPlanNanos,
+				&builtSpaces, &builtSimplices,
+			};
+			return *fields[index];
+		}
+		uint64_t field(size_t index) const { return const_cast<SolveProfile *>(this)->field(index); }
+};
+
+// Charges the time since the previous lap to each counter in turn
+class ProfileLap {
+	private:
+		std::chrono::steady_clock::time_point last;
+	public:
+		ProfileLap():last(std::chrono::steady_clock::now()) {}
+		void lap(uint64_t &nanos){
+			auto now = std::chrono::steady_clock::now();
+			nanos += uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(now - last).count());
+			last = now;
+		}
+};
+
+} // end namespace simplex
+
+// The instrumentation points. They expand to nothing unless profiling is enabled
+#ifdef SIMPLEX_PROFILE
+#define SIMPLEX_PROFILE_START() simplex::ProfileLap profileLap
+#define SIMPLEX_PROFILE_LAP(nanos) profileLap.lap(nanos)
+#define SIMPLEX_PROFILE_PHASE(profile, phase) profileLap.lap((profile).phaseNanos[size_t(simplex::SolvePhase::phase)])
+#define SIMPLEX_PROFILE_COUNT(profile, counter, n) ((profile).counter += (n))
+#else
+#define SIMPLEX_PROFILE_START() ((void)0)
+#define SIMPLEX_PROFILE_LAP(nanos) ((void)0)
+#define SIMPLEX_PROFILE_PHASE(profile, phase) ((void)0)
+#define SIMPLEX_PROFILE_COUNT(profile, counter, n) ((void)0)
+#endif
@@ -0,0 +1,168 @@
+/*
+Copyright 2016, Blur Studio
+
+This file is part of Simplex.
+
+Simplex is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Simplex is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Simplex.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "progression.h"
+#include "combo.h"
+#include "sparseJacobian.h"
+#include "comboTable.h"
+#include "trispace.h"
+#include "solveProfile.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace simplex {
+
+// Counts how many of each item's sliders are active this frame, and lists
+// the items once they all are. The counts are only valid where the stamp matches
+class HitCounter {
+	public:
+		std::vector<size_t> stamps;
+		std::vector<size_t> listed;
+		std::vector<unsigned> hits;
+		std::vector<size_t> active;
+
+		void resize(size_t count){
+			stamps.assign(count, 0);
+			listed.assign(count, 0);
+			hits.assign(count, 0);
+			active.clear();
+			active.reserve(count);
+		}
+		void hit(size_t item, size_t stamp, size_t target){
+			if (stamps[item] != stamp){
+				stamps[item] = stamp;
+				hits[item] = 0;
+			}
+			if (++hits[item] == target) force(item, stamp);
+		}
+		// List the item whatever its count is
+		void force(size_t item, size_t stamp){
+			if (listed[item] == stamp) return;
+			listed[item] = stamp;
+			active.push_back(item);
+		}
+};
+
+// Everything that changes during a solve.
+// A built Simplex is read-only while solving into a SolverState, so any
+// number of threads can share one Simplex as long as each has its own state
+class SolverState {
+	public:
+		// The raw input, and its rectified copies
+		std::vector<double> values;
+		std::vector<double> posValues;
+		std::vector<double> clamped;
+		std::vector<bool> inverses;
+
+		// The stored value and multiplier of every output controller
+		// indexed by ShapeController::getSlot(). Sliders come first,
+		// so the front of ctrlValues is also the list of slider values
+		std::vector<double> ctrlValues;
+		std::vector<double> ctrlMultipliers;
+
+		// Scratch storage for the individual solve steps
+		ProgOutput progScratch;
+		ComboScratch comboScratch;
+		TriSpaceScratch spaceScratch;
+
+		// Storage for Simplex::solveSparse. Only the shapes listed
+		// in touchedShapes hold a value from the current solve
+		std::vector<double> sparseAccum;
+		std::vector<size_t> touchedShapes;
+
+		// Storage for Simplex::solveJacobian. The derivatives of
+		// every slot's value and multiplier with respect to the sliders,
+		// and the values they're taken at. Those are ctrlValues and
+		// ctrlMultipliers, but with every traversal solved, even where
+		// the activity mask skipped one for having a zero multiplier
+		std::vector<ComboPairs> valueGradients;
+		std::vector<ComboPairs> multGradients;
+		std::vector<double> gradientValues;
+		std::vector<double> gradientMultipliers;
+
+		// Storage for Simplex::fit. The weights and Jacobian of the current
+		// sliders and of the trial step, the Jacobians from either side of
+		// zero for the sliders close to it, the damped normal equations, and
+		// the start values Simplex::fitBatch retries a frame from
+		std::vector<double> fitTarget;
+		std::vector<double> fitWeights;
+		std::vector<double> fitTrialWeights;
+		std::vector<double> fitTrial;
+		std::vector<double> fitGradient;
+		std::vector<double> fitNormal;
+		std::vector<double> fitSystem;
+		std::vector<double> fitStep;
+		std::vector<double> fitRetry;
+		std::vector<size_t> fitFree;
+		std::vector<unsigned char> fitSide;
+		ComboPairs fitRow;
+		SparseJacobian fitJacobian;
+		SparseJacobian fitTrialJacobian;
+		SparseJacobian fitAboveJacobian;
+		SparseJacobian fitBelowJacobian;
+		SparseJacobian fitChosenJacobian;
+		ProgOutput derivScratch;
+
+		// Bookkeeping for Simplex::solveIncremental
+		// The previous input is kept in values, and is only trusted while
+		// hasPrevious is set and buildId matches the Simplex that made it
+		size_t buildId = 0;
+		bool hasPrevious = false;
+		bool previousExact = true;
+		// A "visited" mark is a stamp equal to the current one,
+		// so the marks never need to be cleared between solves
+		size_t stamp = 0;
+		std::vector<size_t> ctrlStamp;
+		std::vector<size_t> touchStamp;
+		std::vector<size_t> spaceStamp;
+		std::vector<size_t> shapeStamp;
+		std::vector<size_t> dirtySliders;
+		std::vector<size_t> dirtyCtrls;
+		std::vector<size_t> dirtyShapes;
+		std::vector<size_t> touchedCtrls;
+		std::vector<double> floaterValues;
+
+		// The activity mask. When masked is set, only the combo rows, spaces and
+		// traversals listed in the counters were solved, and activeSlots holds
+		// every slot that can contribute to the output, in ascending order
+		bool masked = false;
+		HitCounter maskCombos;
+		HitCounter maskSpaces;
+		HitCounter maskTraversals;
+		std::vector<size_t> activeSlots;
+
+		// The key of the current input in the Simplex's result cache,
+		// and the input the cache solves for it
+		std::vector<uint64_t> cacheKey;
+		std::vector<double> cacheInput;
+
+		// What the solves into this state measured. Only filled in when
+		// profiling is compiled in, and never cleared by the solver
+		SolveProfile profile;
+
+		void resize(size_t sliderCount, size_t ctrlCount, size_t shapeCount, size_t spaceCount, size_t maxComboRows,
+				size_t comboRowCount, size_t traversalCount);
+		// Also forgets the previous solve
+		void clearValues();
+};
+
+} // end namespace simplex
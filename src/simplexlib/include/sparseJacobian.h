@@ -0,0 +1,71 @@
+/*
+Copyright 2016, Blur Studio
+
+This file is part of Simplex.
+
+Simplex is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Simplex is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Simplex.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+namespace simplex {
+
+// One non-zero derivative of a shape weight with respect to a slider value
+class JacobianEntry {
+	public:
+		size_t shape;
+		size_t slider;
+		double value;
+
+		JacobianEntry(size_t shape, size_t slider, double value): shape(shape), slider(slider), value(value) {}
+		bool operator<(const JacobianEntry &other) const {
+			return (shape != other.shape) ? shape < other.shape : slider < other.slider;
+		}
+};
+
+// The derivatives of every shape weight with respect to every slider
+// value, listing only the non-zero ones. The entries are sorted by shape,
+// then by slider, and no pair is listed twice
+// Clearing keeps the storage, so re-using one of these doesn't allocate
+class SparseJacobian {
+	public:
+		std::vector<JacobianEntry> entries;
+
+		void clear() { entries.clear(); }
+		size_t size() const { return entries.size(); }
+		bool empty() const { return entries.empty(); }
+
+		// The derivative for the given shape and slider, which is 0.0 when it isn't listed
+		double get(size_t shapeIdx, size_t sliderIdx) const {
+			JacobianEntry key(shapeIdx, sliderIdx, 0.0);
+			auto it = std::lower_bound(entries.begin(), entries.end(), key);
+			if (it == entries.end() || it->shape != shapeIdx || it->slider != sliderIdx) return 0.0;
+			return it->value;
+		}
+
+		// Expand into a dense row-major buffer of shapeLen rows and sliderLen
+		// columns, so out[shape * sliderLen + slider]. Entries past the end are dropped
+		void toDense(double *out, size_t shapeLen, size_t sliderLen) const {
+			std::fill(out, out + shapeLen * sliderLen, 0.0);
+			for (auto eit = entries.begin(); eit != entries.end(); ++eit){
+				if (eit->shape < shapeLen && eit->slider < sliderLen)
+					out[eit->shape * sliderLen + eit->slider] = eit->value;
+			}
+		}
+};
+
+} // end namespace simplex
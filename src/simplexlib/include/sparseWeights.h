@@ -0,0 +1,55 @@
+/*
+Copyright 2016, Blur Studio
+
+This file is part of Simplex.
+
+Simplex is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Simplex is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Simplex.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+namespace simplex {
+
+// A solve result that only lists the shapes with a non-zero weight
+// The indices are ascending, and weights[i] goes with indices[i]
+// Clearing keeps the storage, so re-using one of these doesn't allocate
+class SparseWeights {
+	public:
+		std::vector<size_t> indices;
+		std::vector<double> weights;
+
+		void clear() { indices.clear(); weights.clear(); }
+		size_t size() const { return indices.size(); }
+		bool empty() const { return indices.empty(); }
+
+		// The weight of the given shape, which is 0.0 when it isn't listed
+		double get(size_t shapeIdx) const {
+			auto it = std::lower_bound(indices.begin(), indices.end(), shapeIdx);
+			if (it == indices.end() || *it != shapeIdx) return 0.0;
+			return weights[it - indices.begin()];
+		}
+
+		// Expand into a dense buffer of len weights. Indices past the end are dropped
+		void toDense(double *out, size_t len) const {
+			std::fill(out, out + len, 0.0);
+			for (size_t i = 0; i < indices.size(); ++i){
+				if (indices[i] < len) out[indices[i]] = weights[i];
+			}
+		}
+};
+
+} // end namespace simplex
@@ -31,31 +31,44 @@ namespace simplex {
 class Progression;
 class Simplex;
 class Slider;
+class SimplexBinary;
 
 
 class Traversal : public ShapeController {
+	friend class SimplexBinary;
+	friend class TraversalTable; // flattens the states for the solve plan
 	private:
 		ComboPairs progStartState;
 		ComboPairs progDeltaState;
 		ComboPairs multState;
 		ComboSolve solveType;
 		bool exact;
+
+		// Restore an already resolved traversal
+		Traversal(const std::string &name, size_t prog, size_t index,
+				const ComboPairs &progStartState, const ComboPairs &progDeltaState, const ComboPairs &multState, ComboSolve solveType):
+			ShapeController(name, prog, index), progStartState(progStartState), progDeltaState(progDeltaState),
+			multState(multState), solveType(solveType), exact(true) {}
 	public:
 		/*
-		Traversal(const std::string &name, Progression* prog, size_t index,
+		Traversal(const std::string &name, size_t prog, size_t index,
 				ShapeController* progressCtrl, ShapeController* multiplierCtrl, bool valueFlip, bool multiplierFlip):
 			ShapeController(name, prog, index), progressCtrl(progressCtrl), multiplierCtrl(multiplierCtrl),
 			valueFlip(valueFlip), multiplierFlip(multiplierFlip) {}
 		*/
 
-		Traversal(const std::string &name, Progression* prog, size_t index, ShapeController* progressCtrl, ShapeController* multiplierCtrl, bool valueFlip, bool multiplierFlip);
-		Traversal(const std::string &name, Progression* prog, size_t index, const ComboPairs &startState, const ComboPairs &endState, ComboSolve solveType);
-
-		void storeValue(
-			const std::vector<double> &values,
-			const std::vector<double> &posValues,
-			const std::vector<double> &clamped,
-			const std::vector<bool> &inverses);
+		Traversal(const std::string &name, size_t prog, size_t index, ShapeController* progressCtrl, ShapeController* multiplierCtrl, bool valueFlip, bool multiplierFlip);
+		Traversal(const std::string &name, size_t prog, size_t index, const ComboPairs &startState, const ComboPairs &endState, ComboSolve solveType);
+
+		void storeValue(SolverState &state) const override;
+		// The value and multiplier storeValue gives, and their derivatives with respect to the sliders
+		void storeGradient(const SolverState &state, double &value, double &mul, ComboPairs &valueGradient, ComboPairs &multGradient) const;
+		// The sliders this traversal reads. progDeltaState shares them with progStartState
+		const ComboPairs &getMultState() const { return multState; }
+		const ComboPairs &getProgStartState() const { return progStartState; }
+		bool readsSlider(size_t index) const;
+		// Renumber the sliders after one is removed. It can't be one this reads
+		void sliderRemoved(size_t index);
 		static bool parseJSONv1(const rapidjson::Value &val, size_t index, Simplex *simp);
 		static bool parseJSONv2(const rapidjson::Value &val, size_t index, Simplex *simp);
 		static bool parseJSONv3(const rapidjson::Value &val, size_t index, Simplex *simp);
@@ -0,0 +1,72 @@
+/*
+Copyright 2016, Blur Studio
+
+This file is part of Simplex.
+
+Simplex is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Simplex is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Simplex.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "enums.h"
+#include "comboTable.h"
+
+#include <utility>
+#include <vector>
+
+namespace simplex {
+
+class Traversal;
+
+// A group of traversals that share a solve type and state sizes, stored
+// column-major like a ComboTable. The multiplier and progress states are
+// flattened into slider slot and target arrays, so every row is solved
+// with straight loops instead of chasing Slider pointers, and the
+// reductions run in the SolverState's ComboScratch
+class TraversalTable {
+	public:
+		ComboSolve solveType;
+		bool exact;
+		size_t multArity;
+		size_t progArity;
+
+		// The SolverState slot of the traversal for each row
+		std::vector<size_t> rows;
+		// Column-major slider slots and target signs (+1.0 or -1.0) of the multiplier state
+		std::vector<unsigned> multSliders;
+		std::vector<double> multSigns;
+		// The progress state is solved on each slider value minus its start value
+		std::vector<unsigned> progSliders;
+		std::vector<double> progStarts;
+		std::vector<double> progSigns;
+
+		TraversalTable(ComboSolve solveType, bool exact, size_t multArity, size_t progArity):
+			solveType(solveType), exact(exact), multArity(multArity), progArity(progArity) {}
+		size_t size() const { return rows.size(); }
+		void addRow(const Traversal *trav);
+		void finalize();
+
+		// Compute the value and multiplier of every traversal in the table from
+		// the slider values at the front of ctrlValues, like Traversal::storeValue
+		void solve(double *ctrlValues, double *ctrlMultipliers, ComboScratch &scratch) const;
+		// Same as above for a single row, with the same arithmetic
+		void solveRow(size_t row, double *ctrlValues, double *ctrlMultipliers, ComboScratch &scratch) const;
+
+		// Group the enabled traversals into tables. rowOf gets the (table, row)
+		// of each traversal, where disabled ones get a table of size_t(-1)
+		static std::vector<TraversalTable> buildTables(const std::vector<Traversal> &traversals,
+				std::vector<std::pair<size_t, size_t>> &rowOf);
+};
+
+} // end namespace simplex
@@ -21,31 +21,63 @@ along with Simplex.  If not, see <http://www.gnu.org/licenses/>.
 
 #include "enums.h"
 #include "utils.h"
+#include "combo.h"
 #include <vector>
 #include <unordered_map>
 
 namespace simplex {
 
 class Floater;
+class SolverState;
+class SimplexBinary;
+
+// Scratch storage so TriSpace::storeValue doesn't allocate once warmed up
+class TriSpaceScratch {
+	public:
+		std::vector<double> vec;
+		std::vector<bool> inverse;
+		std::vector<int> simp;
+		std::vector<std::pair<int, double>> sort;
+		std::vector<double> bary;
+};
+
+// A user simplex with its barycentric solve precomputed
+// The corners never change after triangulation, so the solve
+// is reduced to one small matrix-vector multiply
+class BarySolve {
+	public:
+		// The floater index for each corner, or -1 if it isn't a floater
+		std::vector<int> floaterCorners;
+		// The last corner, and the row-major inverse of the other corners minus it
+		std::vector<double> last;
+		std::vector<double> inverse;
+
+		BarySolve() {}
+		BarySolve(const std::vector<std::vector<double>> &corners, const std::vector<int> &floaterCorners);
+		// Write the dim+1 barycentric coordinates of p to out
+		void solve(const double *p, double *out) const;
+};
 
 class TriSpace {
+	friend class SimplexBinary; // lets the serializer skip the triangulation
 	private:
+		TriSpace() {}
+
 		// Correlates the auto-generated simplex with the user-created simplices
 		// resulting from the splitting procedure
 		std::unordered_map<std::vector<int>, std::vector<std::vector<int>>, vectorHash<int>> simplexMap;
+		// The same user simplices, ready to solve
+		std::unordered_map<std::vector<int>, std::vector<BarySolve>, vectorHash<int>> barySolves;
 		std::vector<std::vector<double>> userPoints;
 		std::vector<std::vector<int>> overrideSimplices;
 
 		std::vector<Floater *> floaters;
-		std::vector<double> barycentric(const std::vector<std::vector<double>> &simplex, const std::vector<double> &p) const;
-		//static std::vector<std::vector<double>> simplexToCorners(const std::vector<int> &simplex);
-		std::vector<int> pointToSimp(const std::vector<double> &pt);
-		std::vector<std::vector<int>> pointToAdjSimp(const std::vector<double> &pt, double eps=0.01);
+		static void pointToSimp(const std::vector<double> &pt, std::vector<int> &out, std::vector<std::pair<int, double>> &sortScratch);
 		void triangulate(); // convenience function for separating the data access from the actual math
-		// Code to split a list of simplices by a list of points, only used in triangulate()
-		std::vector<std::vector<std::vector<double>>> splitSimps(const std::vector<std::vector<double>> &pts, const std::vector<std::vector<int>> &simps) const;
-		std::vector<std::vector<double> > simplexToCorners(const std::vector<int> &simplex) const;
-		void rec(const std::vector<double> &point, const std::vector<int> &oVals, const std::vector<int> &simp, std::vector<std::vector<int> > &out, double eps) const;
+		void buildBarySolves();
+		// Find the user simplex that holds the current slider values, leaving
+		// its barycentric coordinates in the state's scratch. Null if there isn't one
+		const BarySolve *findSolve(SolverState &state) const;
 
 		// break down the given simplex encoding to a list of corner points for the barycentric solver and
 		// a correlation of the point index to the floater index (or size_t_MAX if invalid)
@@ -53,18 +85,21 @@ class TriSpace {
 				const std::vector<int> &simplex,
 				const std::vector<int> &original,
 				std::vector<std::vector<double>> &out,
-				std::vector<int> &floaterCorners
+				std::vector<int> &floaterCorners,
+				std::vector<double> &currVec
 				) const;
 
 	public:
 		// Take the non-related floaters and group them by shared span and orthant
 		static std::vector<TriSpace> buildSpaces(std::vector<Floater> &floaters);
 		TriSpace(std::vector<Floater*> floaters);
-		void storeValue(
-				const std::vector<double> &values,
-				const std::vector<double> &posValues,
-				const std::vector<double> &clamped,
-				const std::vector<bool> &inverses);
+		const std::vector<Floater*> &getFloaters() const { return floaters; }
+		// The number of candidate simplices the solve can test
+		size_t simplexCount() const;
+		void storeValue(SolverState &state) const;
+		// The derivatives of the floater values storeValue gives, written to
+		// the gradient at each floater's slot. Floaters that get no value are left alone
+		void storeGradient(SolverState &state, std::vector<ComboPairs> &gradients) const;
 };
 
 
@@ -19,6 +19,7 @@ along with Simplex.  If not, see <http://www.gnu.org/licenses/>.
 
 #pragma once
 
+#include <cmath>  // for signbit
 #include <vector>
 #include <type_traits>  // for hash
 #include "rapidjson/document.h"
@@ -63,6 +64,8 @@ inline bool floatEQ(const double A, const double B, const double eps) {
 inline bool isZero(const double a) { return floatEQ(a, 0.0, EPS); }
 inline bool isPositive(const double a) { return a > -EPS; }
 inline bool isNegative(const double a) { return a < EPS; }
+// Exactly +0.0, which is what every value is cleared to
+inline bool isCleanZero(const double a) { return a == 0.0 && !std::signbit(a); }
 
 void rectify(
 		const std::vector<double> &rawVec,
@@ -72,6 +75,8 @@ void rectify(
 );
 
 double doSoftMin(double X, double Y);
+// Same as above, also giving the partial derivatives with respect to X and Y
+double doSoftMin(double X, double Y, double &dX, double &dY);
 
 template <typename T>
 struct vectorHash {
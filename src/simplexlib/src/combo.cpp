@@ -28,14 +28,18 @@ along with Simplex.  If not, see <http://www.gnu.org/licenses/>.
 using namespace simplex;
 
 
-bool simplex::solveState(const std::vector<double> &vals, const std::vector<double> &tars, ComboSolve solveType, bool exact, double &value) {
+namespace {
+// The shared combo math. getPair(i, val, tar) provides the
+// i'th value/target so callers don't have to build temporary vectors
+template <typename PairGetter>
+bool solveStateImpl(size_t count, PairGetter getPair, ComboSolve solveType, bool exact, double &value) {
 	double mn, mx, allMul = 1.0, allSum = 0.0;
 	mn = std::numeric_limits<double>::infinity();
 	mx = -mn;
 
-	for (size_t i = 0; i < vals.size(); ++i){
-		double val = vals[i];
-		double tar = tars[i];
+	for (size_t i = 0; i < count; ++i){
+		double val, tar;
+		getPair(i, val, tar);
 
 		// Specifically this instead of isNegative()
 		// because isNegative returns true for 0.0
@@ -72,7 +76,7 @@ bool simplex::solveState(const std::vector<double> &vals, const std::vector<doub
 		if (isZero(allSum))
 			value = 0.0;
 		else
-			value = vals.size() * allMul / allSum;
+			value = count * allMul / allSum;
 		break;
 	case ComboSolve::None:
 		value = (exact) ? mn : doSoftMin(mx, mn);
@@ -83,15 +87,162 @@ bool simplex::solveState(const std::vector<double> &vals, const std::vector<doub
 	return true;
 }
 
-bool simplex::solveState(const ComboPairs &stateList, ComboSolve solveType, bool exact, double &value) {
-	std::vector<double> vals, tars;
-	for (auto sit = stateList.begin(); sit != stateList.end(); ++sit) {
-		//for (const auto &state: stateList){
-		const auto &state = *sit;
-		vals.push_back(state.first->getValue());
-		tars.push_back(state.second);
+// solveStateImpl, also giving the derivative of the value with respect to each
+// slider. getPair(i, slider, val, tar) provides the i'th slider index as well
+// The clamped slider values have no derivative
+template <typename PairGetter>
+bool solveGradientImpl(size_t count, PairGetter getPair, ComboSolve solveType, bool exact, double &value, ComboPairs &gradient) {
+	gradient.clear();
+	double mn, mx, allMul = 1.0, allSum = 0.0;
+	mn = std::numeric_limits<double>::infinity();
+	mx = -mn;
+
+	// Reduce the i'th value the same way, with its derivative in dval
+	auto reduce = [&](size_t i, size_t &slider, double &val, double &dval) {
+		double tar;
+		getPair(i, slider, val, tar);
+		bool valNeg = !isPositive(val);
+		bool tarNeg = !isPositive(tar);
+		if (valNeg != tarNeg) return false;
+		dval = 1.0;
+		if (valNeg) { val = -val; dval = -1.0; }
+		if (val > MAXVAL) { val = MAXVAL; dval = 0.0; }
+		return true;
+	};
+
+	for (size_t i = 0; i < count; ++i){
+		size_t slider;
+		double val, dval;
+		if (!reduce(i, slider, val, dval)) {
+			gradient.clear();
+			return false;
+		}
+		gradient.push_back(std::make_pair(slider, dval));
+		allMul *= val;
+		allSum += val;
+		if (val < mn) mn = val;
+		if (val > mx) mx = val;
 	}
-	return simplex::solveState(vals, tars, solveType, exact, value);
+	// The product of every reduced value but the i'th
+	auto others = [&](size_t i) {
+		double mul = 1.0;
+		for (size_t j = 0; j < count; ++j){
+			if (j == i) continue;
+			size_t slider;
+			double val, dval;
+			reduce(j, slider, val, dval);
+			mul *= val;
+		}
+		return mul;
+	};
+
+	// The derivative of the value with respect to the reduced min and max
+	// Only the product solves depend on the values in between
+	double dMn = 0.0, dMx = 0.0;
+	bool allValues = false;
+	switch (solveType) {
+	case ComboSolve::allMul:
+		value = allMul;
+		allValues = true;
+		break;
+	case ComboSolve::extMul:
+		value = mx * mn;
+		dMn = mx;
+		dMx = mn;
+		break;
+	case ComboSolve::mulAvgExt:
+		if (isZero(mx + mn)) {
+			value = 0.0;
+		}
+		else {
+			double den = (mx + mn) * (mx + mn);
+			value = 2 * (mx * mn) / (mx + mn);
+			dMn = 2 * mx * mx / den;
+			dMx = 2 * mn * mn / den;
+		}
+		break;
+	case ComboSolve::mulAvgAll:
+		if (isZero(allSum))
+			value = 0.0;
+		else
+			value = count * allMul / allSum;
+		allValues = true;
+		break;
+	default: // min and None
+		if (exact) {
+			value = mn;
+			dMn = 1.0;
+		}
+		else {
+			value = doSoftMin(mx, mn, dMx, dMn);
+		}
+	}
+
+	// When sliders tie for the min or max, the value isn't smooth there
+	// Splitting the derivative between them gives the average of the one
+	// sided derivatives, and doesn't depend on the order of the sliders
+	size_t mnTies = 0, mxTies = 0;
+	if (!allValues) {
+		for (size_t i = 0; i < count; ++i){
+			size_t slider;
+			double val, dval;
+			reduce(i, slider, val, dval);
+			if (val == mn) ++mnTies;
+			if (val == mx) ++mxTies;
+		}
+	}
+
+	for (size_t i = 0; i < count; ++i){
+		double dv = 0.0;
+		if (allValues) {
+			if (solveType == ComboSolve::allMul)
+				dv = others(i);
+			else if (!isZero(allSum))
+				dv = count * (others(i) * allSum - allMul) / (allSum * allSum);
+		}
+		else {
+			size_t slider;
+			double val, dval;
+			reduce(i, slider, val, dval);
+			if (val == mn) dv += dMn / mnTies;
+			if (val == mx) dv += dMx / mxTies;
+		}
+		gradient[i].second *= dv;
+	}
+	gradient.erase(std::remove_if(gradient.begin(), gradient.end(),
+		[](const ComboPair &p) { return p.second == 0.0; }), gradient.end());
+	return true;
+}
+} // namespace
+
+bool simplex::solveState(const std::vector<double> &vals, const std::vector<double> &tars, ComboSolve solveType, bool exact, double &value) {
+	return solveStateImpl(vals.size(),
+		[&](size_t i, double &val, double &tar) { val = vals[i]; tar = tars[i]; },
+		solveType, exact, value);
+}
+
+bool simplex::solveState(const ComboPairs &stateList, const double *ctrlValues, ComboSolve solveType, bool exact, double &value) {
+	return solveStateImpl(stateList.size(),
+		[&](size_t i, double &val, double &tar) { val = ctrlValues[stateList[i].first]; tar = stateList[i].second; },
+		solveType, exact, value);
+}
+
+bool simplex::solveState(const ComboPairs &startList, const ComboPairs &deltaList, const double *ctrlValues, ComboSolve solveType, bool exact, double &value) {
+	return solveStateImpl(startList.size(),
+		[&](size_t i, double &val, double &tar) { val = ctrlValues[startList[i].first] - startList[i].second; tar = deltaList[i].second; },
+		solveType, exact, value);
+}
+
+bool simplex::solveStateGradient(const ComboPairs &stateList, const double *ctrlValues, ComboSolve solveType, bool exact, double &value, ComboPairs &gradient) {
+	return solveGradientImpl(stateList.size(),
+		[&](size_t i, size_t &slider, double &val, double &tar) { slider = stateList[i].first; val = ctrlValues[slider]; tar = stateList[i].second; },
+		solveType, exact, value, gradient);
+}
+
+bool simplex::solveStateGradient(const ComboPairs &startList, const ComboPairs &deltaList, const double *ctrlValues, ComboSolve solveType, bool exact, double &value, ComboPairs &gradient) {
+	return solveGradientImpl(startList.size(),
+		[&](size_t i, size_t &slider, double &val, double &tar) { slider = startList[i].first; val = ctrlValues[slider] - startList[i].second; tar = deltaList[i].second; },
+		solveType, exact, value, gradient);
 }
 
 ComboSolve simplex::getSolveType(const rapidjson::Value &val) {
@@ -102,26 +253,26 @@ ComboSolve simplex::getSolveType(const rapidjson::Value &val) {
 			solveType = ComboSolve::None;
 		}
 		else {
-			std::string solve(solveIt->value.GetString());
-			if (solve == "min")
-				solveType = ComboSolve::min;
-			else if (solve == "allMul")
-				solveType = ComboSolve::allMul;
-			else if (solve == "extMul")
-				solveType = ComboSolve::extMul;
-			else if (solve == "mulAvgExt")
-				solveType = ComboSolve::mulAvgExt;
-			else if (solve == "mulAvgAll")
-				solveType = ComboSolve::mulAvgAll;
-			else if (solve == "None")
-				solveType = ComboSolve::None;
-			else
-				solveType = ComboSolve::None;
+			solveType = getSolveType(std::string(solveIt->value.GetString()));
 		}
 	}
 	return solveType;
 }
 
+ComboSolve simplex::getSolveType(const std::string &solve) {
+	if (solve == "min")
+		return ComboSolve::min;
+	else if (solve == "allMul")
+		return ComboSolve::allMul;
+	else if (solve == "extMul")
+		return ComboSolve::extMul;
+	else if (solve == "mulAvgExt")
+		return ComboSolve::mulAvgExt;
+	else if (solve == "mulAvgAll")
+		return ComboSolve::mulAvgAll;
+	return ComboSolve::None;
+}
+
 bool simplex::getSolvePairs(const rapidjson::Value &val, Simplex *simp, ComboPairs &state, bool &isFloater) {
 	for (auto it = val.Begin(); it != val.End(); ++it) {
 		auto &ival = *it;
@@ -134,17 +285,31 @@ bool simplex::getSolvePairs(const rapidjson::Value &val, Simplex *simp, ComboPai
 		if (!floatEQ(fabs(slval), 1.0, EPS) && !isZero(slval))
 			isFloater = true;
 		if (slidx >= simp->sliders.size()) return false;
-		state.push_back(std::make_pair(&simp->sliders[slidx], slval));
+		state.push_back(std::make_pair(slidx, slval));
 	}
 	return true;
 }
 
-Combo::Combo(const std::string &name, Progression* prog, size_t index,
+bool simplex::isFloaterState(const ComboPairs &state) {
+	for (auto pit = state.begin(); pit != state.end(); ++pit){
+		if (!floatEQ(fabs(pit->second), 1.0, EPS) && !isZero(pit->second))
+			return true;
+	}
+	return false;
+}
+
+void simplex::sliderRemoved(ComboPairs &state, size_t index) {
+	for (auto pit = state.begin(); pit != state.end(); ++pit){
+		if (pit->first > index) --pit->first;
+	}
+}
+
+Combo::Combo(const std::string &name, size_t prog, size_t index,
 	const ComboPairs &stateList, bool isFloater, ComboSolve solveType) :
 	ShapeController(name, prog, index), stateList(stateList), isFloater(isFloater), solveType(solveType), exact(true) {
 	std::sort(this->stateList.begin(), this->stateList.end(),
 		[](const ComboPair &lhs, const ComboPair &rhs) {
-		return lhs.first->getIndex() < rhs.first->getIndex();
+		return lhs.first < rhs.first;
 	}
 	);
 	std::vector<double> rawVec;
@@ -156,15 +321,18 @@ Combo::Combo(const std::string &name, Progression* prog, size_t index,
 	rectify(rawVec, rectified, clamped, inverted);
 }
 
-void Combo::storeValue(
-	const std::vector<double> &values,
-	const std::vector<double> &posValues,
-	const std::vector<double> &clamped,
-	const std::vector<bool> &inverses) {
+void Combo::storeValue(SolverState &state) const {
+	if (!enabled) return;
+	if (isFloater) return;
+	solveState(stateList, state.ctrlValues.data(), solveType, exact, state.ctrlValues[slot]);
+}
 
+void Combo::storeGradient(const SolverState &state, bool exact, ComboPairs &gradient) const {
+	gradient.clear();
 	if (!enabled) return;
 	if (isFloater) return;
-	solveState(stateList, solveType, exact, value);
+	double value;
+	solveStateGradient(stateList, state.ctrlValues.data(), solveType, exact, value, gradient);
 }
 
 bool Combo::parseJSONv1(const rapidjson::Value &val, size_t index, Simplex *simp) {
@@ -185,15 +353,15 @@ bool Combo::parseJSONv1(const rapidjson::Value &val, size_t index, Simplex *simp
 			isFloater = true;
 
 		if (slidx >= simp->sliders.size()) return false;
-		state.push_back(std::make_pair(&simp->sliders[slidx], slval));
+		state.push_back(std::make_pair(slidx, slval));
 	}
 
 	std::string name(val[0u].GetString());
 	size_t pidx = (size_t)val[1].GetInt();
 	if (pidx >= simp->progs.size()) return false;
 	if (isFloater)
-		simp->floaters.push_back(Floater(name, &simp->progs[pidx], index, state, isFloater));
-	simp->combos.push_back(Combo(name, &simp->progs[pidx], index, state, isFloater, ComboSolve::None));
+		simp->floaters.push_back(Floater(name, pidx, index, state, isFloater));
+	simp->combos.push_back(Combo(name, pidx, index, state, isFloater, ComboSolve::None));
 	return true;
 }
 
@@ -205,7 +373,7 @@ bool Combo::parseJSONv2(const rapidjson::Value &val, size_t index, Simplex *simp
 
 	std::string name(nameIt->value.GetString());
 
-	ComboSolve solveType = getSolveType(val);
+	ComboSolve solveType = simplex::getSolveType(val);
 	ComboPairs state;
 	bool isFloater = false;
 	auto &pairsVal = pairsIt->value;
@@ -217,13 +385,13 @@ bool Combo::parseJSONv2(const rapidjson::Value &val, size_t index, Simplex *simp
 	bool enabled = getEnabled(val);
 
 	if (isFloater) {
-		simp->floaters.push_back(Floater(name, &simp->progs[pidx], index, state, isFloater));
+		simp->floaters.push_back(Floater(name, pidx, index, state, isFloater));
 		simp->floaters.back().setEnabled(enabled);
 	}
 	// because a floater is still considered a combo
 	// I need to add it to the list for indexing purposes
 
-	simp->combos.push_back(Combo(name, &simp->progs[pidx], index, state, isFloater, solveType));
+	simp->combos.push_back(Combo(name, pidx, index, state, isFloater, solveType));
 	simp->combos.back().setEnabled(enabled);
 	return true;
 }
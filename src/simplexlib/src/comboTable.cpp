@@ -0,0 +1,286 @@
+/*
+Copyright 2016, Blur Studio
+
+This file is part of Simplex.
+
+Simplex is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Simplex is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Simplex.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "simplex.h"
+#include "comboTable.h"
+
+#include "math.h"
+
+#include <limits>  // for numeric_limits
+#include <vector>
+
+using namespace simplex;
+
+namespace {
+// doSoftMin with its exponent of 2 folded in, and without the branches
+// Expects mx >= mn >= 0.0
+inline double softMinKernel(double mx, double mn) {
+	const double h = 0.025;
+	const double s = sqrt(h);
+	const double d = 2.0 * (sqrt(1.0 + h) - s);
+	double dd = mx - mn;
+	double z = sqrt(mx * mx + h) + sqrt(mn * mn + h) - sqrt(dd * dd + h);
+	double out = (z - s) / d;
+	return (mn <= EPS) ? 0.0 : out;
+}
+
+// The combo value for the reduced slider values, with the same arithmetic as ComboTable::solveRow
+template <ComboSolve S>
+inline double comboValue(double mn, double mx, double mul, double sum, size_t arity, bool exact) {
+	if constexpr (S == ComboSolve::allMul)
+		return mul;
+	else if constexpr (S == ComboSolve::extMul)
+		return mx * mn;
+	else if constexpr (S == ComboSolve::mulAvgExt)
+		return isZero(mx + mn) ? 0.0 : 2 * (mx * mn) / (mx + mn);
+	else if constexpr (S == ComboSolve::mulAvgAll)
+		return isZero(sum) ? 0.0 : arity * mul / sum;
+	else // min and None
+		return exact ? mn : softMinKernel(mx, mn);
+}
+
+// ComboTable::solve for a fixed arity and solve type. Each row is reduced
+// in registers, so there's no scratch, and the slider loop unrolls completely
+template <size_t N, ComboSolve S>
+void solveFixed(const ComboTable &table, double *ctrlValues, bool exact) {
+	size_t count = table.rows.size();
+	const unsigned *sliders = table.sliders.data();
+	const double *signs = table.signs.data();
+	const size_t *rows = table.rows.data();
+	const double inf = std::numeric_limits<double>::infinity();
+
+	for (size_t r = 0; r < count; ++r){
+		double mn = inf, mx = -inf, mul = 1.0, sum = 0.0;
+		unsigned char valid = 1;
+		for (size_t j = 0; j < N; ++j){
+			double sgn = signs[j * count + r];
+			double v = sgn * ctrlValues[sliders[j * count + r]];
+			unsigned char ok = (v > -EPS) & ((sgn > 0.0) | (v >= EPS));
+			valid &= ok;
+
+			v = (v > MAXVAL) ? MAXVAL : v;
+			mul *= v;
+			sum += v;
+			mn = (v < mn) ? v : mn;
+			mx = (v > mx) ? v : mx;
+		}
+		// Combos only read slider values, so storing as we go can't change a later row
+		if (valid) ctrlValues[rows[r]] = comboValue<S>(mn, mx, mul, sum, N, exact);
+	}
+}
+
+template <size_t N>
+ComboTable::Kernel selectKernel(ComboSolve solveType) {
+	switch (solveType) {
+	case ComboSolve::allMul: return &solveFixed<N, ComboSolve::allMul>;
+	case ComboSolve::extMul: return &solveFixed<N, ComboSolve::extMul>;
+	case ComboSolve::mulAvgExt: return &solveFixed<N, ComboSolve::mulAvgExt>;
+	case ComboSolve::mulAvgAll: return &solveFixed<N, ComboSolve::mulAvgAll>;
+	default: return &solveFixed<N, ComboSolve::min>;
+	}
+}
+} // namespace
+
+void ComboScratch::resize(size_t rows){
+	mn.resize(rows);
+	mx.resize(rows);
+	mul.resize(rows);
+	sum.resize(rows);
+	valid.resize(rows);
+	value.resize(rows);
+}
+
+void ComboTable::addRow(Combo *combo){
+	// Stored row-major until finalize()
+	rows.push_back(combo->getSlot());
+	for (auto pit = combo->stateList.begin(); pit != combo->stateList.end(); ++pit){
+		sliders.push_back(unsigned(pit->first));
+		signs.push_back(isPositive(pit->second) ? 1.0 : -1.0);
+	}
+}
+
+void ComboTable::finalize(){
+	size_t count = rows.size();
+	std::vector<unsigned> colSliders(sliders.size());
+	std::vector<double> colSigns(signs.size());
+	for (size_t r = 0; r < count; ++r){
+		for (size_t j = 0; j < arity; ++j){
+			colSliders[j * count + r] = sliders[r * arity + j];
+			colSigns[j * count + r] = signs[r * arity + j];
+		}
+	}
+	sliders.swap(colSliders);
+	signs.swap(colSigns);
+
+	switch (arity) {
+	case 2: kernel = selectKernel<2>(solveType); break;
+	case 3: kernel = selectKernel<3>(solveType); break;
+	case 4: kernel = selectKernel<4>(solveType); break;
+	default: kernel = nullptr;
+	}
+}
+
+void ComboTable::solve(double *ctrlValues, bool exact, ComboScratch &scratch) const {
+	if (kernel)
+		kernel(*this, ctrlValues, exact);
+	else
+		solveGeneric(ctrlValues, exact, scratch);
+}
+
+void ComboTable::solveGeneric(double *ctrlValues, bool exact, ComboScratch &scratch) const {
+	size_t count = rows.size();
+	const double *sliderValues = ctrlValues;
+	double *mn = scratch.mn.data();
+	double *mx = scratch.mx.data();
+	double *mul = scratch.mul.data();
+	double *sum = scratch.sum.data();
+	unsigned char *valid = scratch.valid.data();
+	double *value = scratch.value.data();
+
+	const double inf = std::numeric_limits<double>::infinity();
+	for (size_t r = 0; r < count; ++r){
+		mn[r] = inf;
+		mx[r] = -inf;
+		mul[r] = 1.0;
+		sum[r] = 0.0;
+		valid[r] = 1;
+	}
+
+	for (size_t j = 0; j < arity; ++j){
+		const unsigned *idx = &sliders[j * count];
+		const double *sgn = &signs[j * count];
+		for (size_t r = 0; r < count; ++r){
+			// Flip the value onto the target's side. Matches solveState,
+			// where the value and target must agree on their sign
+			double v = sgn[r] * sliderValues[idx[r]];
+			unsigned char ok = (v > -EPS) & ((sgn[r] > 0.0) | (v >= EPS));
+			valid[r] &= ok;
+
+			v = (v > MAXVAL) ? MAXVAL : v;
+			mul[r] *= v;
+			sum[r] += v;
+			mn[r] = (v < mn[r]) ? v : mn[r];
+			mx[r] = (v > mx[r]) ? v : mx[r];
+		}
+	}
+
+	switch (solveType) {
+	case ComboSolve::allMul:
+		for (size_t r = 0; r < count; ++r)
+			value[r] = mul[r];
+		break;
+	case ComboSolve::extMul:
+		for (size_t r = 0; r < count; ++r)
+			value[r] = mx[r] * mn[r];
+		break;
+	case ComboSolve::mulAvgExt:
+		for (size_t r = 0; r < count; ++r){
+			double den = mx[r] + mn[r];
+			value[r] = isZero(den) ? 0.0 : 2 * (mx[r] * mn[r]) / den;
+		}
+		break;
+	case ComboSolve::mulAvgAll:
+		for (size_t r = 0; r < count; ++r)
+			value[r] = isZero(sum[r]) ? 0.0 : arity * mul[r] / sum[r];
+		break;
+	default: // min and None
+		if (exact){
+			for (size_t r = 0; r < count; ++r)
+				value[r] = mn[r];
+		}
+		else {
+			for (size_t r = 0; r < count; ++r)
+				value[r] = softMinKernel(mx[r], mn[r]);
+		}
+	}
+
+	// Only successful solves are stored, just like Combo::storeValue
+	for (size_t r = 0; r < count; ++r){
+		if (valid[r]) ctrlValues[rows[r]] = value[r];
+	}
+}
+
+void ComboTable::solveRow(size_t row, double *ctrlValues, bool exact) const {
+	size_t count = rows.size();
+	const double inf = std::numeric_limits<double>::infinity();
+	double mn = inf, mx = -inf, mul = 1.0, sum = 0.0;
+	unsigned char valid = 1;
+	for (size_t j = 0; j < arity; ++j){
+		double sgn = signs[j * count + row];
+		double v = sgn * ctrlValues[sliders[j * count + row]];
+		unsigned char ok = (v > -EPS) & ((sgn > 0.0) | (v >= EPS));
+		valid &= ok;
+
+		v = (v > MAXVAL) ? MAXVAL : v;
+		mul *= v;
+		sum += v;
+		mn = (v < mn) ? v : mn;
+		mx = (v > mx) ? v : mx;
+	}
+	if (!valid) return;
+
+	double value;
+	switch (solveType) {
+	case ComboSolve::allMul:
+		value = mul;
+		break;
+	case ComboSolve::extMul:
+		value = mx * mn;
+		break;
+	case ComboSolve::mulAvgExt:
+		value = isZero(mx + mn) ? 0.0 : 2 * (mx * mn) / (mx + mn);
+		break;
+	case ComboSolve::mulAvgAll:
+		value = isZero(sum) ? 0.0 : arity * mul / sum;
+		break;
+	default: // min and None
+		value = exact ? mn : softMinKernel(mx, mn);
+	}
+	ctrlValues[rows[row]] = value;
+}
+
+std::vector<ComboTable> ComboTable::buildTables(std::vector<Combo> &combos){
+	std::vector<ComboTable> tables;
+	for (auto cit = combos.begin(); cit != combos.end(); ++cit){
+		Combo &combo = *cit;
+		// Disabled combos and floaters keep their cleared value
+		if (!combo.enabled || combo.isFloater) continue;
+
+		// None solves exactly the same as min
+		ComboSolve solveType = (combo.solveType == ComboSolve::None) ? ComboSolve::min : combo.solveType;
+		size_t arity = combo.stateList.size();
+
+		ComboTable *table = nullptr;
+		for (auto tit = tables.begin(); tit != tables.end(); ++tit){
+			if (tit->solveType == solveType && tit->arity == arity){
+				table = &(*tit);
+				break;
+			}
+		}
+		if (table == nullptr){
+			tables.push_back(ComboTable(solveType, arity));
+			table = &tables.back();
+		}
+		table->addRow(&combo);
+	}
+
+	for (auto tit = tables.begin(); tit != tables.end(); ++tit)
+		tit->finalize();
+	return tables;
+}
@@ -0,0 +1,111 @@
+/*
+Copyright 2016, Blur Studio
+
+This file is part of Simplex.
+
+Simplex is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Simplex is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Simplex.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "mappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <string>
+
+using namespace simplex;
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(): ptr(nullptr), len(0), fileHandle(INVALID_HANDLE_VALUE), mapHandle(nullptr) {}
+
+bool MappedFile::open(const std::string &path){
+	close();
+	fileHandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (fileHandle == INVALID_HANDLE_VALUE) return false;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart == 0){
+		close();
+		return false;
+	}
+	mapHandle = CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapHandle == nullptr){
+		close();
+		return false;
+	}
+	void *view = MapViewOfFile(mapHandle, FILE_MAP_READ, 0, 0, 0);
+	if (view == nullptr){
+		close();
+		return false;
+	}
+	ptr = static_cast<const char *>(view);
+	len = size_t(fileSize.QuadPart);
+	return true;
+}
+
+void MappedFile::close(){
+	if (ptr != nullptr) UnmapViewOfFile(ptr);
+	if (mapHandle != nullptr) CloseHandle(mapHandle);
+	if (fileHandle != INVALID_HANDLE_VALUE) CloseHandle(fileHandle);
+	ptr = nullptr;
+	len = 0;
+	mapHandle = nullptr;
+	fileHandle = INVALID_HANDLE_VALUE;
+}
+
+#else
+
+MappedFile::MappedFile(): ptr(nullptr), len(0), fd(-1) {}
+
+bool MappedFile::open(const std::string &path){
+	close();
+	fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0) return false;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0){
+		close();
+		return false;
+	}
+	void *view = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+	if (view == MAP_FAILED){
+		close();
+		return false;
+	}
+	ptr = static_cast<const char *>(view);
+	len = size_t(st.st_size);
+	return true;
+}
+
+void MappedFile::close(){
+	if (ptr != nullptr) munmap(const_cast<char *>(ptr), len);
+	if (fd >= 0) ::close(fd);
+	ptr = nullptr;
+	len = 0;
+	fd = -1;
+}
+
+#endif
+
+MappedFile::~MappedFile(){
+	close();
+}
@@ -23,7 +23,8 @@ along with Simplex.  If not, see <http://www.gnu.org/licenses/>.
 #include "rapidjson/document.h"
 #include "rapidjson/rapidjson.h"
 
-#include <algorithm>  // for sort
+#include <algorithm>  // for sort, upper_bound
+#include <math.h>
 #include <utility>
 #include <vector>
 #include <string>
@@ -31,98 +32,117 @@ along with Simplex.  If not, see <http://www.gnu.org/licenses/>.
 using namespace simplex;
 
 Progression::Progression(const std::string &name, const ProgPairs &pairs, ProgType interp):
-		ShapeBase(name), pairs(pairs), interp(interp) {
+		ShapeBase(name) {
+	setPairs(pairs, interp);
+}
+
+void Progression::setPairs(const ProgPairs &pairs, ProgType interp){
+	this->pairs = pairs;
+	this->interp = interp;
 	std::sort(this->pairs.begin(), this->pairs.end(),
 		[](const ProgPair &a, const ProgPair &b) {
 			return a.second < b.second;
 		}
 	);
+	buildTables();
 }
 
-size_t Progression::getInterval(double tVal, const std::vector<double> &times, bool &outside){
-	if (times.size() <= 1){
-		outside = true;
-		return 0;
+void Progression::buildTables(){
+	size_t count = pairs.size();
+	shapes.resize(count);
+	times.resize(count);
+	for (size_t i=0; i<count; ++i){
+		shapes[i] = pairs[i].first;
+		times[i] = pairs[i].second;
 	}
-	outside = tVal < times[0] || tVal > times[times.size() - 1];
-	if (tVal >= times[times.size() - 2]){
-		return times.size() - 2;
+
+	if (interp == ProgType::splitSpline){
+		// The pairs are sorted by time, so each side of zero
+		// is a contiguous run that includes the zero pair
+		size_t zeroStart = 0, zeroEnd = 0;
+		while (zeroStart < count && times[zeroStart] < 0) ++zeroStart;
+		zeroEnd = zeroStart;
+		while (zeroEnd < count && times[zeroEnd] <= 0) ++zeroEnd;
+		negSpan = makeSpan(0, zeroEnd);
+		posSpan = makeSpan(zeroStart, count - zeroStart);
 	}
-	else if (tVal < times[0]){
-		return 0;
-	}
-	else{
-		// the percent for the current segment of tVal
-		// and the corresponding basis values
-		for (size_t i=0; i<times.size()-2; ++i){
-			if (times[i] <= tVal && tVal < times[i+1]){
-				return i;
-			}
-		}
-		return 0;
+	else {
+		negSpan = makeSpan(0, count);
+		posSpan = negSpan;
 	}
 }
 
-ProgPairs Progression::getSplineOutput(double tVal, double mul) const{
-	std::vector<const ProgPair* > sided;
-	for (size_t i = 0; i < pairs.size(); ++i) {
-		sided.push_back(&(pairs[i]));
+Progression::Span Progression::makeSpan(size_t first, size_t count) const {
+	Span span;
+	span.first = first;
+	span.count = count;
+	if (count < 3) return span;
+
+	// Only the breakpoints that getInterval searches matter here
+	const double *t = times.data() + first;
+	double step = (t[count - 2] - t[0]) / double(count - 2);
+	if (!(step > 0.0)) return span;
+	for (size_t i=1; i<count-1; ++i){
+		if (fabs((t[i] - t[i-1]) - step) > step * 1.0e-6) return span;
 	}
-	return getRawSplineOutput(sided, tVal, mul);
+	span.uniform = true;
+	span.invStep = 1.0 / step;
+	return span;
 }
 
-ProgPairs Progression::getSplitSplineOutput(double tVal, double mul) const{
-	std::vector<const ProgPair* > sided;
-	bool gt = tVal >= 0.0;
-	for (size_t i = 0; i < pairs.size(); ++i) {
-		if (gt && pairs[i].second >= 0)
-			sided.push_back(&(pairs[i]));
-		else if (!gt && pairs[i].second <= 0)
-			sided.push_back(&(pairs[i]));
+size_t Progression::getInterval(double tVal, const double *times, size_t count, const Span &span, bool &outside){
+	if (count <= 1){
+		outside = true;
+		return 0;
+	}
+	outside = tVal < times[0] || tVal > times[count - 1];
+	if (tVal >= times[count - 2]){
+		return count - 2;
+	}
+	else if (!(tVal >= times[0])){
+		return 0;
 	}
-	return getRawSplineOutput(sided, tVal, mul);
-}
 
-ProgPairs Progression::getLinearOutput(double tVal, double mul) const{
-	std::vector<const ProgPair* > sided;
-	for (size_t i = 0; i < pairs.size(); ++i) {
-		sided.push_back(&(pairs[i]));
+	// Find the segment where times[i] <= tVal < times[i+1]
+	// With even spacing the direct guess can only be off by
+	// floating point error, so nudge it onto the right segment
+	if (span.uniform){
+		size_t i = size_t((tVal - times[0]) * span.invStep);
+		if (i > count - 3) i = count - 3;
+		while (i > 0 && tVal < times[i]) --i;
+		while (i < count - 3 && tVal >= times[i + 1]) ++i;
+		return i;
 	}
-	return getRawLinearOutput(sided, tVal, mul);
+	const double *it = std::upper_bound(times, times + count - 2, tVal);
+	return size_t(it - times) - 1;
 }
 
-ProgPairs Progression::getRawSplineOutput(const std::vector<const std::pair<Shape*, double>* > pairs, double tVal, double mul){
+void Progression::getRawSplineOutput(const size_t *shapes, const double *times, size_t count, const Span &span, double tVal, double mul, ProgOutput &out){
 	if (
-		(pairs.size() <= 2) ||
-		((tVal < pairs[0]->second) && (tVal > pairs[pairs.size()-1]->second))
+		(count <= 2) ||
+		((tVal < times[0]) && (tVal > times[count-1]))
 	){
-		return getRawLinearOutput(pairs, tVal, mul);
+		getRawLinearOutput(shapes, times, count, span, tVal, mul, out);
+		return;
 	}
 
-	std::vector<Shape*> shapes;
-	std::vector<double> st;
-	for (auto it = pairs.begin(); it != pairs.end(); ++it){
-		shapes.push_back((*it)->first);
-		st.push_back((*it)->second);
-	}
 	bool outside = false;
-	size_t interval = getInterval(tVal, st, outside);
-	ProgPairs out;
+	size_t interval = getInterval(tVal, times, count, span, outside);
 
-	double start = st[interval];
-	double end = st[interval + 1];
+	double start = times[interval];
+	double end = times[interval + 1];
 
 	//# compute the catmull-rom basis multipliers
 	double x = (tVal - start) / (end - start);
 	if (outside) {
 		// If I'm outside the range of the spline, then I linear interpolate along the implicit tangent
 		if (interval == 0) {
-			out.push_back(std::make_pair(shapes[0], mul * (1.0 - x)));
-			out.push_back(std::make_pair(shapes[1], mul * x));
+			out.push(shapes[0], mul * (1.0 - x));
+			out.push(shapes[1], mul * x);
 		}
 		else {
-			out.push_back(std::make_pair(shapes[shapes.size() - 1], mul * x));
-			out.push_back(std::make_pair(shapes[shapes.size() - 2], mul * (1.0 - x)));
+			out.push(shapes[count - 1], mul * x);
+			out.push(shapes[count - 2], mul * (1.0 - x));
 		}
 	}
 	else{
@@ -133,48 +153,126 @@ ProgPairs Progression::getRawSplineOutput(const std::vector<const std::pair<Shap
 		double v2 = (-1.5*x3 + 2.0*x2 + 0.5*x);
 		double v3 = (0.5*x3 - 0.5*x2);
 		if (interval == 0) { // deal with input tangent
-			out.push_back(std::make_pair(shapes[0], mul * (v1 + v0 + v0)));
-			out.push_back(std::make_pair(shapes[1], mul * (v2 - v0)));
-			out.push_back(std::make_pair(shapes[2], mul * (v3)));
+			out.push(shapes[0], mul * (v1 + v0 + v0));
+			out.push(shapes[1], mul * (v2 - v0));
+			out.push(shapes[2], mul * (v3));
 		}
-		else if (interval == st.size() - 2) { // deal with output tangent
-			out.push_back(std::make_pair(shapes[shapes.size() - 3], mul * (v0)));
-			out.push_back(std::make_pair(shapes[shapes.size() - 2], mul * (v1 - v3)));
-			out.push_back(std::make_pair(shapes[shapes.size() - 1], mul * (v2 + v3 + v3)));
+		else if (interval == count - 2) { // deal with output tangent
+			out.push(shapes[count - 3], mul * (v0));
+			out.push(shapes[count - 2], mul * (v1 - v3));
+			out.push(shapes[count - 1], mul * (v2 + v3 + v3));
 		}
 		else {
-			out.push_back(std::make_pair(shapes[interval - 1], mul * v0));
-			out.push_back(std::make_pair(shapes[interval + 0], mul * v1));
-			out.push_back(std::make_pair(shapes[interval + 1], mul * v2));
-			out.push_back(std::make_pair(shapes[interval + 2], mul * v3));
+			out.push(shapes[interval - 1], mul * v0);
+			out.push(shapes[interval + 0], mul * v1);
+			out.push(shapes[interval + 1], mul * v2);
+			out.push(shapes[interval + 2], mul * v3);
 		}
 	}
-	return out;
 }
 
-ProgPairs Progression::getRawLinearOutput(const std::vector<const std::pair<Shape*, double>* > pairs, double tVal, double mul){
-	ProgPairs out;
-	std::vector<double> times;
-	if (pairs.size() < 2) return out;
+void Progression::getRawLinearOutput(const size_t *shapes, const double *times, size_t count, const Span &span, double tVal, double mul, ProgOutput &out){
+	if (count < 2) return;
 
-	for (auto it=pairs.begin(); it!=pairs.end(); ++it){
-		times.push_back((*it)->second);
-	}
 	bool outside;
-	size_t idx = getInterval(tVal, times, outside);
+	size_t idx = getInterval(tVal, times, count, span, outside);
 	double u = (tVal - times[idx]) / (times[idx+1] - times[idx]);
-    out.push_back(std::make_pair(pairs[idx]->first, mul * (1.0-u)));
-	out.push_back(std::make_pair(pairs[idx+1]->first, mul * u));
-	return out;
+	out.push(shapes[idx], mul * (1.0-u));
+	out.push(shapes[idx+1], mul * u);
+}
+
+void Progression::getRawSplineDerivative(const size_t *shapes, const double *times, size_t count, const Span &span, double tVal, double mul, ProgOutput &out){
+	if (
+		(count <= 2) ||
+		((tVal < times[0]) && (tVal > times[count-1]))
+	){
+		getRawLinearDerivative(shapes, times, count, span, tVal, mul, out);
+		return;
+	}
+
+	bool outside = false;
+	size_t interval = getInterval(tVal, times, count, span, outside);
+
+	double start = times[interval];
+	double end = times[interval + 1];
+
+	// The same cases as getRawSplineOutput, with each basis
+	// differentiated, and scaled by dx/dtVal
+	double x = (tVal - start) / (end - start);
+	double dx = mul / (end - start);
+	if (outside) {
+		if (interval == 0) {
+			out.push(shapes[0], -dx);
+			out.push(shapes[1], dx);
+		}
+		else {
+			out.push(shapes[count - 1], dx);
+			out.push(shapes[count - 2], -dx);
+		}
+	}
+	else{
+		double x2 = x*x;
+		double d0 = (-1.5*x2 + 2.0*x - 0.5);
+		double d1 = (4.5*x2 - 5.0*x);
+		double d2 = (-4.5*x2 + 4.0*x + 0.5);
+		double d3 = (1.5*x2 - 1.0*x);
+		if (interval == 0) {
+			out.push(shapes[0], dx * (d1 + d0 + d0));
+			out.push(shapes[1], dx * (d2 - d0));
+			out.push(shapes[2], dx * (d3));
+		}
+		else if (interval == count - 2) {
+			out.push(shapes[count - 3], dx * (d0));
+			out.push(shapes[count - 2], dx * (d1 - d3));
+			out.push(shapes[count - 1], dx * (d2 + d3 + d3));
+		}
+		else {
+			out.push(shapes[interval - 1], dx * d0);
+			out.push(shapes[interval + 0], dx * d1);
+			out.push(shapes[interval + 1], dx * d2);
+			out.push(shapes[interval + 2], dx * d3);
+		}
+	}
+}
+
+void Progression::getRawLinearDerivative(const size_t *shapes, const double *times, size_t count, const Span &span, double tVal, double mul, ProgOutput &out){
+	if (count < 2) return;
+
+	bool outside;
+	size_t idx = getInterval(tVal, times, count, span, outside);
+	double du = mul / (times[idx+1] - times[idx]);
+	out.push(shapes[idx], -du);
+	out.push(shapes[idx+1], du);
 }
 
 ProgPairs Progression::getOutput(double tVal, double mul) const{
-	if (interp == ProgType::spline)
-		return getSplineOutput(tVal, mul);
-	else if (interp == ProgType::splitSpline)
-		return getSplitSplineOutput(tVal, mul);
-	else // if (interp == ProgType::linear)
-		return getLinearOutput(tVal, mul);
+	ProgOutput buf;
+	getOutput(tVal, mul, buf);
+	return ProgPairs(buf.begin(), buf.end());
+}
+
+void Progression::getOutput(double tVal, double mul, ProgOutput &out) const{
+	out.clear();
+	const Span &span = (tVal >= 0.0) ? posSpan : negSpan;
+	const size_t *s = shapes.data() + span.first;
+	const double *t = times.data() + span.first;
+
+	if (interp == ProgType::linear)
+		getRawLinearOutput(s, t, span.count, span, tVal, mul, out);
+	else
+		getRawSplineOutput(s, t, span.count, span, tVal, mul, out);
+}
+
+void Progression::getDerivative(double tVal, double mul, ProgOutput &out) const{
+	out.clear();
+	const Span &span = (tVal >= 0.0) ? posSpan : negSpan;
+	const size_t *s = shapes.data() + span.first;
+	const double *t = times.data() + span.first;
+
+	if (interp == ProgType::linear)
+		getRawLinearDerivative(s, t, span.count, span, tVal, mul, out);
+	else
+		getRawSplineDerivative(s, t, span.count, span, tVal, mul, out);
 }
 
 bool Progression::parseJSONv1(const rapidjson::Value &val, size_t index, Simplex *simp){
@@ -192,7 +290,7 @@ bool Progression::parseJSONv1(const rapidjson::Value &val, size_t index, Simplex
 		size_t x = (size_t)jindices[j].GetInt();
 		double y = (double)jweights[j].GetDouble();
 		if (x >= simp->shapes.size()) return false;
-		pairs.push_back(std::make_pair(&simp->shapes[x], y));
+		pairs.push_back(std::make_pair(x, y));
 	}
 
 	if (!val[0u].IsString()) return false;
@@ -240,7 +338,7 @@ bool Progression::parseJSONv2(const rapidjson::Value &val, size_t index, Simplex
 		double y = (double)ival[1].GetDouble();
 
 		if (x >= simp->shapes.size()) return false;
-		pairs.push_back(std::make_pair(&simp->shapes[x], y));
+		pairs.push_back(std::make_pair(x, y));
 	}
 	simp->progs.push_back(Progression(name, pairs, interp));
 	return true;
@@ -24,15 +24,36 @@ along with Simplex.  If not, see <http://www.gnu.org/licenses/>.
 
 using namespace simplex;
 
-void ShapeController::solve(std::vector<double> &accumulator, double &maxAct) const {
+template <typename T>
+void ShapeController::solve(const Progression &prog, double value, double multiplier, T *accumulator, double &maxAct, ProgOutput &scratch) const {
 	double vm = fabs(value * multiplier);
 	if (vm > maxAct) maxAct = vm;
 
-	ProgPairs shapeVals = prog->getOutput(value, multiplier);
-	for (auto sit=shapeVals.begin(); sit!=shapeVals.end(); ++sit){
+	prog.getOutput(value, multiplier, scratch);
+	for (auto sit=scratch.begin(); sit!=scratch.end(); ++sit){
 		//for (const auto &svp: shapeVals){
 		const auto &svp = *sit;
-		accumulator[svp.first->getIndex()] += svp.second;
+		accumulator[svp.first] += T(svp.second);
+	}
+}
+
+template void ShapeController::solve<float>(const Progression &, double, double, float *, double &, ProgOutput &) const;
+template void ShapeController::solve<double>(const Progression &, double, double, double *, double &, ProgOutput &) const;
+
+void ShapeController::solve(const Progression &prog, double value, double multiplier, double *accumulator, double &maxAct, ProgOutput &scratch,
+		size_t *stamps, size_t stamp, std::vector<size_t> &touched) const {
+	double vm = fabs(value * multiplier);
+	if (vm > maxAct) maxAct = vm;
+
+	prog.getOutput(value, multiplier, scratch);
+	for (auto sit=scratch.begin(); sit!=scratch.end(); ++sit){
+		size_t idx = sit->first;
+		if (stamps[idx] != stamp){
+			stamps[idx] = stamp;
+			accumulator[idx] = 0.0;
+			touched.push_back(idx);
+		}
+		accumulator[idx] += sit->second;
 	}
 }
 
@@ -0,0 +1,133 @@
+/*
+Copyright 2016, Blur Studio
+
+This file is part of Simplex.
+
+Simplex is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Simplex is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Simplex.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "shapeDeltas.h"
+
+#include "Eigen/Dense"
+
+#include <algorithm> // for sort, min, max
+#include <numeric> // for iota
+
+using namespace simplex;
+
+namespace {
+// Runs separated by this many untouched points or fewer are joined,
+// padding the gap with zeros. Longer runs vectorize better, and a
+// few extra zero adds cost less than starting another run
+const uint32_t maxRunGap = 4;
+} // namespace
+
+void ShapeDeltas::clear(){
+	shapeRuns.clear();
+	runs.clear();
+	deltas.clear();
+	points = 0;
+}
+
+bool ShapeDeltas::addShape(size_t shape, const uint32_t *indices, const float *xyz, size_t count){
+	if (shapeRuns.empty())
+		shapeRuns.push_back(0);
+	if (shape < shapeCount())
+		return false;
+	while (shapeCount() < shape)
+		shapeRuns.push_back(runs.size());
+
+	// Sort by point index, keeping the input order for repeated indices
+	std::vector<size_t> order(count);
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), [indices](size_t a, size_t b){ return indices[a] < indices[b]; });
+
+	for (size_t i = 0; i < count; ++i){
+		size_t src = order[i];
+		if (i + 1 < count && indices[order[i + 1]] == indices[src])
+			continue; // the last repeat wins
+		uint32_t idx = indices[src];
+
+		bool extend = false;
+		if (runs.size() > shapeRuns.back()){
+			Run &run = runs.back();
+			uint32_t runEnd = run.start + run.length;
+			if (idx - runEnd <= maxRunGap){
+				// Pad any gap with zeros, and append to the current run
+				deltas.resize(deltas.size() + 3 * (idx - runEnd), 0.0f);
+				run.length = idx + 1 - run.start;
+				extend = true;
+			}
+		}
+		if (!extend){
+			Run run;
+			run.start = idx;
+			run.length = 1;
+			run.offset = (uint32_t)(deltas.size() / 3);
+			runs.push_back(run);
+		}
+		deltas.push_back(xyz[3 * src]);
+		deltas.push_back(xyz[3 * src + 1]);
+		deltas.push_back(xyz[3 * src + 2]);
+		points = std::max(points, (size_t)idx + 1);
+	}
+	shapeRuns.push_back(runs.size());
+	return true;
+}
+
+void ShapeDeltas::accumulate(const double *weights, size_t weightCount, float scale, float *accum) const {
+	accumulate(weights, weightCount, scale, accum, 0, points);
+}
+
+void ShapeDeltas::accumulate(const double *weights, size_t weightCount, float scale, float *accum, size_t begin, size_t end) const {
+	size_t count = std::min(weightCount, shapeCount());
+	for (size_t s = 1; s < count; ++s){
+		float w = scale * (float)weights[s];
+		if (w == 0.0f) continue;
+		accumulateShape(s, w, accum, begin, end);
+	}
+}
+
+void ShapeDeltas::accumulate(const SparseWeights &weights, float scale, float *accum) const {
+	accumulate(weights, scale, accum, 0, points);
+}
+
+void ShapeDeltas::accumulate(const SparseWeights &weights, float scale, float *accum, size_t begin, size_t end) const {
+	size_t count = shapeCount();
+	for (size_t i = 0; i < weights.size(); ++i){
+		size_t s = weights.indices[i];
+		if (s == 0) continue;
+		if (s >= count) break; // the indices are sorted
+		float w = scale * (float)weights.weights[i];
+		if (w == 0.0f) continue;
+		accumulateShape(s, w, accum, begin, end);
+	}
+}
+
+void ShapeDeltas::accumulateShape(size_t shape, float w, float *accum, size_t begin, size_t end) const {
+	typedef Eigen::Map<Eigen::ArrayXf> FloatMap;
+	typedef Eigen::Map<const Eigen::ArrayXf> ConstFloatMap;
+
+	// Runs are sorted, so skip straight to the first that reaches begin
+	auto first = runs.begin() + shapeRuns[shape];
+	auto last = runs.begin() + shapeRuns[shape + 1];
+	first = std::upper_bound(first, last, begin, [](size_t b, const Run &run){ return b < run.start + run.length; });
+	for (auto rit = first; rit != last && rit->start < end; ++rit){
+		size_t start = std::max((size_t)rit->start, begin);
+		size_t stop = std::min((size_t)rit->start + rit->length, end);
+		size_t skip = start - rit->start;
+		FloatMap dst(accum + 3 * start, 3 * (stop - start));
+		dst += w * ConstFloatMap(deltas.data() + 3 * (rit->offset + skip), 3 * (stop - start));
+	}
+}
@@ -18,97 +18,570 @@ along with Simplex.  If not, see <http://www.gnu.org/licenses/>.
 */
 #include "utils.h"
 #include "simplex.h"
+#include "simplexBinary.h"
+#include "simplexReader.h"
+#include "mappedFile.h"
+
+#include "math.h"
 
-#include "rapidjson/error/en.h"
 #include "rapidjson/rapidjson.h"
 
+#include <algorithm> // for copy, fill, sort
+#include <atomic>
+#include <cstring> // for strlen
+#include <thread>
+#include <type_traits>
+#include <vector>
+
 using namespace simplex;
 
-void Simplex::clearValues(){
-	for (auto xit = sliders.begin(); xit != sliders.end(); ++xit) { xit->clearValue(); }
-	for (auto xit = combos.begin(); xit != combos.end(); ++xit) { xit->clearValue(); }
-	for (auto xit = floaters.begin(); xit != floaters.end(); ++xit) { xit->clearValue(); }
-	for (auto xit = traversals.begin(); xit != traversals.end(); ++xit) { xit->clearValue(); }
+namespace {
+std::atomic<size_t> nextBuildId(1);
 
-	//for (auto &x : sliders) x.clearValue();
-	//for (auto &x : combos) x.clearValue();
-	//for (auto &x : floaters) x.clearValue();
-	//for (auto &x : traversals) x.clearValue();
+// The slider values are masked when at most 1 / maskRatio of them are non-zero
+const size_t maskRatio = 2;
+} // namespace
+
+void Simplex::clearValues(){
+	state.clearValues();
 }
 
 void Simplex::setExactSolve(bool exact){
+	exactSolve = exact;
 	for (auto xit = combos.begin(); xit != combos.end(); ++xit) { xit->setExact(exact); }
 	//for (auto &x : combos) x.setExact(exact);
 }
 
 std::vector<double> Simplex::solve(const std::vector<double> &vec){
-	// The solver should simply follow this pattern:
-	// Ask each top level thing to store its value
-	// Ask each shape controller for its contribution to the output
-	std::vector<double> posVec, clamped, output;
-	std::vector<bool> inverses;
-	rectify(vec, posVec, clamped, inverses);
+	std::vector<double> output(shapes.size());
+	solve(vec.data(), vec.size(), output.data());
+	return output;
+}
+
+void Simplex::solve(const double *in, size_t n, double *out){
+	if (!built)
+		build();
+	solve(state, in, n, out);
+}
+
+void Simplex::solveSparse(const double *in, size_t n, SparseWeights &out){
+	if (!built)
+		build();
+	solveSparse(state, in, n, out);
+}
+
+void Simplex::solveIncremental(const double *in, size_t n, double *out){
+	if (!built)
+		build();
+	solveIncremental(state, in, n, out);
+}
+
+void Simplex::solveBatch(const double *in, size_t frames, size_t n, double *out){
+	if (!built)
+		build();
+	solveBatch(state, in, frames, n, out);
+}
+
+void Simplex::solveBatch(const double *in, size_t frames, double *out){
+	solveBatch(in, frames, sliders.size(), out);
+}
+
+void Simplex::prepareState(SolverState &state) const {
+	// Combos and traversals share the scratch rows
+	size_t scratchRows = std::max(plan.maxComboRows, plan.maxTraversalRows);
+	state.resize(sliders.size(), plan.outputs.size(), shapes.size(), spaces.size(), scratchRows,
+			plan.comboRows.size(), traversals.size());
+	state.buildId = buildId;
+}
 
+SolveProfile Simplex::getProfile() const {
+	SolveProfile out = buildProfile;
+	out.merge(state.profile);
+	return out;
+}
+
+void Simplex::clearProfile(){
+	buildProfile.clear();
+	state.profile.clear();
+}
 
+void Simplex::solve(SolverState &state, const double *in, size_t n, double *out) const {
+	solve(state, in, n, out, exactSolve);
+}
+
+template <typename T>
+bool Simplex::storeValues(SolverState &state, const T *in, size_t n, bool exact) const {
+	if (!built)
+		return false;
+
+	if (state.buildId != buildId)
+		prepareState(state);
+
+	size_t count = (n < sliders.size()) ? n : sliders.size();
+	std::copy(in, in + count, state.values.begin());
+	std::fill(state.values.begin() + count, state.values.end(), 0.0);
+	SIMPLEX_PROFILE_START();
+	rectify(state.values, state.posValues, state.clamped, state.inverses);
+	SIMPLEX_PROFILE_PHASE(state.profile, rectify);
+
+	// Values are only written on a successful solve, so start clean
+	state.clearValues();
 	for (auto xit = sliders.begin(); xit != sliders.end(); ++xit){
-		xit->storeValue(vec, posVec, clamped, inverses);
+		xit->storeValue(state);
+	}
+	SIMPLEX_PROFILE_PHASE(state.profile, sliders);
+
+	// Only mask when most sliders are at zero. Otherwise nearly everything
+	// is active, and solving whole tables at once is faster
+	size_t live = 0;
+	for (size_t i = 0; i < sliders.size(); ++i){
+		if (!isCleanZero(state.ctrlValues[i])) ++live;
 	}
-	for (auto xit = combos.begin(); xit != combos.end(); ++xit){
-		xit->storeValue(vec, posVec, clamped, inverses);
+	state.masked = live * maskRatio <= sliders.size();
+	if (state.masked){
+		storeActiveValues(state, exact);
+		return true;
 	}
+
+	for (auto tit = plan.comboTables.begin(); tit != plan.comboTables.end(); ++tit){
+		tit->solve(state.ctrlValues.data(), exact, state.comboScratch);
+	}
+	SIMPLEX_PROFILE_PHASE(state.profile, combos);
 	for (auto xit = spaces.begin(); xit != spaces.end(); ++xit){
-		xit->storeValue(vec, posVec, clamped, inverses);
-	}
-	for (auto xit = traversals.begin(); xit != traversals.end(); ++xit){
-		xit->storeValue(vec, posVec, clamped, inverses);
-	}
-
-	/*
-	for (auto &x : sliders)
-		x.storeValue(vec, posVec, clamped, inverses);
-	for (auto &x : combos)
-		x.storeValue(vec, posVec, clamped, inverses);
-	for (auto &x : spaces)
-		x.storeValue(vec, posVec, clamped, inverses);
-	for (auto &x : traversals)
-		x.storeValue(vec, posVec, clamped, inverses);
-	*/
-	
-	output.resize(shapes.size());
+		xit->storeValue(state);
+	}
+	SIMPLEX_PROFILE_PHASE(state.profile, spaces);
+	for (auto tit = plan.traversalTables.begin(); tit != plan.traversalTables.end(); ++tit){
+		tit->solve(state.ctrlValues.data(), state.ctrlMultipliers.data(), state.comboScratch);
+	}
+	SIMPLEX_PROFILE_PHASE(state.profile, traversals);
+	SIMPLEX_PROFILE_COUNT(state.profile, solves, 1);
+	return true;
+}
+
+void Simplex::solve(SolverState &state, const double *in, size_t n, double *out, bool exact) const {
+	if (built && results.enabled()){
+		solveCached(state, in, n, out, exact, false);
+		return;
+	}
+	solveDense(state, in, n, out, exact);
+}
+
+void Simplex::solveCached(SolverState &state, const double *in, size_t n, double *out, bool exact, bool incremental) const {
+	results.makeKey(buildId, in, n, sliders.size(), exact, state.cacheKey, state.cacheInput);
+	if (results.find(state.cacheKey, out, shapes.size())){
+		// The state doesn't hold the solve of this input, so it can't be built on
+		state.hasPrevious = false;
+		return;
+	}
+	// Solve the snapped input, so a result doesn't depend on which pose was cached first
+	if (incremental)
+		updateIncremental(state, state.cacheInput.data(), sliders.size(), out, exact);
+	else
+		solveDense(state, state.cacheInput.data(), sliders.size(), out, exact);
+	results.store(state.cacheKey, out, shapes.size());
+}
+
+void Simplex::storeActiveValues(SolverState &state, bool exact) const {
+	// A combo or traversal multiplier only has a value when every slider in
+	// its state is on the same side of zero as its target, so count how
+	// many are and only solve the rows where they all are. A slider at
+	// exactly zero matches no targets: with a positive target it would
+	// give a zero value, which is what the cleared value already is.
+	// Values from -EPS to zero, -0.0 and NaN don't solve to a clean zero,
+	// so the rows reading those are always solved, just like a full solve
+	SIMPLEX_PROFILE_START();
+	size_t stamp = ++state.stamp;
+	HitCounter &combos = state.maskCombos;
+	HitCounter &travs = state.maskTraversals;
+	HitCounter &spaceHits = state.maskSpaces;
+	combos.active.clear();
+	travs.active.clear();
+	spaceHits.active.clear();
+	state.activeSlots.clear();
+
+	auto comboArity = [&](size_t c){ return plan.comboTables[plan.comboRows[c].first].arity; };
+	auto multArity = [&](size_t t){ return plan.traversalTables[plan.traversalRows[t].first].multArity; };
+	for (size_t i = 0; i < sliders.size(); ++i){
+		double val = state.ctrlValues[i];
+		if (isCleanZero(val)) continue;
+		state.activeSlots.push_back(i);
+		if (val > 0.0 || val <= -EPS){
+			size_t key = 2 * i + ((val > 0.0) ? 0 : 1);
+			for (const size_t *cit = plan.comboReaders.begin(key); cit != plan.comboReaders.end(key); ++cit)
+				combos.hit(*cit, stamp, comboArity(*cit));
+			for (const size_t *tit = plan.traversalReaders.begin(key); tit != plan.traversalReaders.end(key); ++tit)
+				travs.hit(*tit, stamp, multArity(*tit));
+		}
+		else {
+			for (size_t key = 2 * i; key < 2 * i + 2; ++key){
+				for (const size_t *cit = plan.comboReaders.begin(key); cit != plan.comboReaders.end(key); ++cit)
+					combos.force(*cit, stamp);
+				for (const size_t *tit = plan.traversalReaders.begin(key); tit != plan.traversalReaders.end(key); ++tit)
+					travs.force(*tit, stamp);
+			}
+		}
+		// A space only solves when none of its sliders are zero
+		if (!isZero(state.clamped[i])){
+			for (const size_t *sit = plan.sliderSpaces.begin(i); sit != plan.sliderSpaces.end(i); ++sit)
+				spaceHits.hit(*sit, stamp, spaces[*sit].getFloaters()[0]->stateList.size());
+		}
+	}
+	for (auto cit = plan.forcedComboRows.begin(); cit != plan.forcedComboRows.end(); ++cit)
+		combos.force(*cit, stamp);
+	for (auto tit = plan.forcedTraversals.begin(); tit != plan.forcedTraversals.end(); ++tit)
+		travs.force(*tit, stamp);
+
+	std::vector<double> &ctrlValues = state.ctrlValues;
+	for (auto cit = combos.active.begin(); cit != combos.active.end(); ++cit){
+		const ComboTable &table = plan.comboTables[plan.comboRows[*cit].first];
+		size_t row = plan.comboRows[*cit].second;
+		table.solveRow(row, ctrlValues.data(), exact);
+		size_t slot = table.rows[row];
+		if (ctrlValues[slot] != 0.0) state.activeSlots.push_back(slot);
+	}
+	SIMPLEX_PROFILE_PHASE(state.profile, combos);
+	for (auto sit = spaceHits.active.begin(); sit != spaceHits.active.end(); ++sit){
+		spaces[*sit].storeValue(state);
+		const std::vector<Floater*> &spaceFloaters = spaces[*sit].getFloaters();
+		for (auto fit = spaceFloaters.begin(); fit != spaceFloaters.end(); ++fit){
+			size_t slot = (*fit)->getSlot();
+			if (ctrlValues[slot] != 0.0) state.activeSlots.push_back(slot);
+		}
+	}
+	SIMPLEX_PROFILE_PHASE(state.profile, spaces);
+	for (auto tit = travs.active.begin(); tit != travs.active.end(); ++tit){
+		const std::pair<size_t, size_t> &loc = plan.traversalRows[*tit];
+		const TraversalTable &table = plan.traversalTables[loc.first];
+		table.solveRow(loc.second, ctrlValues.data(), state.ctrlMultipliers.data(), state.comboScratch);
+		// A zero multiplier zeroes every weight the traversal gives
+		size_t slot = table.rows[loc.second];
+		if (ctrlValues[slot] != 0.0 && state.ctrlMultipliers[slot] != 0.0) state.activeSlots.push_back(slot);
+	}
+	SIMPLEX_PROFILE_PHASE(state.profile, traversals);
+
+	// Keep the accumulation in slot order, so the sums match a full solve
+	state.activeSlots.insert(state.activeSlots.end(), plan.activeAtZero.begin(), plan.activeAtZero.end());
+	std::sort(state.activeSlots.begin(), state.activeSlots.end());
+	state.activeSlots.erase(std::unique(state.activeSlots.begin(), state.activeSlots.end()), state.activeSlots.end());
+	SIMPLEX_PROFILE_COUNT(state.profile, solves, 1);
+}
+
+void Simplex::solve(const float *in, size_t n, float *out){
+	if (!built)
+		build();
+	solve(state, in, n, out);
+}
+
+void Simplex::solveBatch(const float *in, size_t frames, size_t n, float *out){
+	if (!built)
+		build();
+	solveBatch(state, in, frames, n, out);
+}
+
+void Simplex::solve(SolverState &state, const float *in, size_t n, float *out) const {
+	solve(state, in, n, out, exactSolve);
+}
+
+void Simplex::solve(SolverState &state, const float *in, size_t n, float *out, bool exact) const {
+	solveDense(state, in, n, out, exact);
+}
+
+void Simplex::solveBatch(SolverState &state, const float *in, size_t frames, size_t n, float *out) const {
+	solveBatch(state, in, frames, n, out, exactSolve);
+}
+
+void Simplex::solveBatch(SolverState &state, const float *in, size_t frames, size_t n, float *out, bool exact) const {
+	size_t outLen = shapes.size();
+	for (size_t f = 0; f < frames; ++f){
+		solve(state, in + f * n, n, out + f * outLen, exact);
+	}
+}
+
+template <typename T>
+void Simplex::solveDense(SolverState &state, const T *in, size_t n, T *out, bool exact) const {
+	// The solver should simply follow this pattern:
+	// Ask each top level thing to store its value
+	// Ask each shape controller for its contribution to the output
+	std::fill(out, out + shapes.size(), T(0.0));
+	if (!storeValues(state, in, n, exact))
+		return;
+
+	SIMPLEX_PROFILE_START();
 	double maxAct = 0.0;
+	if (state.masked){
+		for (auto sit = state.activeSlots.begin(); sit != state.activeSlots.end(); ++sit){
+			size_t i = *sit;
+			plan.outputs[i]->solve(*plan.outputProgs[i], state.ctrlValues[i], state.ctrlMultipliers[i], out, maxAct, state.progScratch);
+		}
+	}
+	else {
+		for (size_t i = 0; i < plan.outputs.size(); ++i){
+			plan.outputs[i]->solve(*plan.outputProgs[i], state.ctrlValues[i], state.ctrlMultipliers[i], out, maxAct, state.progScratch);
+		}
+	}
+	SIMPLEX_PROFILE_PHASE(state.profile, shapes);
+
+	// set the rest value properly
+	if (!shapes.empty())
+		out[0] = T(1.0 - maxAct);
+
+	// solveIncremental only builds on double weights
+	state.hasPrevious = std::is_same<T, double>::value;
+	state.previousExact = exact;
+}
 
-	for (auto xit = sliders.begin(); xit != sliders.end(); ++xit)
-		xit->solve(output, maxAct);
-	for (auto xit = combos.begin(); xit != combos.end(); ++xit)
-		xit->solve(output, maxAct);
-	for (auto xit = floaters.begin(); xit != floaters.end(); ++xit)
-		xit->solve(output, maxAct);
-	for (auto xit = traversals.begin(); xit != traversals.end(); ++xit)
-		xit->solve(output, maxAct);
-
-	/*
-	for (auto &x : sliders)
-		x.solve(output, maxAct);
-	for (auto &x : combos)
-		x.solve(output, maxAct);
-	for (auto &x : floaters)
-		x.solve(output, maxAct);
-	for (auto &x : traversals)
-		x.solve(output, maxAct);
-	*/
+void Simplex::solveSparse(SolverState &state, const double *in, size_t n, SparseWeights &out) const {
+	solveSparse(state, in, n, out, exactSolve);
+}
+
+void Simplex::solveSparse(SolverState &state, const double *in, size_t n, SparseWeights &out, bool exact) const {
+	out.clear();
+	if (!storeValues(state, in, n, exact))
+		return;
+
+	// Only the shapes that a controller writes to get collected. They're
+	// accumulated in the same order as solve(), so the weights match exactly
+	SIMPLEX_PROFILE_START();
+	size_t stamp = ++state.stamp;
+	state.touchedShapes.clear();
+	double maxAct = 0.0;
+	size_t slotCount = state.masked ? state.activeSlots.size() : plan.outputs.size();
+	for (size_t k = 0; k < slotCount; ++k){
+		size_t i = state.masked ? state.activeSlots[k] : k;
+		plan.outputs[i]->solve(*plan.outputProgs[i], state.ctrlValues[i], state.ctrlMultipliers[i], state.sparseAccum.data(),
+				maxAct, state.progScratch, state.shapeStamp.data(), stamp, state.touchedShapes);
+	}
+	std::sort(state.touchedShapes.begin(), state.touchedShapes.end());
+	SIMPLEX_PROFILE_PHASE(state.profile, shapes);
 
 	// set the rest value properly
-	if (!output.empty())
-		output[0] = 1.0 - maxAct;
-	return output;
+	if (!shapes.empty() && maxAct != 1.0){
+		out.indices.push_back(0);
+		out.weights.push_back(1.0 - maxAct);
+	}
+	for (auto sit = state.touchedShapes.begin(); sit != state.touchedShapes.end(); ++sit){
+		// The rest shape is always overwritten, like it is in solve()
+		if (*sit == 0) continue;
+		double val = state.sparseAccum[*sit];
+		if (val == 0.0) continue;
+		out.indices.push_back(*sit);
+		out.weights.push_back(val);
+	}
+
+	// There's no dense output to update incrementally
+	state.hasPrevious = false;
+}
+
+void Simplex::solveIncremental(SolverState &state, const double *in, size_t n, double *out) const {
+	solveIncremental(state, in, n, out, exactSolve);
+}
+
+void Simplex::solveIncremental(SolverState &state, const double *in, size_t n, double *out, bool exact) const {
+	if (built && results.enabled()){
+		solveCached(state, in, n, out, exact, true);
+		return;
+	}
+	updateIncremental(state, in, n, out, exact);
+}
+
+void Simplex::updateIncremental(SolverState &state, const double *in, size_t n, double *out, bool exact) const {
+	if (!built || state.buildId != buildId || !state.hasPrevious || state.previousExact != exact){
+		solveDense(state, in, n, out, exact);
+		return;
+	}
+
+	SIMPLEX_PROFILE_START();
+	SIMPLEX_PROFILE_COUNT(state.profile, solves, 1);
+
+	// Find the sliders whose input changed
+	state.dirtySliders.clear();
+	size_t count = (n < sliders.size()) ? n : sliders.size();
+	for (size_t i = 0; i < sliders.size(); ++i){
+		double val = (i < count) ? in[i] : 0.0;
+		if (val == state.values[i]) continue;
+		state.values[i] = val;
+		state.dirtySliders.push_back(i);
+	}
+	if (state.dirtySliders.empty())
+		return;
+	rectify(state.values, state.posValues, state.clamped, state.inverses);
+	SIMPLEX_PROFILE_PHASE(state.profile, rectify);
+
+	size_t stamp = ++state.stamp;
+	std::vector<double> &ctrlValues = state.ctrlValues;
+	std::vector<double> &ctrlMuls = state.ctrlMultipliers;
+	state.dirtyCtrls.clear();
+	auto checkChanged = [&](size_t slot, double oldVal, double oldMul){
+		if (ctrlValues[slot] != oldVal || ctrlMuls[slot] != oldMul)
+			state.dirtyCtrls.push_back(slot);
+	};
+
+	// Re-solve everything that reads a changed slider, in the same order as solve()
+	// Values are only written on a successful solve, so each dependent
+	// is reset to its cleared value before it's re-solved
+	for (auto dit = state.dirtySliders.begin(); dit != state.dirtySliders.end(); ++dit){
+		double oldVal = ctrlValues[*dit];
+		sliders[*dit].storeValue(state);
+		checkChanged(*dit, oldVal, 1.0);
+	}
+	SIMPLEX_PROFILE_PHASE(state.profile, sliders);
+	for (auto dit = state.dirtySliders.begin(); dit != state.dirtySliders.end(); ++dit){
+		for (const size_t *rit = plan.sliderCombos.begin(*dit); rit != plan.sliderCombos.end(*dit); ++rit){
+			const ComboTable &table = plan.comboTables[plan.comboRows[*rit].first];
+			size_t row = plan.comboRows[*rit].second;
+			size_t slot = table.rows[row];
+			if (state.ctrlStamp[slot] == stamp) continue;
+			state.ctrlStamp[slot] = stamp;
+			double oldVal = ctrlValues[slot];
+			ctrlValues[slot] = 0.0;
+			table.solveRow(row, ctrlValues.data(), exact);
+			checkChanged(slot, oldVal, 1.0);
+		}
+	}
+	SIMPLEX_PROFILE_PHASE(state.profile, combos);
+	for (auto dit = state.dirtySliders.begin(); dit != state.dirtySliders.end(); ++dit){
+		for (const size_t *sit = plan.sliderSpaces.begin(*dit); sit != plan.sliderSpaces.end(*dit); ++sit){
+			if (state.spaceStamp[*sit] == stamp) continue;
+			state.spaceStamp[*sit] = stamp;
+			const std::vector<Floater*> &spaceFloaters = spaces[*sit].getFloaters();
+			state.floaterValues.clear();
+			for (auto fit = spaceFloaters.begin(); fit != spaceFloaters.end(); ++fit){
+				state.floaterValues.push_back(ctrlValues[(*fit)->getSlot()]);
+				ctrlValues[(*fit)->getSlot()] = 0.0;
+			}
+			spaces[*sit].storeValue(state);
+			for (size_t f = 0; f < spaceFloaters.size(); ++f){
+				checkChanged(spaceFloaters[f]->getSlot(), state.floaterValues[f], 1.0);
+			}
+		}
+	}
+	SIMPLEX_PROFILE_PHASE(state.profile, spaces);
+	for (auto dit = state.dirtySliders.begin(); dit != state.dirtySliders.end(); ++dit){
+		for (const size_t *tit = plan.sliderTraversals.begin(*dit); tit != plan.sliderTraversals.end(*dit); ++tit){
+			// Disabled traversals never change from their cleared value
+			const std::pair<size_t, size_t> &loc = plan.traversalRows[*tit];
+			if (loc.first == size_t(-1)) continue;
+			size_t slot = traversals[*tit].getSlot();
+			if (state.ctrlStamp[slot] == stamp) continue;
+			state.ctrlStamp[slot] = stamp;
+			double oldVal = ctrlValues[slot], oldMul = ctrlMuls[slot];
+			plan.traversalTables[loc.first].solveRow(loc.second, ctrlValues.data(), ctrlMuls.data(), state.comboScratch);
+			checkChanged(slot, oldVal, oldMul);
+		}
+	}
+	SIMPLEX_PROFILE_PHASE(state.profile, traversals);
+	if (state.dirtyCtrls.empty())
+		return;
+
+	// Every shape a changed controller can write to gets rebuilt from scratch
+	// The rest shape is skipped, because it's always overwritten below
+	state.dirtyShapes.clear();
+	for (auto cit = state.dirtyCtrls.begin(); cit != state.dirtyCtrls.end(); ++cit){
+		for (const size_t *sit = plan.ctrlShapes.begin(*cit); sit != plan.ctrlShapes.end(*cit); ++sit){
+			if (*sit == 0 || state.shapeStamp[*sit] == stamp) continue;
+			state.shapeStamp[*sit] = stamp;
+			state.dirtyShapes.push_back(*sit);
+			out[*sit] = 0.0;
+		}
+	}
+
+	// Re-accumulate those shapes from every controller that writes to them.
+	// Walking the controllers in slot order adds the terms in the same
+	// order as solve(), so the result matches a full solve exactly
+	state.touchedCtrls.clear();
+	for (auto sit = state.dirtyShapes.begin(); sit != state.dirtyShapes.end(); ++sit){
+		for (const size_t *cit = plan.shapeCtrls.begin(*sit); cit != plan.shapeCtrls.end(*sit); ++cit){
+			if (state.touchStamp[*cit] == stamp) continue;
+			state.touchStamp[*cit] = stamp;
+			state.touchedCtrls.push_back(*cit);
+		}
+	}
+	std::sort(state.touchedCtrls.begin(), state.touchedCtrls.end());
+	ProgOutput &pairs = state.progScratch;
+	for (auto cit = state.touchedCtrls.begin(); cit != state.touchedCtrls.end(); ++cit){
+		plan.outputProgs[*cit]->getOutput(ctrlValues[*cit], ctrlMuls[*cit], pairs);
+		for (auto pit = pairs.begin(); pit != pairs.end(); ++pit){
+			size_t shapeIdx = pit->first;
+			if (state.shapeStamp[shapeIdx] == stamp)
+				out[shapeIdx] += pit->second;
+		}
+	}
+
+	// The rest value needs the activation of every controller
+	double maxAct = 0.0;
+	for (size_t i = 0; i < plan.outputs.size(); ++i){
+		double act = fabs(ctrlValues[i] * ctrlMuls[i]);
+		if (act > maxAct) maxAct = act;
+	}
+	out[0] = 1.0 - maxAct;
+	SIMPLEX_PROFILE_PHASE(state.profile, shapes);
+}
+
+void Simplex::solveBatch(SolverState &state, const double *in, size_t frames, size_t n, double *out) const {
+	solveBatch(state, in, frames, n, out, exactSolve);
+}
+
+void Simplex::solveBatch(SolverState &state, const double *in, size_t frames, size_t n, double *out, bool exact) const {
+	size_t outLen = shapes.size();
+	for (size_t f = 0; f < frames; ++f){
+		solve(state, in + f * n, n, out + f * outLen, exact);
+	}
+}
+
+template <typename T>
+void Simplex::solveBatchThreads(const T *in, size_t frames, size_t n, T *out, size_t threadCount, bool exact) const {
+	if (threadCount == 0)
+		threadCount = std::thread::hardware_concurrency();
+	if (threadCount > frames)
+		threadCount = frames;
+	if (threadCount <= 1){
+		SolverState local;
+		solveBatch(local, in, frames, n, out, exact);
+		return;
+	}
+
+	// Give each thread one contiguous run of frames
+	size_t outLen = shapes.size();
+	size_t chunk = frames / threadCount;
+	size_t extra = frames % threadCount;
+	std::vector<std::thread> workers;
+	workers.reserve(threadCount);
+	size_t start = 0;
+	for (size_t t = 0; t < threadCount; ++t){
+		size_t count = chunk + ((t < extra) ? 1 : 0);
+		workers.push_back(std::thread([this, in, n, out, outLen, start, count, exact](){
+			SolverState local;
+			solveBatch(local, in + start * n, count, n, out + start * outLen, exact);
+		}));
+		start += count;
+	}
+	for (auto wit = workers.begin(); wit != workers.end(); ++wit)
+		wit->join();
+}
+
+void Simplex::solveBatchParallel(const double *in, size_t frames, size_t n, double *out, size_t threadCount) const {
+	solveBatchThreads(in, frames, n, out, threadCount, exactSolve);
 }
 
-Simplex::Simplex(const std::string &json){
+void Simplex::solveBatchParallel(const float *in, size_t frames, size_t n, float *out, size_t threadCount) const {
+	solveBatchThreads(in, frames, n, out, threadCount, exactSolve);
+}
+
+void Simplex::solveBatchParallel(const double *in, size_t frames, size_t n, double *out, size_t threadCount, bool exact) const {
+	solveBatchThreads(in, frames, n, out, threadCount, exact);
+}
+
+void Simplex::solveBatchParallel(const float *in, size_t frames, size_t n, float *out, size_t threadCount, bool exact) const {
+	solveBatchThreads(in, frames, n, out, threadCount, exact);
+}
+
+Simplex::Simplex(const std::string &json): Simplex() {
 	parseJSON(json);
 }
 
-Simplex::Simplex(const char *json){
-	parseJSON(std::string(json));
+Simplex::Simplex(const char *json): Simplex() {
+	parseJSON(json);
 }
 
 bool Simplex::parseJSONversion(const rapidjson::Document &d, unsigned version){
@@ -195,29 +668,20 @@ bool Simplex::parseJSONversion(const rapidjson::Document &d, unsigned version){
 }
 
 bool Simplex::parseJSON(const std::string &json){
-	// Make sure when getting the 0 index from a rapidjson Value
-	// always use rapidjson::SizeType, or 0u because the compiler
-	// can't decide between 0 and a null std::string
-	built = false;
-	
-	rapidjson::Document d;
-	d.Parse<0>(json.c_str());
+	return parseJSON(json.data(), json.size());
+}
 
-	hasParseError = false;
-	if (d.HasParseError()){
-		hasParseError = true;
-		parseError = std::string(rapidjson::GetParseError_En(d.GetParseError()));
-		parseErrorOffset = d.GetErrorOffset();
-		return false;
-	}
+bool Simplex::parseJSON(std::string_view json){
+	return parseJSON(json.data(), json.size());
+}
 
-	unsigned encoding = 1u;
-	if (d.HasMember("encodingVersion")){
-		const rapidjson::Value &ev = d["encodingVersion"];
-		if (!ev.IsUint()) return false;
-		encoding = ev.GetUint();
-	}
-	return parseJSONversion(d, encoding);
+bool Simplex::parseJSON(const char *json){
+	return parseJSON(json, strlen(json));
+}
+
+bool Simplex::parseJSON(const char *json, size_t length){
+	built = false;
+	return SimplexReader::read(*this, json, length);
 }
 
 void Simplex::clear() {
@@ -228,6 +692,7 @@ void Simplex::clear() {
 	floaters.clear();
 	spaces.clear();
 	traversals.clear();
+	plan.clear();
 
 	built = false;
 	loaded = false;
@@ -235,7 +700,73 @@ void Simplex::clear() {
 }
 
 void Simplex::build() {
+	SIMPLEX_PROFILE_START();
 	spaces = TriSpace::buildSpaces(floaters);
+	SIMPLEX_PROFILE_LAP(buildProfile.buildSpacesNanos);
+	plan.build(*this);
+	SIMPLEX_PROFILE_LAP(buildProfile.buildPlanNanos);
+	SIMPLEX_PROFILE_COUNT(buildProfile, builds, 1);
+	SIMPLEX_PROFILE_COUNT(buildProfile, builtSpaces, spaces.size());
+	for (auto xit = spaces.begin(); xit != spaces.end(); ++xit){
+		SIMPLEX_PROFILE_COUNT(buildProfile, builtSimplices, xit->simplexCount());
+	}
+	buildId = nextBuildId++;
 	built = true;
 }
 
+void Simplex::replan(bool floatersChanged) {
+	if (!built) return;
+	if (floatersChanged)
+		spaces = TriSpace::buildSpaces(floaters);
+	plan.build(*this);
+	// Any state sized for the old plan is stale now
+	buildId = nextBuildId++;
+}
+
+bool Simplex::parseBinary(const char *data, size_t size){
+	clear();
+	if (!SimplexBinary::read(*this, data, size)){
+		// Don't leave a partial solver behind, but keep the error
+		std::string err = parseError;
+		size_t offset = parseErrorOffset;
+		clear();
+		hasParseError = true;
+		parseError = err;
+		parseErrorOffset = offset;
+		return false;
+	}
+	plan.build(*this);
+	buildId = nextBuildId++;
+	built = true;
+	loaded = true;
+	return true;
+}
+
+bool Simplex::parseBinaryFile(const std::string &path){
+	MappedFile file;
+	if (!file.open(path)){
+		clear();
+		hasParseError = true;
+		parseError = "Unable to open " + path;
+		parseErrorOffset = 0;
+		return false;
+	}
+	return parseBinary(file.data(), file.size());
+}
+
+bool Simplex::toBinary(std::string &out){
+	if (!loaded)
+		return false;
+	if (!built)
+		build();
+	SimplexBinary::write(*this, out);
+	return true;
+}
+
+bool Simplex::toBinary(std::string &out) const {
+	if (!loaded || !built)
+		return false;
+	SimplexBinary::write(*this, out);
+	return true;
+}
+
@@ -0,0 +1,424 @@
+/*
+Copyright 2016, Blur Studio
+
+This file is part of Simplex.
+
+Simplex is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Simplex is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Simplex.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "simplex.h"
+#include "simplexBinary.h"
+
+#include <algorithm> // for sort
+#include <cstdint>
+#include <cstring> // for memcmp, memcpy
+#include <string>
+#include <vector>
+
+using namespace simplex;
+
+namespace {
+const char MAGIC[8] = {'S', 'M', 'P', 'X', 'B', 'I', 'N', '\0'};
+const uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+class BinaryWriter {
+	private:
+		std::string &out;
+	public:
+		explicit BinaryWriter(std::string &out): out(out) {}
+
+		template <typename T>
+		void put(T val){ out.append(reinterpret_cast<const char *>(&val), sizeof(T)); }
+		void putIndex(size_t idx){ put<uint64_t>(uint64_t(idx)); }
+		void putBool(bool val){ put<uint8_t>(val ? 1 : 0); }
+		void putString(const std::string &str){
+			put<uint32_t>(uint32_t(str.size()));
+			out.append(str);
+		}
+		void putDoubles(const std::vector<double> &vals){
+			putIndex(vals.size());
+			for (auto vit = vals.begin(); vit != vals.end(); ++vit) put<double>(*vit);
+		}
+		void putInts(const std::vector<int> &vals){
+			putIndex(vals.size());
+			for (auto vit = vals.begin(); vit != vals.end(); ++vit) put<int32_t>(int32_t(*vit));
+		}
+		void putPairs(const ComboPairs &pairs){
+			putIndex(pairs.size());
+			for (auto pit = pairs.begin(); pit != pairs.end(); ++pit){
+				putIndex(pit->first);
+				put<double>(pit->second);
+			}
+		}
+};
+
+class BinaryReader {
+	private:
+		const char *start;
+		const char *cur;
+		const char *end;
+	public:
+		bool ok;
+		std::string error;
+		size_t errorOffset;
+
+		BinaryReader(const char *data, size_t size): start(data), cur(data), end(data + size), ok(true), errorOffset(0) {}
+
+		void fail(const char *msg){
+			if (!ok) return;
+			ok = false;
+			error = msg;
+			errorOffset = size_t(cur - start);
+		}
+		size_t remaining() const { return size_t(end - cur); }
+
+		template <typename T>
+		T get(){
+			T val = T();
+			if (!ok) return val;
+			if (remaining() < sizeof(T)){
+				fail("Unexpected end of data");
+				return val;
+			}
+			memcpy(&val, cur, sizeof(T));
+			cur += sizeof(T);
+			return val;
+		}
+		bool getBool(){ return get<uint8_t>() != 0; }
+		size_t getIndex(size_t limit){
+			uint64_t val = get<uint64_t>();
+			if (ok && val >= limit){
+				fail("Index out of range");
+				return 0;
+			}
+			return size_t(val);
+		}
+		// Every item takes at least minBytes, so a corrupt count can't ask for a huge allocation
+		size_t getCount(size_t minBytes){
+			uint64_t val = get<uint64_t>();
+			if (ok && val > remaining() / minBytes){
+				fail("Count is larger than the data");
+				return 0;
+			}
+			return size_t(val);
+		}
+		std::string getString(){
+			uint32_t len = get<uint32_t>();
+			if (ok && len > remaining()) fail("Unexpected end of data");
+			if (!ok) return std::string();
+			std::string str(cur, len);
+			cur += len;
+			return str;
+		}
+		void getDoubles(std::vector<double> &out){
+			size_t count = getCount(sizeof(double));
+			out.resize(count);
+			for (size_t i=0; i<count; ++i) out[i] = get<double>();
+		}
+		void getInts(std::vector<int> &out){
+			size_t count = getCount(sizeof(int32_t));
+			out.resize(count);
+			for (size_t i=0; i<count; ++i) out[i] = int(get<int32_t>());
+		}
+		void getPairs(Simplex &simp, ComboPairs &out){
+			size_t count = getCount(sizeof(uint64_t) + sizeof(double));
+			out.clear();
+			for (size_t i=0; i<count && ok; ++i){
+				size_t sidx = getIndex(simp.sliders.size());
+				double val = get<double>();
+				if (ok) out.push_back(std::make_pair(sidx, val));
+			}
+		}
+		ComboSolve getSolveType(){
+			uint32_t val = get<uint32_t>();
+			if (ok && val > uint32_t(ComboSolve::None)) fail("Invalid solve type");
+			return ok ? ComboSolve(val) : ComboSolve::None;
+		}
+};
+} // namespace
+
+bool SimplexBinary::isBinary(const char *data, size_t size){
+	return size >= sizeof(MAGIC) && memcmp(data, MAGIC, sizeof(MAGIC)) == 0;
+}
+
+void SimplexBinary::write(const Simplex &simp, std::string &out){
+	out.clear();
+	BinaryWriter w(out);
+	out.append(MAGIC, sizeof(MAGIC));
+	w.put<uint32_t>(SIMPLEX_BINARY_VERSION);
+	w.put<uint32_t>(BYTE_ORDER_MARK);
+
+	w.putIndex(simp.shapes.size());
+	for (auto xit = simp.shapes.begin(); xit != simp.shapes.end(); ++xit){
+		w.putString(*xit->getName());
+	}
+
+	w.putIndex(simp.progs.size());
+	for (auto xit = simp.progs.begin(); xit != simp.progs.end(); ++xit){
+		w.putString(*xit->getName());
+		w.put<uint32_t>(uint32_t(xit->interp));
+		w.putIndex(xit->pairs.size());
+		for (auto pit = xit->pairs.begin(); pit != xit->pairs.end(); ++pit){
+			w.putIndex(pit->first);
+			w.put<double>(pit->second);
+		}
+	}
+
+	w.putIndex(simp.sliders.size());
+	for (auto xit = simp.sliders.begin(); xit != simp.sliders.end(); ++xit){
+		w.putString(*xit->getName());
+		w.putIndex(xit->prog);
+		w.putBool(xit->enabled);
+	}
+
+	w.putIndex(simp.combos.size());
+	for (auto xit = simp.combos.begin(); xit != simp.combos.end(); ++xit){
+		w.putString(*xit->getName());
+		w.putIndex(xit->prog);
+		w.putBool(xit->enabled);
+		w.putBool(xit->isFloater);
+		w.put<uint32_t>(uint32_t(xit->solveType));
+		w.putPairs(xit->stateList);
+	}
+
+	w.putIndex(simp.floaters.size());
+	for (auto xit = simp.floaters.begin(); xit != simp.floaters.end(); ++xit){
+		w.putString(*xit->getName());
+		w.putIndex(xit->prog);
+		w.putIndex(xit->getIndex());
+		w.putBool(xit->enabled);
+		w.putBool(xit->isFloater);
+		w.putPairs(xit->stateList);
+	}
+
+	w.putIndex(simp.traversals.size());
+	for (auto xit = simp.traversals.begin(); xit != simp.traversals.end(); ++xit){
+		w.putString(*xit->getName());
+		w.putIndex(xit->prog);
+		w.putBool(xit->enabled);
+		w.put<uint32_t>(uint32_t(xit->solveType));
+		w.putPairs(xit->progStartState);
+		w.putPairs(xit->progDeltaState);
+		w.putPairs(xit->multState);
+	}
+
+	const Floater *floaters = simp.floaters.data();
+	w.putIndex(simp.spaces.size());
+	for (auto xit = simp.spaces.begin(); xit != simp.spaces.end(); ++xit){
+		const TriSpace &space = *xit;
+		w.putIndex(space.floaters.size());
+		for (auto fit = space.floaters.begin(); fit != space.floaters.end(); ++fit){
+			w.putIndex(size_t(*fit - floaters));
+		}
+		w.putIndex(space.userPoints.size());
+		for (auto pit = space.userPoints.begin(); pit != space.userPoints.end(); ++pit){
+			w.putDoubles(*pit);
+		}
+		w.putIndex(space.overrideSimplices.size());
+		for (auto oit = space.overrideSimplices.begin(); oit != space.overrideSimplices.end(); ++oit){
+			w.putInts(*oit);
+		}
+
+		// Each user simplex is stored with its precomputed solve
+		// Sorting the keys keeps the output the same for the same solver
+		typedef std::pair<const std::vector<int>, std::vector<std::vector<int>>> MapEntry;
+		std::vector<const MapEntry*> entries;
+		for (auto mit = space.simplexMap.begin(); mit != space.simplexMap.end(); ++mit){
+			entries.push_back(&(*mit));
+		}
+		std::sort(entries.begin(), entries.end(), [](const MapEntry *a, const MapEntry *b){ return a->first < b->first; });
+
+		w.putIndex(entries.size());
+		for (auto eit = entries.begin(); eit != entries.end(); ++eit){
+			const MapEntry &entry = **eit;
+			const std::vector<BarySolve> &solves = space.barySolves.at(entry.first);
+			w.putInts(entry.first);
+			w.putIndex(entry.second.size());
+			for (size_t i=0; i<entry.second.size(); ++i){
+				w.putInts(entry.second[i]);
+				w.putInts(solves[i].floaterCorners);
+				w.putDoubles(solves[i].last);
+				w.putDoubles(solves[i].inverse);
+			}
+		}
+	}
+}
+
+bool SimplexBinary::read(Simplex &simp, const char *data, size_t size){
+	BinaryReader r(data, size);
+	if (!isBinary(data, size)){
+		r.fail("Not a simplex binary");
+	}
+	else {
+		r.get<uint64_t>(); // skip the magic number
+		if (r.get<uint32_t>() != SIMPLEX_BINARY_VERSION) r.fail("Unsupported binary version");
+		else if (r.get<uint32_t>() != BYTE_ORDER_MARK) r.fail("Mismatched byte order");
+	}
+
+	// The smallest possible record for each list, for sanity checking the counts
+	const size_t nameSize = sizeof(uint32_t);
+	const size_t indexSize = sizeof(uint64_t);
+
+	// Everything refers back to earlier lists by pointer, so each list
+	// is sized up front and never reallocates once it's been referenced
+	size_t count = r.getCount(nameSize);
+	simp.shapes.reserve(count);
+	for (size_t i=0; i<count && r.ok; ++i){
+		std::string name = r.getString();
+		simp.shapes.push_back(Shape(name, i));
+	}
+
+	count = r.getCount(nameSize + sizeof(uint32_t) + indexSize);
+	simp.progs.reserve(count);
+	for (size_t i=0; i<count && r.ok; ++i){
+		std::string name = r.getString();
+		uint32_t interp = r.get<uint32_t>();
+		if (r.ok && interp > uint32_t(ProgType::splitSpline)) r.fail("Invalid interpolation type");
+		size_t pairCount = r.getCount(indexSize + sizeof(double));
+		ProgPairs pairs;
+		for (size_t j=0; j<pairCount && r.ok; ++j){
+			size_t sidx = r.getIndex(simp.shapes.size());
+			double val = r.get<double>();
+			pairs.push_back(std::make_pair(sidx, val));
+		}
+		if (r.ok) simp.progs.push_back(Progression(name, pairs, ProgType(interp)));
+	}
+
+	count = r.getCount(nameSize + indexSize + 1);
+	simp.sliders.reserve(count);
+	for (size_t i=0; i<count && r.ok; ++i){
+		std::string name = r.getString();
+		size_t pidx = r.getIndex(simp.progs.size());
+		bool enabled = r.getBool();
+		if (!r.ok) break;
+		simp.sliders.push_back(Slider(name, pidx, i));
+		simp.sliders.back().setEnabled(enabled);
+	}
+
+	ComboPairs pairs, deltaPairs, multPairs;
+	count = r.getCount(nameSize + indexSize + 2 + sizeof(uint32_t) + indexSize);
+	simp.combos.reserve(count);
+	for (size_t i=0; i<count && r.ok; ++i){
+		std::string name = r.getString();
+		size_t pidx = r.getIndex(simp.progs.size());
+		bool enabled = r.getBool();
+		bool isFloater = r.getBool();
+		ComboSolve solveType = r.getSolveType();
+		r.getPairs(simp, pairs);
+		if (!r.ok) break;
+		simp.combos.push_back(Combo(name, pidx, i, pairs, isFloater, solveType));
+		simp.combos.back().setEnabled(enabled);
+	}
+
+	count = r.getCount(nameSize + 2 * indexSize + 2 + indexSize);
+	simp.floaters.reserve(count);
+	for (size_t i=0; i<count && r.ok; ++i){
+		std::string name = r.getString();
+		size_t pidx = r.getIndex(simp.progs.size());
+		size_t index = r.getIndex(simp.combos.size());
+		bool enabled = r.getBool();
+		bool isFloater = r.getBool();
+		r.getPairs(simp, pairs);
+		if (!r.ok) break;
+		if (pairs.empty()){
+			r.fail("Floaters need at least one slider");
+			break;
+		}
+		simp.floaters.push_back(Floater(name, pidx, index, pairs, isFloater));
+		simp.floaters.back().setEnabled(enabled);
+	}
+
+	count = r.getCount(nameSize + indexSize + 1 + sizeof(uint32_t) + 3 * indexSize);
+	simp.traversals.reserve(count);
+	for (size_t i=0; i<count && r.ok; ++i){
+		std::string name = r.getString();
+		size_t pidx = r.getIndex(simp.progs.size());
+		bool enabled = r.getBool();
+		ComboSolve solveType = r.getSolveType();
+		r.getPairs(simp, pairs);
+		r.getPairs(simp, deltaPairs);
+		r.getPairs(simp, multPairs);
+		if (!r.ok) break;
+		if (pairs.size() != deltaPairs.size()){
+			r.fail("Mismatched traversal states");
+			break;
+		}
+		simp.traversals.push_back(Traversal(name, pidx, i, pairs, deltaPairs, multPairs, solveType));
+		simp.traversals.back().setEnabled(enabled);
+	}
+
+	count = r.getCount(4 * indexSize);
+	simp.spaces.reserve(count);
+	for (size_t i=0; i<count && r.ok; ++i){
+		TriSpace space;
+		size_t floaterCount = r.getCount(indexSize);
+		if (r.ok && floaterCount == 0) r.fail("Trispaces need at least one floater");
+		for (size_t j=0; j<floaterCount && r.ok; ++j){
+			size_t fidx = r.getIndex(simp.floaters.size());
+			if (r.ok) space.floaters.push_back(&simp.floaters[fidx]);
+		}
+		if (!r.ok) break;
+		size_t dim = space.floaters[0]->stateList.size();
+
+		size_t pointCount = r.getCount(indexSize);
+		space.userPoints.resize(pointCount);
+		for (size_t j=0; j<pointCount && r.ok; ++j){
+			r.getDoubles(space.userPoints[j]);
+		}
+		size_t overrideCount = r.getCount(indexSize);
+		space.overrideSimplices.resize(overrideCount);
+		for (size_t j=0; j<overrideCount && r.ok; ++j){
+			r.getInts(space.overrideSimplices[j]);
+		}
+
+		std::vector<int> key;
+		size_t mapCount = r.getCount(2 * indexSize);
+		for (size_t j=0; j<mapCount && r.ok; ++j){
+			r.getInts(key);
+			size_t simpCount = r.getCount(4 * indexSize);
+			if (r.ok && key.size() != dim + 1) r.fail("Mismatched simplex size");
+			if (!r.ok) break;
+			std::vector<std::vector<int>> &userSimps = space.simplexMap[key];
+			std::vector<BarySolve> &solves = space.barySolves[key];
+			userSimps.resize(simpCount);
+			solves.resize(simpCount);
+			for (size_t k=0; k<simpCount && r.ok; ++k){
+				BarySolve &solve = solves[k];
+				r.getInts(userSimps[k]);
+				r.getInts(solve.floaterCorners);
+				r.getDoubles(solve.last);
+				r.getDoubles(solve.inverse);
+				if (!r.ok) break;
+
+				// Everything storeValue indexes with has to be in range
+				bool valid = userSimps[k].size() == dim + 1 && solve.floaterCorners.size() == dim + 1 &&
+					solve.last.size() == dim && solve.inverse.size() == dim * dim;
+				for (auto cit = solve.floaterCorners.begin(); cit != solve.floaterCorners.end(); ++cit){
+					if (*cit < -1 || *cit >= int(space.floaters.size())) valid = false;
+				}
+				if (!valid) r.fail("Invalid trispace simplex");
+			}
+		}
+		if (r.ok) simp.spaces.push_back(space);
+	}
+
+	if (r.ok && r.remaining() != 0) r.fail("Unexpected data after the end");
+
+	if (!r.ok){
+		simp.hasParseError = true;
+		simp.parseError = r.error;
+		simp.parseErrorOffset = r.errorOffset;
+		return false;
+	}
+	return true;
+}
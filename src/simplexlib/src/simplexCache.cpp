@@ -0,0 +1,121 @@
+/*
+Copyright 2016, Blur Studio
+
+This file is part of Simplex.
+
+Simplex is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Simplex is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Simplex.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "simplexCache.h"
+
+#include <functional> // for hash
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+using namespace simplex;
+
+namespace {
+
+struct CacheEntry {
+	std::string definition;
+	const Simplex *rig; // only used to find the entry again when it's released
+	std::weak_ptr<const Simplex> weak;
+};
+
+struct CacheRegistry {
+	std::mutex mutex;
+	std::unordered_multimap<size_t, CacheEntry> entries;
+};
+
+// Never destroyed, so solvers still held during static
+// destruction can safely remove themselves
+CacheRegistry &registry(){
+	static CacheRegistry *reg = new CacheRegistry();
+	return *reg;
+}
+
+std::shared_ptr<const Simplex> findLive(CacheRegistry &reg, size_t key, std::string_view json){
+	auto range = reg.entries.equal_range(key);
+	for (auto it = range.first; it != range.second; ++it){
+		if (it->second.definition != json) continue;
+		// An expired entry is waiting on its deleter to take the lock
+		auto rig = it->second.weak.lock();
+		if (rig) return rig;
+	}
+	return std::shared_ptr<const Simplex>();
+}
+
+void release(size_t key, const Simplex *rig){
+	CacheRegistry &reg = registry();
+	{
+		std::lock_guard<std::mutex> lock(reg.mutex);
+		auto range = reg.entries.equal_range(key);
+		for (auto it = range.first; it != range.second; ++it){
+			if (it->second.rig == rig){
+				reg.entries.erase(it);
+				break;
+			}
+		}
+	}
+	delete rig;
+}
+
+} // namespace
+
+std::shared_ptr<const Simplex> SimplexCache::acquire(std::string_view json){
+	return acquire(json.data(), json.size());
+}
+
+std::shared_ptr<const Simplex> SimplexCache::acquire(const char *json, size_t length){
+	std::string_view view(json, length);
+	size_t key = std::hash<std::string_view>()(view);
+	CacheRegistry &reg = registry();
+	{
+		std::lock_guard<std::mutex> lock(reg.mutex);
+		auto rig = findLive(reg, key, view);
+		if (rig) return rig;
+	}
+
+	// Build without holding the lock, so different rigs can load in parallel
+	Simplex *raw = new Simplex();
+	std::shared_ptr<const Simplex> built(raw, [key](const Simplex *s){ release(key, s); });
+	raw->parseJSON(json, length);
+	raw->build();
+
+	// Declared after built, so a duplicate is released once the lock is let go
+	std::lock_guard<std::mutex> lock(reg.mutex);
+	// Someone else may have loaded the same definition in the meantime
+	auto rig = findLive(reg, key, view);
+	if (rig) return rig;
+	reg.entries.emplace(key, CacheEntry{std::string(view), raw, built});
+	return built;
+}
+
+std::shared_ptr<const Simplex> SimplexCache::find(std::string_view json){
+	size_t key = std::hash<std::string_view>()(json);
+	CacheRegistry &reg = registry();
+	std::lock_guard<std::mutex> lock(reg.mutex);
+	return findLive(reg, key, json);
+}
+
+size_t SimplexCache::size(){
+	CacheRegistry &reg = registry();
+	std::lock_guard<std::mutex> lock(reg.mutex);
+	size_t count = 0;
+	for (auto it = reg.entries.begin(); it != reg.entries.end(); ++it){
+		if (!it->second.weak.expired()) ++count;
+	}
+	return count;
+}
@@ -0,0 +1,208 @@
+/*
+Copyright 2016, Blur Studio
+
+This file is part of Simplex.
+
+Simplex is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Simplex is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Simplex.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "simplex.h"
+
+#include <string>
+#include <vector>
+
+using namespace simplex;
+
+namespace {
+bool validState(const ComboPairs &state, size_t sliderCount){
+	if (state.empty()) return false;
+	for (auto pit = state.begin(); pit != state.end(); ++pit){
+		if (pit->first >= sliderCount) return false;
+	}
+	return true;
+}
+
+bool validPairs(const ProgPairs &pairs, size_t shapeCount){
+	for (auto pit = pairs.begin(); pit != pairs.end(); ++pit){
+		if (pit->first >= shapeCount) return false;
+	}
+	return true;
+}
+
+bool readsSlider(const ComboPairs &state, size_t index){
+	for (auto pit = state.begin(); pit != state.end(); ++pit){
+		if (pit->first == index) return true;
+	}
+	return false;
+}
+
+// The position of the floater for the given combo, or where it would be inserted
+// The floaters are kept in the same order as their combos
+size_t floaterPosition(const std::vector<Floater> &floaters, size_t combo){
+	size_t pos = 0;
+	while (pos < floaters.size() && floaters[pos].getIndex() < combo) ++pos;
+	return pos;
+}
+} // namespace
+
+bool Simplex::addShape(const std::string &name){
+	shapes.push_back(Shape(name, shapes.size()));
+	replan(false);
+	return true;
+}
+
+bool Simplex::addProgression(const std::string &name, const ProgPairs &pairs, ProgType interp){
+	if (!validPairs(pairs, shapes.size())) return false;
+	// Nothing uses it yet, so the plan doesn't change
+	progs.push_back(Progression(name, pairs, interp));
+	return true;
+}
+
+bool Simplex::addSlider(const std::string &name, size_t prog){
+	if (prog >= progs.size()) return false;
+	sliders.push_back(Slider(name, prog, sliders.size()));
+	replan(false);
+	return true;
+}
+
+bool Simplex::addCombo(const std::string &name, size_t prog, const ComboPairs &state, ComboSolve solveType){
+	if (prog >= progs.size()) return false;
+	if (!validState(state, sliders.size())) return false;
+
+	// A floater is still a combo, so it goes in both lists
+	size_t index = combos.size();
+	bool isFloater = isFloaterState(state);
+	if (isFloater)
+		floaters.push_back(Floater(name, prog, index, state, isFloater));
+	combos.push_back(Combo(name, prog, index, state, isFloater, solveType));
+	combos.back().setExact(exactSolve);
+	replan(isFloater);
+	return true;
+}
+
+bool Simplex::setProgression(size_t index, const ProgPairs &pairs, ProgType interp){
+	if (index >= progs.size()) return false;
+	if (!validPairs(pairs, shapes.size())) return false;
+	progs[index].setPairs(pairs, interp);
+	replan(false);
+	return true;
+}
+
+bool Simplex::setCombo(size_t index, const ComboPairs &state, ComboSolve solveType){
+	if (index >= combos.size()) return false;
+	if (!validState(state, sliders.size())) return false;
+
+	const Combo &old = combos[index];
+	std::string name = *old.getName();
+	size_t prog = old.getProgIndex();
+	bool enabled = old.isEnabled();
+	bool wasFloater = old.getIsFloater();
+	bool isFloater = isFloaterState(state);
+
+	combos[index] = Combo(name, prog, index, state, isFloater, solveType);
+	combos[index].setEnabled(enabled);
+	combos[index].setExact(exactSolve);
+
+	size_t pos = floaterPosition(floaters, index);
+	bool hasFloater = pos < floaters.size() && floaters[pos].getIndex() == index;
+	if (hasFloater)
+		floaters.erase(floaters.begin() + pos);
+	if (isFloater){
+		floaters.insert(floaters.begin() + pos, Floater(name, prog, index, state, isFloater));
+		floaters[pos].setEnabled(enabled);
+	}
+	replan(wasFloater || isFloater || hasFloater);
+	return true;
+}
+
+bool Simplex::removeShape(size_t index){
+	// The rest shape is always the first one
+	if (index == 0 || index >= shapes.size()) return false;
+
+	ProgPairs pairs;
+	for (auto xit = progs.begin(); xit != progs.end(); ++xit){
+		const ProgPairs &old = xit->getPairs();
+		bool changed = false;
+		pairs.clear();
+		for (auto pit = old.begin(); pit != old.end(); ++pit){
+			if (pit->first == index){
+				changed = true;
+				continue;
+			}
+			if (pit->first > index) changed = true;
+			pairs.push_back(std::make_pair(pit->first > index ? pit->first - 1 : pit->first, pit->second));
+		}
+		if (changed) xit->setPairs(pairs, xit->getInterp());
+	}
+
+	shapes.erase(shapes.begin() + index);
+	for (size_t i = index; i < shapes.size(); ++i) shapes[i].setIndex(i);
+	replan(false);
+	return true;
+}
+
+bool Simplex::removeProgression(size_t index){
+	if (index >= progs.size()) return false;
+	// Floaters share their combo's progression, so they don't need checking
+	for (auto xit = sliders.begin(); xit != sliders.end(); ++xit)
+		if (xit->getProgIndex() == index) return false;
+	for (auto xit = combos.begin(); xit != combos.end(); ++xit)
+		if (xit->getProgIndex() == index) return false;
+	for (auto xit = traversals.begin(); xit != traversals.end(); ++xit)
+		if (xit->getProgIndex() == index) return false;
+
+	progs.erase(progs.begin() + index);
+	auto renumber = [index](ShapeController &ctrl){
+		if (ctrl.getProgIndex() > index) ctrl.setProgIndex(ctrl.getProgIndex() - 1);
+	};
+	for (auto xit = sliders.begin(); xit != sliders.end(); ++xit) renumber(*xit);
+	for (auto xit = combos.begin(); xit != combos.end(); ++xit) renumber(*xit);
+	for (auto xit = floaters.begin(); xit != floaters.end(); ++xit) renumber(*xit);
+	for (auto xit = traversals.begin(); xit != traversals.end(); ++xit) renumber(*xit);
+	replan(false);
+	return true;
+}
+
+bool Simplex::removeSlider(size_t index){
+	if (index >= sliders.size()) return false;
+	for (auto xit = combos.begin(); xit != combos.end(); ++xit)
+		if (readsSlider(xit->stateList, index)) return false;
+	for (auto xit = traversals.begin(); xit != traversals.end(); ++xit)
+		if (xit->readsSlider(index)) return false;
+
+	sliders.erase(sliders.begin() + index);
+	for (size_t i = index; i < sliders.size(); ++i) sliders[i].setIndex(i);
+	// The order of every state is kept, so the spaces don't need re-triangulating
+	for (auto xit = combos.begin(); xit != combos.end(); ++xit) sliderRemoved(xit->stateList, index);
+	for (auto xit = floaters.begin(); xit != floaters.end(); ++xit) sliderRemoved(xit->stateList, index);
+	for (auto xit = traversals.begin(); xit != traversals.end(); ++xit) xit->sliderRemoved(index);
+	replan(false);
+	return true;
+}
+
+bool Simplex::removeCombo(size_t index){
+	if (index >= combos.size()) return false;
+
+	combos.erase(combos.begin() + index);
+	for (size_t i = index; i < combos.size(); ++i) combos[i].setIndex(i);
+
+	size_t pos = floaterPosition(floaters, index);
+	bool hasFloater = pos < floaters.size() && floaters[pos].getIndex() == index;
+	if (hasFloater)
+		floaters.erase(floaters.begin() + pos);
+	for (size_t i = pos; i < floaters.size(); ++i)
+		floaters[i].setIndex(floaters[i].getIndex() - 1);
+	replan(hasFloater);
+	return true;
+}
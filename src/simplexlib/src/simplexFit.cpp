@@ -0,0 +1,380 @@
+/*
+Copyright 2016, Blur Studio
+
+This file is part of Simplex.
+
+Simplex is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Simplex is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Simplex.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "simplex.h"
+
+#include <algorithm> // for copy, fill, min, max, sort
+#include <math.h>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using namespace simplex;
+
+namespace {
+const double minDamping = 1.0e-12;
+const double maxDamping = 1.0e10;
+// Sliders closer to zero than this check both sides of it
+const double zeroBand = 1.0e-5;
+// Where each slider's derivatives are taken
+const unsigned char sideCurrent = 0;
+const unsigned char sideAbove = 1;
+const unsigned char sideBelow = 2;
+
+// The sum of the squared differences between the weights and the target
+double fitError(const std::vector<double> &weights, const std::vector<double> &target){
+	double err = 0.0;
+	for (size_t i = 0; i < weights.size(); ++i){
+		double d = weights[i] - target[i];
+		err += d * d;
+	}
+	return err;
+}
+
+// Solve a x = b for a symmetric positive definite row-major a, leaving x in b
+// The lower triangle of a is overwritten with its Cholesky factor
+bool choleskySolve(double *a, size_t n, double *b){
+	for (size_t j = 0; j < n; ++j){
+		double d = a[j*n + j];
+		for (size_t k = 0; k < j; ++k) d -= a[j*n + k] * a[j*n + k];
+		if (!(d > 0.0)) return false;
+		d = sqrt(d);
+		a[j*n + j] = d;
+		for (size_t i = j + 1; i < n; ++i){
+			double v = a[i*n + j];
+			for (size_t k = 0; k < j; ++k) v -= a[i*n + k] * a[j*n + k];
+			a[i*n + j] = v / d;
+		}
+	}
+	for (size_t i = 0; i < n; ++i){
+		double v = b[i];
+		for (size_t k = 0; k < i; ++k) v -= a[i*n + k] * b[k];
+		b[i] = v / a[i*n + i];
+	}
+	for (size_t i = n; i-- > 0; ){
+		double v = b[i];
+		for (size_t k = i + 1; k < n; ++k) v -= a[k*n + i] * b[k];
+		b[i] = v / a[i*n + i];
+	}
+	return true;
+}
+} // namespace
+
+bool Simplex::fit(SolverState &state, const double *target, size_t n, double *values, const FitOptions &options, FitResult &result) const {
+	return fit(state, target, n, values, options, result, exactSolve);
+}
+
+bool Simplex::fit(SolverState &state, const double *target, size_t n, double *values, const FitOptions &options, FitResult &result, bool exact) const {
+	result = FitResult();
+	if (!built)
+		return false;
+
+	size_t sliderCount = sliders.size();
+	size_t shapeCount = shapes.size();
+	std::vector<double> &goal = state.fitTarget;
+	std::vector<double> &weights = state.fitWeights;
+	std::vector<double> &trialWeights = state.fitTrialWeights;
+	std::vector<double> &trial = state.fitTrial;
+	std::vector<double> &gradient = state.fitGradient;
+	std::vector<double> &normal = state.fitNormal;
+	std::vector<double> &system = state.fitSystem;
+	std::vector<double> &step = state.fitStep;
+	std::vector<size_t> &freeSliders = state.fitFree;
+	std::vector<unsigned char> &side = state.fitSide;
+	ComboPairs &row = state.fitRow;
+	SparseJacobian *jac = &state.fitJacobian;
+	SparseJacobian *trialJac = &state.fitTrialJacobian;
+	SparseJacobian &aboveJac = state.fitAboveJacobian;
+	SparseJacobian &belowJac = state.fitBelowJacobian;
+	SparseJacobian &chosenJac = state.fitChosenJacobian;
+
+	goal.assign(shapeCount, 0.0);
+	std::copy(target, target + std::min(n, shapeCount), goal.begin());
+	weights.resize(shapeCount);
+	trialWeights.resize(shapeCount);
+	trial.resize(sliderCount);
+	gradient.resize(sliderCount);
+	normal.resize(sliderCount * sliderCount);
+	step.resize(sliderCount);
+	side.resize(sliderCount);
+
+	auto clampValue = [&](double v){ return std::min(std::max(v, options.lower), options.upper); };
+	for (size_t i = 0; i < sliderCount; ++i)
+		values[i] = clampValue(values[i]);
+
+	solveJacobian(state, values, sliderCount, weights.data(), *jac, exact);
+	double err = fitError(weights, goal);
+	double damping = options.damping;
+
+	// The weights change their shape where a slider crosses zero, so the
+	// derivative on one side says nothing about the other. A slider that
+	// the fit drives to zero would never cross it. Those close to zero get
+	// the derivatives from exactly zero, and from just past -EPS, where
+	// everything reads as negative, and follow the side that lowers the error
+	bool canGoBelow = options.lower <= -2.0 * EPS;
+
+	size_t sweeps = 0;
+	for (size_t iter = 0; iter < options.maxIterations; ++iter){
+		// Pick which side of zero each slider close to it takes its derivative from
+		bool nearZero = false;
+		for (size_t i = 0; i < sliderCount; ++i){
+			side[i] = (canGoBelow && fabs(values[i]) < zeroBand && sliders[i].isEnabled()) ? sideAbove : sideCurrent;
+			nearZero |= (side[i] != sideCurrent);
+		}
+		const SparseJacobian *used = jac;
+		if (nearZero){
+			for (size_t i = 0; i < sliderCount; ++i)
+				trial[i] = (side[i] == sideAbove) ? 0.0 : values[i];
+			solveJacobian(state, trial.data(), sliderCount, trialWeights.data(), aboveJac, exact);
+			for (size_t i = 0; i < sliderCount; ++i)
+				trial[i] = (side[i] == sideAbove) ? -2.0 * EPS : values[i];
+			solveJacobian(state, trial.data(), sliderCount, trialWeights.data(), belowJac, exact);
+
+			// The slope of the error on each side, as g = J^T r
+			std::fill(gradient.begin(), gradient.end(), 0.0);
+			std::fill(step.begin(), step.end(), 0.0);
+			for (auto eit = aboveJac.entries.begin(); eit != aboveJac.entries.end(); ++eit)
+				gradient[eit->slider] += eit->value * (weights[eit->shape] - goal[eit->shape]);
+			for (auto eit = belowJac.entries.begin(); eit != belowJac.entries.end(); ++eit)
+				step[eit->slider] += eit->value * (weights[eit->shape] - goal[eit->shape]);
+			for (size_t i = 0; i < sliderCount; ++i){
+				// Go down when that lowers the error faster than going up does
+				if (side[i] == sideAbove && step[i] > 0.0 && step[i] > -gradient[i]) side[i] = sideBelow;
+			}
+
+			// Gather every slider's derivatives from the side it takes
+			std::vector<JacobianEntry> &entries = chosenJac.entries;
+			entries.clear();
+			for (auto eit = jac->entries.begin(); eit != jac->entries.end(); ++eit)
+				if (side[eit->slider] == sideCurrent) entries.push_back(*eit);
+			for (auto eit = aboveJac.entries.begin(); eit != aboveJac.entries.end(); ++eit)
+				if (side[eit->slider] == sideAbove) entries.push_back(*eit);
+			for (auto eit = belowJac.entries.begin(); eit != belowJac.entries.end(); ++eit)
+				if (side[eit->slider] == sideBelow) entries.push_back(*eit);
+			std::sort(entries.begin(), entries.end());
+			used = &chosenJac;
+		}
+
+		// The normal equations J^T J and the gradient J^T r
+		// The entries are sorted by shape, so each shape's row is a contiguous run
+		std::fill(normal.begin(), normal.end(), 0.0);
+		std::fill(gradient.begin(), gradient.end(), 0.0);
+		for (auto eit = used->entries.begin(); eit != used->entries.end(); ){
+			size_t shape = eit->shape;
+			row.clear();
+			for (; eit != used->entries.end() && eit->shape == shape; ++eit)
+				row.push_back(std::make_pair(eit->slider, eit->value));
+			double r = weights[shape] - goal[shape];
+			for (auto ait = row.begin(); ait != row.end(); ++ait){
+				gradient[ait->first] += ait->second * r;
+				double *nrow = &normal[ait->first * sliderCount];
+				for (auto cit = row.begin(); cit != row.end(); ++cit)
+					nrow[cit->first] += ait->second * cit->second;
+			}
+		}
+
+		// Sliders held against a bound by the gradient stay where they are
+		freeSliders.clear();
+		double slope = 0.0;
+		for (size_t i = 0; i < sliderCount; ++i){
+			double g = gradient[i];
+			if ((values[i] <= options.lower && g > 0.0) || (values[i] >= options.upper && g < 0.0)) continue;
+			freeSliders.push_back(i);
+			slope = std::max(slope, fabs(g));
+		}
+		if (slope <= options.tolerance){
+			if (sweeps < options.maxSweeps && err > options.tolerance * options.tolerance){
+				++sweeps;
+				if (sweepSliders(state, goal, values, err, options, exact)){
+					solveJacobian(state, values, sliderCount, weights.data(), *jac, exact);
+					continue;
+				}
+			}
+			result.converged = true;
+			break;
+		}
+
+		// Damp the step until it lowers the error
+		size_t freeCount = freeSliders.size();
+		system.resize(freeCount * freeCount);
+		bool improved = false;
+		double moved = 0.0;
+		while (!improved && damping <= maxDamping){
+			for (size_t a = 0; a < freeCount; ++a){
+				const double *nrow = &normal[freeSliders[a] * sliderCount];
+				for (size_t b = 0; b < freeCount; ++b)
+					system[a * freeCount + b] = nrow[freeSliders[b]];
+				system[a * freeCount + a] += damping * (1.0 + system[a * freeCount + a]);
+				step[a] = -gradient[freeSliders[a]];
+			}
+			if (!choleskySolve(system.data(), freeCount, step.data())){
+				damping *= 4.0;
+				continue;
+			}
+
+			std::copy(values, values + sliderCount, trial.begin());
+			for (size_t a = 0; a < freeCount; ++a)
+				trial[freeSliders[a]] = clampValue(values[freeSliders[a]] + step[a]);
+			solveJacobian(state, trial.data(), sliderCount, trialWeights.data(), *trialJac, exact);
+			double trialErr = fitError(trialWeights, goal);
+			if (trialErr < err){
+				for (size_t i = 0; i < sliderCount; ++i)
+					moved = std::max(moved, fabs(trial[i] - values[i]));
+				std::copy(trial.begin(), trial.end(), values);
+				std::swap(weights, trialWeights);
+				std::swap(jac, trialJac);
+				err = trialErr;
+				damping = std::max(damping / 3.0, minDamping);
+				improved = true;
+			}
+			else {
+				damping *= 4.0;
+			}
+		}
+
+		if (improved)
+			++result.iterations;
+		// Nowhere close by is any better
+		if (!improved || moved <= options.tolerance){
+			if (sweeps < options.maxSweeps && err > options.tolerance * options.tolerance){
+				++sweeps;
+				if (sweepSliders(state, goal, values, err, options, exact)){
+					solveJacobian(state, values, sliderCount, weights.data(), *jac, exact);
+					continue;
+				}
+			}
+			result.converged = true;
+			break;
+		}
+	}
+	result.error = err;
+	return result.converged;
+}
+
+bool Simplex::sweepSliders(SolverState &state, const std::vector<double> &goal, double *values, double &err,
+		const FitOptions &options, bool exact) const {
+	// A slider that has to get past a progression point to reach the
+	// target, like one that fits an in-between shape from the wrong side
+	// of it, can't see the shapes on the far side. So try each progression
+	// time, and the current value mirrored across it
+	size_t sliderCount = sliders.size();
+	std::vector<double> &trialWeights = state.fitTrialWeights;
+	bool swept = false;
+	for (size_t i = 0; i < sliderCount; ++i){
+		if (!sliders[i].isEnabled()) continue;
+		double current = values[i];
+		double best = current;
+		const ProgPairs &pairs = progs[sliders[i].getProgIndex()].getPairs();
+		for (auto pit = pairs.begin(); pit != pairs.end(); ++pit){
+			double tries[2] = {pit->second, 2.0 * pit->second - current};
+			for (double t : tries){
+				t = std::min(std::max(t, options.lower), options.upper);
+				if (fabs(t - current) <= options.tolerance) continue;
+				values[i] = t;
+				solveDense(state, values, sliderCount, trialWeights.data(), exact);
+				double trialErr = fitError(trialWeights, goal);
+				if (trialErr < err){
+					err = trialErr;
+					best = t;
+				}
+			}
+		}
+		values[i] = best;
+		swept |= (best != current);
+	}
+	return swept;
+}
+
+void Simplex::fitBatch(SolverState &state, const double *targets, size_t frames, size_t n, const double *start,
+		double *out, const FitOptions &options, FitResult *results) const {
+	fitBatch(state, targets, frames, n, start, out, options, results, exactSolve);
+}
+
+void Simplex::fitBatch(SolverState &state, const double *targets, size_t frames, size_t n, const double *start,
+		double *out, const FitOptions &options, FitResult *results, bool exact) const {
+	size_t sliderCount = sliders.size();
+	std::vector<double> &retry = state.fitRetry;
+	retry.resize(sliderCount);
+	FitResult result, retryResult;
+	for (size_t f = 0; f < frames; ++f){
+		double *values = out + f * sliderCount;
+		const double *target = targets + f * n;
+		if (start != nullptr)
+			std::copy(start, start + sliderCount, retry.begin());
+		else
+			std::fill(retry.begin(), retry.end(), 0.0);
+		// Warm start from the previous frame, which is usually close by
+		if (f == 0)
+			std::copy(retry.begin(), retry.end(), values);
+		else
+			std::copy(values - sliderCount, values, values);
+		fit(state, target, n, values, options, result, exact);
+
+		// A jump in the targets can leave the previous frame's values in
+		// the wrong place to start, so a frame that doesn't reach its
+		// target tries again from the start values, and keeps the better one
+		if (f != 0 && result.error > options.tolerance * options.tolerance){
+			fit(state, target, n, retry.data(), options, retryResult, exact);
+			if (retryResult.error < result.error){
+				std::copy(retry.begin(), retry.end(), values);
+				result = retryResult;
+			}
+		}
+		if (results != nullptr)
+			results[f] = result;
+	}
+}
+
+void Simplex::fitBatchParallel(const double *targets, size_t frames, size_t n, const double *start,
+		double *out, const FitOptions &options, FitResult *results, size_t threadCount) const {
+	fitBatchParallel(targets, frames, n, start, out, options, results, threadCount, exactSolve);
+}
+
+void Simplex::fitBatchParallel(const double *targets, size_t frames, size_t n, const double *start,
+		double *out, const FitOptions &options, FitResult *results, size_t threadCount, bool exact) const {
+	if (threadCount == 0)
+		threadCount = std::thread::hardware_concurrency();
+	if (threadCount > frames)
+		threadCount = frames;
+	if (threadCount <= 1){
+		SolverState local;
+		fitBatch(local, targets, frames, n, start, out, options, results, exact);
+		return;
+	}
+
+	// Give each thread one contiguous run of frames, so the warm starts still
+	// follow the performance. Only the first frame of each run starts cold
+	size_t sliderCount = sliders.size();
+	size_t chunk = frames / threadCount;
+	size_t extra = frames % threadCount;
+	std::vector<std::thread> workers;
+	workers.reserve(threadCount);
+	size_t first = 0;
+	for (size_t t = 0; t < threadCount; ++t){
+		size_t count = chunk + ((t < extra) ? 1 : 0);
+		FitResult *runResults = (results != nullptr) ? results + first : nullptr;
+		workers.push_back(std::thread([this, targets, n, start, out, sliderCount, first, count, &options, runResults, exact](){
+			SolverState local;
+			fitBatch(local, targets + first * n, count, n, start, out + first * sliderCount, options, runResults, exact);
+		}));
+		first += count;
+	}
+	for (auto wit = workers.begin(); wit != workers.end(); ++wit)
+		wit->join();
+}
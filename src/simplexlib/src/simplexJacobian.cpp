@@ -0,0 +1,139 @@
+/*
+Copyright 2016, Blur Studio
+
+This file is part of Simplex.
+
+Simplex is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Simplex is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Simplex.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "simplex.h"
+
+#include <algorithm> // for sort, remove_if
+#include <math.h>
+#include <vector>
+
+using namespace simplex;
+
+void Simplex::solveJacobian(const double *in, size_t n, double *out, SparseJacobian &jac){
+	if (!built)
+		build();
+	solveJacobian(state, in, n, out, jac);
+}
+
+void Simplex::solveJacobian(SolverState &state, const double *in, size_t n, double *out, SparseJacobian &jac) const {
+	solveJacobian(state, in, n, out, jac, exactSolve);
+}
+
+void Simplex::solveJacobian(SolverState &state, const double *in, size_t n, double *out, SparseJacobian &jac, bool exact) const {
+	jac.clear();
+	// The gradients are built from the stored controller values, so
+	// this has to be a real solve rather than a copy from the cache
+	solveDense(state, in, n, out, exact);
+	if (!built)
+		return;
+
+	// Every controller only reads slider values, so the chain rule stops
+	// there, and each slot's gradient is a short list of its own sliders
+	std::vector<ComboPairs> &dValues = state.valueGradients;
+	std::vector<ComboPairs> &dMuls = state.multGradients;
+	for (auto git = dValues.begin(); git != dValues.end(); ++git) git->clear();
+	for (auto git = dMuls.begin(); git != dMuls.end(); ++git) git->clear();
+
+	for (auto xit = sliders.begin(); xit != sliders.end(); ++xit){
+		xit->storeGradient(dValues[xit->getSlot()]);
+	}
+	// Combos and traversals read the stored slider values, which a disabled
+	// slider leaves at zero whatever its input is. The spaces read the
+	// rectified input, so they still follow a disabled slider
+	auto dropDisabled = [&](ComboPairs &gradient){
+		gradient.erase(std::remove_if(gradient.begin(), gradient.end(),
+			[&](const ComboPair &p){ return !sliders[p.first].isEnabled(); }), gradient.end());
+	};
+	for (auto xit = combos.begin(); xit != combos.end(); ++xit){
+		xit->storeGradient(state, exact, dValues[xit->getSlot()]);
+		dropDisabled(dValues[xit->getSlot()]);
+	}
+	for (auto xit = spaces.begin(); xit != spaces.end(); ++xit){
+		xit->storeGradient(state, dValues);
+	}
+	std::vector<double> &values = state.gradientValues;
+	std::vector<double> &muls = state.gradientMultipliers;
+	values.assign(state.ctrlValues.begin(), state.ctrlValues.end());
+	muls.assign(state.ctrlMultipliers.begin(), state.ctrlMultipliers.end());
+	for (auto xit = traversals.begin(); xit != traversals.end(); ++xit){
+		size_t slot = xit->getSlot();
+		xit->storeGradient(state, values[slot], muls[slot], dValues[slot], dMuls[slot]);
+		dropDisabled(dValues[slot]);
+		dropDisabled(dMuls[slot]);
+	}
+
+	// A slot adds multiplier * weight(value) to each of its shapes, and
+	// the rest shape is one minus the largest |value * multiplier|
+	double maxAct = 0.0;
+	size_t maxSlot = plan.outputs.size();
+	ProgOutput &weights = state.progScratch;
+	ProgOutput &slopes = state.derivScratch;
+	for (size_t i = 0; i < plan.outputs.size(); ++i){
+		double value = values[i];
+		double mul = muls[i];
+		double vm = fabs(value * mul);
+		if (vm > maxAct){
+			maxAct = vm;
+			maxSlot = i;
+		}
+
+		const ComboPairs &dValue = dValues[i];
+		const ComboPairs &dMul = dMuls[i];
+		if (dValue.empty() && dMul.empty()) continue;
+		const Progression &prog = *plan.outputProgs[i];
+		prog.getDerivative(value, mul, slopes);
+		for (auto sit = slopes.begin(); sit != slopes.end(); ++sit){
+			// The rest shape is overwritten, so nothing else adds to it
+			if (sit->first == 0) continue;
+			for (auto dit = dValue.begin(); dit != dValue.end(); ++dit)
+				jac.entries.push_back(JacobianEntry(sit->first, dit->first, sit->second * dit->second));
+		}
+		if (dMul.empty()) continue;
+		prog.getOutput(value, 1.0, weights);
+		for (auto sit = weights.begin(); sit != weights.end(); ++sit){
+			if (sit->first == 0) continue;
+			for (auto dit = dMul.begin(); dit != dMul.end(); ++dit)
+				jac.entries.push_back(JacobianEntry(sit->first, dit->first, sit->second * dit->second));
+		}
+	}
+
+	if (!shapes.empty() && maxSlot != plan.outputs.size()){
+		double value = values[maxSlot];
+		double mul = muls[maxSlot];
+		double sign = (value * mul < 0.0) ? 1.0 : -1.0;
+		const ComboPairs &dValue = dValues[maxSlot];
+		const ComboPairs &dMul = dMuls[maxSlot];
+		for (auto dit = dValue.begin(); dit != dValue.end(); ++dit)
+			jac.entries.push_back(JacobianEntry(0, dit->first, sign * mul * dit->second));
+		for (auto dit = dMul.begin(); dit != dMul.end(); ++dit)
+			jac.entries.push_back(JacobianEntry(0, dit->first, sign * value * dit->second));
+	}
+
+	// Merge the entries for the same shape and slider
+	std::vector<JacobianEntry> &entries = jac.entries;
+	std::sort(entries.begin(), entries.end());
+	size_t kept = 0;
+	for (size_t i = 0; i < entries.size(); ){
+		JacobianEntry merged = entries[i];
+		for (++i; i < entries.size() && entries[i].shape == merged.shape && entries[i].slider == merged.slider; ++i)
+			merged.value += entries[i].value;
+		if (merged.value != 0.0) entries[kept++] = merged;
+	}
+	entries.resize(kept, JacobianEntry(0, 0, 0.0));
+}
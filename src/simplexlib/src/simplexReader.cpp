@@ -0,0 +1,577 @@
+/*
+Copyright 2016, Blur Studio
+
+This file is part of Simplex.
+
+Simplex is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Simplex is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Simplex.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "simplexReader.h"
+#include "simplex.h"
+
+#include "rapidjson/error/en.h"
+#include "rapidjson/reader.h"
+#include "rapidjson/memorystream.h"
+#include "rapidjson/encodedstream.h"
+
+#include <algorithm> // for fill
+#include <climits> // for INT_MAX, UCHAR_MAX
+#include <cstdint>
+#include <cstring> // for strlen, memcmp
+#include <deque>
+#include <string>
+
+using namespace simplex;
+
+namespace {
+
+// The top-level members the solver reads. Everything else in a definition
+// (groups, falloffs, and whatever extras the UI stores) is skipped over
+enum Member : unsigned char {
+	memberShapes, memberProgs, memberSliders, memberCombos, memberTraversals, memberVersion, memberSkip
+};
+const char * const memberKeys[] = {"shapes", "progressions", "sliders", "combos", "traversals", "encodingVersion"};
+const size_t memberKeyCount = sizeof(memberKeys) / sizeof(memberKeys[0]);
+const size_t sectionCount = memberVersion;
+
+// The members of an element that any of the encodings read. The v1
+// encoding writes most elements as arrays, so their first few positions
+// get slots too, and a shape that's just a string is slotSelf
+enum Slot : unsigned char {
+	slotSelf,
+	slotPos0, slotPos1, slotPos2, slotPos3,
+	slotName, slotProg, slotPairs, slotInterp, slotEnabled, slotSolveType,
+	slotProgressType, slotProgressControl, slotProgressFlip,
+	slotMultiplierType, slotMultiplierControl, slotMultiplierFlip,
+	slotStart, slotEnd,
+	slotSkip
+};
+const char * const slotKeys[] = {
+	"name", "prog", "pairs", "interp", "enabled", "solveType",
+	"progressType", "progressControl", "progressFlip",
+	"multiplierType", "multiplierControl", "multiplierFlip",
+	"start", "end"
+};
+const size_t slotKeyCount = sizeof(slotKeys) / sizeof(slotKeys[0]);
+const size_t slotPositions = slotName - slotPos0;
+
+// What a value was, as the rapidjson Is* checks that would pass for it
+const unsigned char isString = 1;
+const unsigned char isBool = 2;
+const unsigned char isInt = 4;
+const unsigned char isUint = 8;
+const unsigned char isNumber = 16;
+const unsigned char isDouble = 32;
+const unsigned char isArray = 64;
+const unsigned char isObject = 128;
+
+// One entry of an array member. A pair is an array itself, so
+// its index and value come from its own first two entries
+struct PendingItem {
+	double value;
+	int index;
+	unsigned char type;
+	unsigned char first; // the types of a pair's first two entries
+	unsigned char second;
+	unsigned char count; // how many entries a pair has, up to 2
+
+	bool isPair(unsigned char valueType) const {
+		return (type & isArray) && count >= 2 && (first & isInt) && (second & valueType);
+	}
+};
+
+// One member of an element, by its key, or by its position in a v1 array
+struct PendingField {
+	Slot slot;
+	unsigned char type;
+	int number; // an int or bool's value, or how many items an array has
+	size_t start; // where a string's text or an array's items begin
+};
+
+struct PendingElement {
+	unsigned char type;
+	unsigned char positions; // how many an array element has, up to 255
+	unsigned fieldCount;
+	size_t fieldStart; // into PendingRecords::fields
+};
+
+// Everything kept from the sections, in flat lists that are shared by all
+// of the elements, so reading an element doesn't allocate anything of its own.
+// They're deques so growing them never copies what's already been kept
+struct PendingRecords {
+	std::deque<PendingElement> elements[sectionCount];
+	bool present[sectionCount] = {};
+	bool isSectionArray[sectionCount] = {};
+	std::deque<PendingField> fields;
+	std::deque<PendingItem> items;
+	std::string text; // every kept string, each followed by a null
+
+	bool rootIsObject = false;
+	bool hasVersion = false;
+	bool versionIsUint = false;
+	unsigned version = 1;
+
+	const PendingField *find(const PendingElement &elem, Slot slot) const {
+		for (size_t i = elem.fieldStart; i < elem.fieldStart + elem.fieldCount; ++i){
+			if (fields[i].slot == slot) return &fields[i];
+		}
+		return nullptr;
+	}
+	// The member, when it's there and passes every check in type
+	const PendingField *find(const PendingElement &elem, Slot slot, unsigned char type) const {
+		const PendingField *field = find(elem, slot);
+		if (field == nullptr || (field->type & type) != type) return nullptr;
+		return field;
+	}
+	// This stops at the first null like std::string(value.GetString()) does
+	std::string str(const PendingField *field) const {
+		return std::string(text.data() + field->start);
+	}
+	size_t itemCount(const PendingField *field) const {
+		return (size_t)field->number;
+	}
+	const PendingItem &item(const PendingField *field, size_t i) const {
+		return items[field->start + i];
+	}
+};
+
+// Keeps the parts of a definition the solver reads while it streams past.
+// Values are placed by how many containers are open around them:
+// 1 within the root, 2 within a section, 3 within an element,
+// 4 within an element's array member, and 5 within one of its pairs
+class SectionHandler : public rapidjson::BaseReaderHandler<rapidjson::UTF8<>, SectionHandler> {
+	private:
+		PendingRecords &rec;
+		size_t depth;
+		size_t skipDepth; // the depth inside the container being skipped, or 0
+		Member member; // the root member whose value is next
+		bool seen[memberKeyCount];
+		size_t section; // whose array is open, or sectionCount
+		Slot slot; // the element member whose value is next
+
+		bool skipping() const { return skipDepth != 0; }
+
+		void addField(Slot s, unsigned char type, int64_t i, const char *str, rapidjson::SizeType length){
+			PendingField field;
+			field.slot = s;
+			field.type = type;
+			field.number = (type & isArray) ? 0 : (int)i;
+			field.start = (type & isArray) ? rec.items.size() : rec.text.size();
+			if (type & isString){
+				rec.text.append(str, length);
+				rec.text.push_back('\0');
+			}
+			rec.fields.push_back(field);
+			++rec.elements[section].back().fieldCount;
+		}
+
+		// Keep a value starting at the current depth
+		// Returns whether anything inside it is needed too
+		bool place(unsigned char type, int64_t i, double d, const char *str, rapidjson::SizeType length){
+			switch (depth){
+				case 0:
+					rec.rootIsObject = (type & isObject) != 0;
+					return rec.rootIsObject;
+				case 1: {
+					Member m = member;
+					member = memberSkip;
+					if (m == memberVersion){
+						rec.hasVersion = true;
+						rec.versionIsUint = (type & isUint) != 0;
+						if (rec.versionIsUint) rec.version = (unsigned)i;
+						return false;
+					}
+					if (m == memberSkip) return false;
+					rec.present[m] = true;
+					rec.isSectionArray[m] = (type & isArray) != 0;
+					if (!rec.isSectionArray[m]) return false;
+					section = m;
+					return true;
+				}
+				case 2: {
+					PendingElement elem;
+					elem.type = type;
+					elem.positions = 0;
+					elem.fieldStart = rec.fields.size();
+					elem.fieldCount = 0;
+					rec.elements[section].push_back(elem);
+					if (type & isString) addField(slotSelf, type, i, str, length);
+					return (type & (isArray | isObject)) != 0;
+				}
+				case 3: {
+					PendingElement &elem = rec.elements[section].back();
+					Slot s = slot;
+					slot = slotSkip;
+					if (elem.type & isArray){
+						s = (elem.positions < slotPositions) ? Slot(slotPos0 + elem.positions) : slotSkip;
+						if (elem.positions < UCHAR_MAX) ++elem.positions;
+					}
+					if (s == slotSkip) return false;
+					addField(s, type, i, str, length);
+					// Only arrays have anything more to read
+					return (type & isArray) != 0;
+				}
+				case 4: {
+					PendingItem item;
+					item.value = (type & isNumber) ? d : 0.0;
+					item.index = (type & isInt) ? (int)i : 0;
+					item.type = type;
+					item.first = 0;
+					item.second = 0;
+					item.count = 0;
+					rec.items.push_back(item);
+					++rec.fields.back().number;
+					return (type & isArray) != 0;
+				}
+				case 5: {
+					PendingItem &item = rec.items.back();
+					if (item.count == 0){
+						item.first = type;
+						item.index = (type & isInt) ? (int)i : 0;
+					}
+					else if (item.count == 1){
+						item.second = type;
+						item.value = (type & isNumber) ? d : 0.0;
+					}
+					if (item.count < 2) ++item.count;
+					return false;
+				}
+			}
+			return false;
+		}
+
+		bool scalar(unsigned char type, int64_t i, double d, const char *str=nullptr, rapidjson::SizeType length=0){
+			if (!skipping()) place(type, i, d, str, length);
+			return true;
+		}
+		bool start(unsigned char type){
+			bool keep = skipping() || place(type, 0, 0.0, nullptr, 0);
+			++depth;
+			if (!keep) skipDepth = depth;
+			return true;
+		}
+		bool end(){
+			if (skipDepth == depth) skipDepth = 0;
+			--depth;
+			if (depth == 1 && !skipping()) section = sectionCount;
+			return true;
+		}
+
+	public:
+		explicit SectionHandler(PendingRecords &rec):
+			rec(rec), depth(0), skipDepth(0), member(memberSkip), section(sectionCount), slot(slotSkip){
+			std::fill(seen, seen + memberKeyCount, false);
+		}
+
+		bool Null(){ return scalar(0, 0, 0.0); }
+		bool Bool(bool b){ return scalar(isBool, b ? 1 : 0, 0.0); }
+		bool Int(int i){ return scalar(isInt | isNumber, i, (double)i); }
+		bool Uint(unsigned u){ return scalar(isUint | isNumber | (u <= (unsigned)INT_MAX ? isInt : 0), u, (double)u); }
+		bool Int64(int64_t i){ return scalar(isNumber, 0, (double)i); }
+		bool Uint64(uint64_t u){ return scalar(isNumber, 0, (double)u); }
+		bool Double(double d){ return scalar(isNumber | isDouble, 0, d); }
+		bool String(const char *str, rapidjson::SizeType length, bool){ return scalar(isString, 0, 0.0, str, length); }
+		bool StartObject(){ return start(isObject); }
+		bool EndObject(rapidjson::SizeType){ return end(); }
+		bool StartArray(){ return start(isArray); }
+		bool EndArray(rapidjson::SizeType){ return end(); }
+
+		bool Key(const char *str, rapidjson::SizeType length, bool){
+			if (skipping()) return true;
+			if (depth == 1){
+				// Like the DOM, only the first of any repeated keys counts
+				member = memberSkip;
+				for (size_t k = 0; k < memberKeyCount; ++k){
+					if (!seen[k] && strlen(memberKeys[k]) == length && memcmp(memberKeys[k], str, length) == 0){
+						seen[k] = true;
+						member = Member(k);
+						break;
+					}
+				}
+			}
+			else if (depth == 3){
+				slot = slotSkip;
+				for (size_t k = 0; k < slotKeyCount; ++k){
+					if (strlen(slotKeys[k]) == length && memcmp(slotKeys[k], str, length) == 0){
+						Slot s = Slot(slotName + k);
+						if (rec.find(rec.elements[section].back(), s) == nullptr) slot = s;
+						break;
+					}
+				}
+			}
+			return true;
+		}
+};
+
+// The element readers accept what the parseJSONv1/v2/v3 functions do
+// for the same value. Where those would index past the end of a v1 array,
+// or read something else as one, these fail instead.
+// Anything but a version 2 or 3 file is read as version 1
+
+bool isVersion1(unsigned version){
+	return version != 2 && version != 3;
+}
+
+bool readEnabled(const PendingRecords &rec, const PendingElement &elem){
+	const PendingField *enabled = rec.find(elem, slotEnabled, isBool);
+	return enabled == nullptr || enabled->number != 0;
+}
+
+ComboSolve readSolveType(const PendingRecords &rec, const PendingElement &elem){
+	const PendingField *solve = rec.find(elem, slotSolveType, isString);
+	return (solve == nullptr) ? ComboSolve::None : getSolveType(rec.str(solve));
+}
+
+// Like getSolvePairs, but v1 combos take integer slider values too
+bool readSolvePairs(const PendingRecords &rec, const PendingField *pairs, const Simplex &simp,
+		unsigned char valueType, ComboPairs &state){
+	for (size_t j = 0; j < rec.itemCount(pairs); ++j){
+		const PendingItem &item = rec.item(pairs, j);
+		if (!item.isPair(valueType)) return false;
+		size_t slidx = (size_t)item.index;
+		if (slidx >= simp.sliders.size()) return false;
+		state.push_back(std::make_pair(slidx, item.value));
+	}
+	return true;
+}
+
+bool readShape(const PendingRecords &rec, const PendingElement &elem, size_t index, unsigned version, Simplex &simp){
+	const PendingField *name = isVersion1(version) ?
+		rec.find(elem, slotSelf, isString) :
+		(elem.type & isObject) ? rec.find(elem, slotName, isString) : nullptr;
+	if (name == nullptr) return false;
+	simp.shapes.push_back(Shape(rec.str(name), index));
+	return true;
+}
+
+bool readProgression(const PendingRecords &rec, const PendingElement &elem, unsigned version, Simplex &simp){
+	ProgPairs pairs;
+	ProgType interp = ProgType::spline;
+	const PendingField *name;
+	if (isVersion1(version)){
+		if (!(elem.type & isArray) || elem.positions < 3) return false;
+		const PendingField *indices = rec.find(elem, slotPos1, isArray);
+		const PendingField *weights = rec.find(elem, slotPos2, isArray);
+		if (indices == nullptr || weights == nullptr) return false;
+		if (rec.itemCount(weights) < rec.itemCount(indices)) return false;
+		for (size_t j = 0; j < rec.itemCount(indices); ++j){
+			const PendingItem &x = rec.item(indices, j);
+			const PendingItem &y = rec.item(weights, j);
+			if (!(x.type & isInt)) return false;
+			if (!(y.type & isNumber)) return false;
+			if ((size_t)x.index >= simp.shapes.size()) return false;
+			pairs.push_back(std::make_pair((size_t)x.index, y.value));
+		}
+		name = rec.find(elem, slotPos0, isString);
+		if (name == nullptr) return false;
+		if (elem.positions > 3){
+			const PendingField *interpName = rec.find(elem, slotPos3, isString);
+			if (interpName == nullptr) return false;
+			if (rec.str(interpName) == "linear") interp = ProgType::linear;
+		}
+	}
+	else {
+		if (!(elem.type & isObject)) return false;
+		name = rec.find(elem, slotName, isString);
+		const PendingField *jpairs = rec.find(elem, slotPairs, isArray);
+		const PendingField *interpName = rec.find(elem, slotInterp, isString);
+		if (name == nullptr || jpairs == nullptr || interpName == nullptr) return false;
+		std::string interpStr = rec.str(interpName);
+		if (interpStr == "linear")
+			interp = ProgType::linear;
+		else if (interpStr == "splitspline")
+			interp = ProgType::splitSpline;
+		for (size_t j = 0; j < rec.itemCount(jpairs); ++j){
+			const PendingItem &item = rec.item(jpairs, j);
+			if (!item.isPair(isDouble)) return false;
+			if ((size_t)item.index >= simp.shapes.size()) return false;
+			pairs.push_back(std::make_pair((size_t)item.index, item.value));
+		}
+	}
+	simp.progs.push_back(Progression(rec.str(name), pairs, interp));
+	return true;
+}
+
+bool readSlider(const PendingRecords &rec, const PendingElement &elem, size_t index, unsigned version, Simplex &simp){
+	const PendingField *name, *prog;
+	bool v1 = isVersion1(version);
+	if (v1){
+		if (!(elem.type & isArray) || elem.positions < 2) return false;
+		name = rec.find(elem, slotPos0, isString);
+		prog = rec.find(elem, slotPos1, isInt);
+	}
+	else {
+		if (!(elem.type & isObject)) return false;
+		name = rec.find(elem, slotName, isString);
+		prog = rec.find(elem, slotProg, isInt);
+	}
+	if (name == nullptr || prog == nullptr) return false;
+	size_t slidx = (size_t)prog->number;
+	if (slidx >= simp.progs.size()) return false;
+	simp.sliders.push_back(Slider(rec.str(name), slidx, index));
+	if (!v1) simp.sliders.back().setEnabled(readEnabled(rec, elem));
+	return true;
+}
+
+bool readCombo(const PendingRecords &rec, const PendingElement &elem, size_t index, unsigned version, Simplex &simp){
+	const PendingField *name, *prog, *pairs;
+	bool v1 = isVersion1(version);
+	if (v1){
+		if (!(elem.type & isArray) || elem.positions < 3) return false;
+		name = rec.find(elem, slotPos0, isString);
+		prog = rec.find(elem, slotPos1, isInt);
+		pairs = rec.find(elem, slotPos2, isArray);
+	}
+	else {
+		if (!(elem.type & isObject)) return false;
+		name = rec.find(elem, slotName, isString);
+		prog = rec.find(elem, slotProg, isInt);
+		pairs = rec.find(elem, slotPairs, isArray);
+	}
+	if (name == nullptr || prog == nullptr || pairs == nullptr) return false;
+
+	ComboPairs state;
+	if (!readSolvePairs(rec, pairs, simp, v1 ? isNumber : isDouble, state)) return false;
+	bool isFloater = isFloaterState(state);
+	size_t pidx = (size_t)prog->number;
+	if (pidx >= simp.progs.size()) return false;
+
+	std::string comboName = rec.str(name);
+	ComboSolve solveType = v1 ? ComboSolve::None : readSolveType(rec, elem);
+	bool enabled = v1 || readEnabled(rec, elem);
+	if (isFloater){
+		simp.floaters.push_back(Floater(comboName, pidx, index, state, isFloater));
+		simp.floaters.back().setEnabled(enabled);
+	}
+	// A floater is still a combo, for the indexing
+	simp.combos.push_back(Combo(comboName, pidx, index, state, isFloater, solveType));
+	simp.combos.back().setEnabled(enabled);
+	return true;
+}
+
+// The controller a v1 or v2 traversal reads, from its type name and index
+ShapeController *readTraversalControl(const PendingRecords &rec, const PendingField *type, const PendingField *control, Simplex &simp){
+	std::string typeName = rec.str(type);
+	size_t idx = (size_t)control->number;
+	if (!typeName.empty() && typeName[0] == 'S')
+		return (idx < simp.sliders.size()) ? &simp.sliders[idx] : nullptr;
+	return (idx < simp.combos.size()) ? &simp.combos[idx] : nullptr;
+}
+
+bool readTraversal(const PendingRecords &rec, const PendingElement &elem, size_t index, unsigned version, Simplex &simp){
+	if (!(elem.type & isObject)) return false;
+	const PendingField *name = rec.find(elem, slotName, isString);
+	const PendingField *prog = rec.find(elem, slotProg, isInt);
+	if (name == nullptr || prog == nullptr) return false;
+	size_t pidx = (size_t)prog->number;
+
+	if (version == 3){
+		const PendingField *start = rec.find(elem, slotStart, isArray);
+		const PendingField *end = rec.find(elem, slotEnd, isArray);
+		if (start == nullptr || end == nullptr) return false;
+		ComboPairs startPairs, endPairs;
+		if (!readSolvePairs(rec, start, simp, isDouble, startPairs)) return false;
+		if (!readSolvePairs(rec, end, simp, isDouble, endPairs)) return false;
+		if (pidx >= simp.progs.size()) return false;
+		simp.traversals.push_back(Traversal(rec.str(name), pidx, index, startPairs, endPairs, readSolveType(rec, elem)));
+	}
+	else {
+		const PendingField *pcType = rec.find(elem, slotProgressType, isString);
+		const PendingField *pcIdx = rec.find(elem, slotProgressControl, isInt);
+		const PendingField *pcFlip = rec.find(elem, slotProgressFlip, isBool);
+		const PendingField *mcType = rec.find(elem, slotMultiplierType, isString);
+		const PendingField *mcIdx = rec.find(elem, slotMultiplierControl, isInt);
+		const PendingField *mcFlip = rec.find(elem, slotMultiplierFlip, isBool);
+		if (pcType == nullptr || pcIdx == nullptr || pcFlip == nullptr) return false;
+		if (mcType == nullptr || mcIdx == nullptr || mcFlip == nullptr) return false;
+		ShapeController *pcItem = readTraversalControl(rec, pcType, pcIdx, simp);
+		ShapeController *mcItem = readTraversalControl(rec, mcType, mcIdx, simp);
+		if (pcItem == nullptr || mcItem == nullptr) return false;
+		if (pidx >= simp.progs.size()) return false;
+		simp.traversals.push_back(Traversal(rec.str(name), pidx, index, pcItem, mcItem, pcFlip->number != 0, mcFlip->number != 0));
+	}
+	simp.traversals.back().setEnabled(readEnabled(rec, elem));
+	return true;
+}
+
+// Build the solver from the records, in the same order as parseJSONversion
+bool resolve(const PendingRecords &rec, Simplex &simp){
+	if (!rec.rootIsObject) return false;
+	unsigned version = 1u;
+	if (rec.hasVersion){
+		if (!rec.versionIsUint) return false;
+		version = rec.version;
+	}
+
+	// Must have these
+	const Member required[] = {memberShapes, memberProgs, memberSliders};
+	for (Member m : required){
+		if (!rec.present[m] || !rec.isSectionArray[m]) return false;
+	}
+
+	// Every section's size is known up front, so each list is only allocated once
+	const std::deque<PendingElement> &shapes = rec.elements[memberShapes];
+	simp.shapes.reserve(simp.shapes.size() + shapes.size());
+	for (size_t i = 0; i < shapes.size(); ++i){
+		if (!readShape(rec, shapes[i], i, version, simp)) return false;
+	}
+	const std::deque<PendingElement> &progs = rec.elements[memberProgs];
+	simp.progs.reserve(simp.progs.size() + progs.size());
+	for (size_t i = 0; i < progs.size(); ++i){
+		if (!readProgression(rec, progs[i], version, simp)) return false;
+	}
+	const std::deque<PendingElement> &sliders = rec.elements[memberSliders];
+	simp.sliders.reserve(simp.sliders.size() + sliders.size());
+	for (size_t i = 0; i < sliders.size(); ++i){
+		if (!readSlider(rec, sliders[i], i, version, simp)) return false;
+	}
+	if (rec.present[memberCombos]){
+		if (!rec.isSectionArray[memberCombos]) return false;
+		const std::deque<PendingElement> &combos = rec.elements[memberCombos];
+		simp.combos.reserve(simp.combos.size() + combos.size());
+		for (size_t i = 0; i < combos.size(); ++i){
+			if (!readCombo(rec, combos[i], i, version, simp)) return false;
+		}
+	}
+	if (rec.present[memberTraversals]){
+		if (!rec.isSectionArray[memberTraversals]) return false;
+		const std::deque<PendingElement> &travs = rec.elements[memberTraversals];
+		simp.traversals.reserve(simp.traversals.size() + travs.size());
+		for (size_t i = 0; i < travs.size(); ++i){
+			if (!readTraversal(rec, travs[i], i, version, simp)) return false;
+		}
+	}
+	simp.loaded = true;
+	return true;
+}
+
+} // namespace
+
+bool SimplexReader::read(Simplex &simp, const char *json, size_t length){
+	PendingRecords rec;
+	SectionHandler handler(rec);
+	rapidjson::MemoryStream ms(json, length);
+	rapidjson::EncodedInputStream<rapidjson::UTF8<>, rapidjson::MemoryStream> is(ms);
+	rapidjson::Reader reader;
+	rapidjson::ParseResult result = reader.Parse<rapidjson::kParseDefaultFlags>(is, handler);
+
+	simp.hasParseError = false;
+	if (result.IsError()){
+		simp.hasParseError = true;
+		simp.parseError = std::string(rapidjson::GetParseError_En(result.Code()));
+		simp.parseErrorOffset = result.Offset();
+		return false;
+	}
+	return resolve(rec, simp);
+}
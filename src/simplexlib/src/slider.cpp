@@ -33,7 +33,7 @@ bool Slider::parseJSONv1(const rapidjson::Value &val, size_t index, Simplex *sim
 	size_t slidx = size_t(val[1].GetInt());
 
 	if (slidx >= simp->progs.size()) return false;
-	simp->sliders.push_back(Slider(name, &simp->progs[slidx], index));
+	simp->sliders.push_back(Slider(name, slidx, index));
 	return true;
 }
 
@@ -50,7 +50,7 @@ bool Slider::parseJSONv2(const rapidjson::Value &val, size_t index, Simplex *sim
 
 	bool enabled = getEnabled(val);
 
-	simp->sliders.push_back(Slider(name, &simp->progs[slidx], index));
+	simp->sliders.push_back(Slider(name, slidx, index));
 	simp->sliders.back().setEnabled(enabled);
 	return true;
 }
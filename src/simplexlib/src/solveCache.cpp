@@ -0,0 +1,178 @@
+/*
+Copyright 2016, Blur Studio
+
+This file is part of Simplex.
+
+Simplex is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Simplex is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Simplex.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "solveCache.h"
+
+#include <algorithm> // for copy
+#include <cmath>
+#include <cstring> // for memcpy
+#include <iterator> // for prev
+
+using namespace simplex;
+
+namespace {
+uint64_t bitsOf(double val){
+	uint64_t bits;
+	memcpy(&bits, &val, sizeof(bits));
+	return bits;
+}
+} // namespace
+
+SolveCache::SolveCache(const SolveCache &other){
+	std::lock_guard<std::mutex> lock(other.mutex);
+	capacity.store(other.getCapacity());
+	quantum = other.quantum;
+}
+
+SolveCache &SolveCache::operator=(const SolveCache &other){
+	if (this == &other) return *this;
+	size_t cap;
+	double q;
+	{
+		std::lock_guard<std::mutex> lock(other.mutex);
+		cap = other.getCapacity();
+		q = other.quantum;
+	}
+	configure(cap, q);
+	return *this;
+}
+
+uint64_t SolveCache::hashKey(const std::vector<uint64_t> &key){
+	// FNV-1a over the words, with each word mixed first so nearby values spread out
+	uint64_t hash = 14695981039346656037ull;
+	for (auto kit = key.begin(); kit != key.end(); ++kit){
+		uint64_t word = *kit * 0x9E3779B97F4A7C15ull;
+		word ^= word >> 32;
+		hash = (hash ^ word) * 1099511628211ull;
+	}
+	return hash;
+}
+
+void SolveCache::configure(size_t newCapacity, double newQuantum){
+	std::lock_guard<std::mutex> lock(mutex);
+	capacity.store(newCapacity);
+	quantum = (newQuantum > 0.0) ? newQuantum : 0.0;
+	entries.clear();
+	index.clear();
+	stats = SolveCacheStats();
+}
+
+double SolveCache::getQuantum() const {
+	std::lock_guard<std::mutex> lock(mutex);
+	return quantum;
+}
+
+void SolveCache::makeKey(size_t buildId, const double *in, size_t n, size_t sliderCount, bool exact,
+		std::vector<uint64_t> &key, std::vector<double> &snapped) const {
+	double q = getQuantum();
+	key.resize(sliderCount + 3);
+	snapped.resize(sliderCount);
+	key[0] = buildId;
+	key[1] = exact ? 1 : 0;
+	key[2] = bitsOf(q);
+	size_t count = (n < sliderCount) ? n : sliderCount;
+	for (size_t i = 0; i < sliderCount; ++i){
+		double val = (i < count) ? in[i] : 0.0;
+		if (q > 0.0){
+			// Keyed on the step count, so every value that snaps the same way matches
+			double steps = std::nearbyint(val / q);
+			key[i + 3] = bitsOf(steps);
+			snapped[i] = std::isfinite(steps) ? steps * q : val;
+		}
+		else {
+			key[i + 3] = bitsOf(val);
+			snapped[i] = val;
+		}
+	}
+}
+
+bool SolveCache::find(const std::vector<uint64_t> &key, double *out, size_t outLen){
+	uint64_t hash = hashKey(key);
+	std::lock_guard<std::mutex> lock(mutex);
+	auto range = index.equal_range(hash);
+	for (auto it = range.first; it != range.second; ++it){
+		Entry &entry = *it->second;
+		if (entry.key != key || entry.weights.size() != outLen) continue;
+		entries.splice(entries.begin(), entries, it->second);
+		std::copy(entry.weights.begin(), entry.weights.end(), out);
+		++stats.hits;
+		return true;
+	}
+	++stats.misses;
+	return false;
+}
+
+void SolveCache::store(const std::vector<uint64_t> &key, const double *weights, size_t outLen){
+	uint64_t hash = hashKey(key);
+	std::lock_guard<std::mutex> lock(mutex);
+	size_t cap = getCapacity();
+	if (cap == 0) return;
+
+	// Another thread may have stored the same pose in the meantime
+	auto range = index.equal_range(hash);
+	for (auto it = range.first; it != range.second; ++it){
+		if (it->second->key == key){
+			entries.splice(entries.begin(), entries, it->second);
+			it->second->weights.assign(weights, weights + outLen);
+			return;
+		}
+	}
+
+	if (entries.size() >= cap){
+		// Reuse the least recently used entry, so a full cache doesn't allocate
+		auto last = std::prev(entries.end());
+		auto old = index.equal_range(last->hash);
+		for (auto it = old.first; it != old.second; ++it){
+			if (it->second == last){
+				index.erase(it);
+				break;
+			}
+		}
+		entries.splice(entries.begin(), entries, last);
+		++stats.evictions;
+	}
+	else {
+		entries.emplace_front();
+	}
+	Entry &entry = entries.front();
+	entry.hash = hash;
+	entry.key.assign(key.begin(), key.end());
+	entry.weights.assign(weights, weights + outLen);
+	index.emplace(hash, entries.begin());
+	stats.entries = entries.size();
+}
+
+void SolveCache::clear(){
+	std::lock_guard<std::mutex> lock(mutex);
+	entries.clear();
+	index.clear();
+	stats.entries = 0;
+}
+
+SolveCacheStats SolveCache::getStats() const {
+	std::lock_guard<std::mutex> lock(mutex);
+	return stats;
+}
+
+void SolveCache::clearStats(){
+	std::lock_guard<std::mutex> lock(mutex);
+	size_t count = stats.entries;
+	stats = SolveCacheStats();
+	stats.entries = count;
+}
@@ -0,0 +1,198 @@
+/*
+Copyright 2016, Blur Studio
+
+This file is part of Simplex.
+
+Simplex is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Simplex is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Simplex.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "simplex.h"
+#include "solvePlan.h"
+
+#include <algorithm> // for find
+#include <utility>
+#include <vector>
+
+using namespace simplex;
+
+namespace {
+// Whether a zero value leaves every shape but the rest unweighted
+// Then skipping the controller can't change the output
+bool quietAtZero(const Progression &prog, ProgOutput &pairs){
+	const double zeros[] = {0.0, -0.0};
+	for (double zero : zeros){
+		prog.getOutput(zero, 1.0, pairs);
+		for (auto pit = pairs.begin(); pit != pairs.end(); ++pit){
+			if (pit->first != 0 && pit->second != 0.0) return false;
+		}
+	}
+	return true;
+}
+} // namespace
+
+void IndexMap::clear(){
+	offsets.clear();
+	items.clear();
+}
+
+void IndexMap::build(const std::vector<std::vector<size_t>> &lists){
+	clear();
+	offsets.reserve(lists.size() + 1);
+	offsets.push_back(0);
+	for (auto lit = lists.begin(); lit != lists.end(); ++lit){
+		items.insert(items.end(), lit->begin(), lit->end());
+		offsets.push_back(items.size());
+	}
+}
+
+void SolvePlan::clear(){
+	outputs.clear();
+	outputProgs.clear();
+	comboTables.clear();
+	maxComboRows = 0;
+	comboRows.clear();
+	traversalTables.clear();
+	maxTraversalRows = 0;
+	traversalRows.clear();
+	sliderCombos.clear();
+	sliderSpaces.clear();
+	sliderTraversals.clear();
+	comboReaders.clear();
+	traversalReaders.clear();
+	forcedComboRows.clear();
+	forcedTraversals.clear();
+	activeAtZero.clear();
+	ctrlShapes.clear();
+	shapeCtrls.clear();
+}
+
+void SolvePlan::build(Simplex &simp){
+	clear();
+	outputs.reserve(simp.sliders.size() + simp.combos.size() + simp.floaters.size() + simp.traversals.size());
+	for (auto xit = simp.sliders.begin(); xit != simp.sliders.end(); ++xit){
+		xit->setSlot(outputs.size());
+		outputs.push_back(&(*xit));
+	}
+	for (auto xit = simp.combos.begin(); xit != simp.combos.end(); ++xit){
+		xit->setSlot(outputs.size());
+		outputs.push_back(&(*xit));
+	}
+	for (auto xit = simp.floaters.begin(); xit != simp.floaters.end(); ++xit){
+		xit->setSlot(outputs.size());
+		outputs.push_back(&(*xit));
+	}
+	for (auto xit = simp.traversals.begin(); xit != simp.traversals.end(); ++xit){
+		xit->setSlot(outputs.size());
+		outputs.push_back(&(*xit));
+	}
+
+	outputProgs.reserve(outputs.size());
+	for (auto oit = outputs.begin(); oit != outputs.end(); ++oit){
+		outputProgs.push_back(&simp.progs[(*oit)->getProgIndex()]);
+	}
+
+	comboTables = ComboTable::buildTables(simp.combos);
+	for (auto tit = comboTables.begin(); tit != comboTables.end(); ++tit){
+		if (tit->size() > maxComboRows) maxComboRows = tit->size();
+	}
+	traversalTables = TraversalTable::buildTables(simp.traversals, traversalRows);
+	for (auto tit = traversalTables.begin(); tit != traversalTables.end(); ++tit){
+		if (tit->size() > maxTraversalRows) maxTraversalRows = tit->size();
+	}
+
+	// Index everything that reads each slider
+	size_t sliderCount = simp.sliders.size();
+	std::vector<std::vector<size_t>> lists(sliderCount);
+	for (size_t t = 0; t < comboTables.size(); ++t){
+		const ComboTable &table = comboTables[t];
+		size_t count = table.size();
+		for (size_t r = 0; r < count; ++r){
+			for (size_t j = 0; j < table.arity; ++j){
+				lists[table.sliders[j * count + r]].push_back(comboRows.size());
+			}
+			comboRows.push_back(std::make_pair(t, r));
+		}
+	}
+	sliderCombos.build(lists);
+
+	lists.assign(sliderCount, std::vector<size_t>());
+	for (size_t s = 0; s < simp.spaces.size(); ++s){
+		// Every floater in a space shares the same span
+		const Floater *floater = simp.spaces[s].getFloaters()[0];
+		for (auto pit = floater->stateList.begin(); pit != floater->stateList.end(); ++pit){
+			lists[pit->first].push_back(s);
+		}
+	}
+	sliderSpaces.build(lists);
+
+	lists.assign(sliderCount, std::vector<size_t>());
+	for (size_t t = 0; t < simp.traversals.size(); ++t){
+		const Traversal &trav = simp.traversals[t];
+		const ComboPairs &mult = trav.getMultState();
+		const ComboPairs &start = trav.getProgStartState();
+		for (auto pit = mult.begin(); pit != mult.end(); ++pit)
+			lists[pit->first].push_back(t);
+		for (auto pit = start.begin(); pit != start.end(); ++pit)
+			lists[pit->first].push_back(t);
+	}
+	sliderTraversals.build(lists);
+
+	// A controller at zero is quiet when its progression only weights the rest shape
+	std::vector<bool> loud(outputs.size(), false);
+	ProgOutput pairs;
+	for (size_t c = 0; c < outputs.size(); ++c){
+		loud[c] = !quietAtZero(*outputProgs[c], pairs);
+		if (loud[c]) activeAtZero.push_back(c);
+	}
+
+	lists.assign(2 * sliderCount, std::vector<size_t>());
+	for (size_t c = 0; c < comboRows.size(); ++c){
+		const ComboTable &table = comboTables[comboRows[c].first];
+		size_t count = table.size(), r = comboRows[c].second;
+		if (table.arity == 0 || loud[table.rows[r]]) forcedComboRows.push_back(c);
+		for (size_t j = 0; j < table.arity; ++j){
+			size_t key = 2 * table.sliders[j * count + r] + ((table.signs[j * count + r] < 0.0) ? 1 : 0);
+			lists[key].push_back(c);
+		}
+	}
+	comboReaders.build(lists);
+
+	lists.assign(2 * sliderCount, std::vector<size_t>());
+	for (size_t t = 0; t < simp.traversals.size(); ++t){
+		const std::pair<size_t, size_t> &loc = traversalRows[t];
+		if (loc.first == size_t(-1)) continue;
+		const TraversalTable &table = traversalTables[loc.first];
+		size_t count = table.size(), r = loc.second;
+		if (table.multArity == 0 || loud[table.rows[r]]) forcedTraversals.push_back(t);
+		for (size_t j = 0; j < table.multArity; ++j){
+			size_t key = 2 * table.multSliders[j * count + r] + ((table.multSigns[j * count + r] < 0.0) ? 1 : 0);
+			lists[key].push_back(t);
+		}
+	}
+	traversalReaders.build(lists);
+
+	// Index which controllers can write to which shapes
+	std::vector<std::vector<size_t>> shapeLists(simp.shapes.size());
+	lists.assign(outputs.size(), std::vector<size_t>());
+	for (size_t c = 0; c < outputs.size(); ++c){
+		const ProgPairs &pairs = outputProgs[c]->getPairs();
+		for (auto pit = pairs.begin(); pit != pairs.end(); ++pit){
+			size_t shapeIdx = pit->first;
+			if (std::find(lists[c].begin(), lists[c].end(), shapeIdx) != lists[c].end()) continue;
+			lists[c].push_back(shapeIdx);
+			shapeLists[shapeIdx].push_back(c);
+		}
+	}
+	ctrlShapes.build(lists);
+	shapeCtrls.build(shapeLists);
+}
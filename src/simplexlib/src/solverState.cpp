@@ -0,0 +1,63 @@
+/*
+Copyright 2016, Blur Studio
+
+This file is part of Simplex.
+
+Simplex is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Simplex is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Simplex.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "solverState.h"
+
+#include <algorithm> // for fill
+#include <vector>
+
+using namespace simplex;
+
+void SolverState::resize(size_t sliderCount, size_t ctrlCount, size_t shapeCount, size_t spaceCount, size_t maxComboRows,
+		size_t comboRowCount, size_t traversalCount){
+	values.resize(sliderCount);
+	posValues.resize(sliderCount);
+	clamped.resize(sliderCount);
+	inverses.resize(sliderCount);
+	ctrlValues.resize(ctrlCount);
+	ctrlMultipliers.resize(ctrlCount);
+	comboScratch.resize(maxComboRows);
+	sparseAccum.resize(shapeCount);
+	touchedShapes.reserve(shapeCount);
+	valueGradients.resize(ctrlCount);
+	multGradients.resize(ctrlCount);
+
+	stamp = 0;
+	ctrlStamp.assign(ctrlCount, 0);
+	touchStamp.assign(ctrlCount, 0);
+	spaceStamp.assign(spaceCount, 0);
+	shapeStamp.assign(shapeCount, 0);
+	dirtySliders.reserve(sliderCount);
+	dirtyCtrls.reserve(ctrlCount);
+	dirtyShapes.reserve(shapeCount);
+	touchedCtrls.reserve(ctrlCount);
+	hasPrevious = false;
+
+	masked = false;
+	maskCombos.resize(comboRowCount);
+	maskSpaces.resize(spaceCount);
+	maskTraversals.resize(traversalCount);
+	// Slots can be listed once as active, and again for being active at zero
+	activeSlots.reserve(2 * ctrlCount);
+}
+
+void SolverState::clearValues(){
+	std::fill(ctrlValues.begin(), ctrlValues.end(), 0.0);
+	std::fill(ctrlMultipliers.begin(), ctrlMultipliers.end(), 1.0);
+	hasPrevious = false;
+}
@@ -22,19 +22,19 @@ along with Simplex.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <vector>
 #include <string>
-#include <unordered_map>
-#include <unordered_set>
+#include <map>
+#include <set>
 
 using namespace simplex;
 
 Traversal::Traversal(
-		const std::string &name, Progression* prog, size_t index,
+		const std::string &name, size_t prog, size_t index,
 		ShapeController* progressCtrl, ShapeController* multiplierCtrl, bool valueFlip, bool multiplierFlip):
 		ShapeController(name, prog, index), exact(true){
 
 	solveType = ComboSolve::None;
 	if (multiplierCtrl->sliderType()) {
-		multState.push_back(std::make_pair((Slider*)multiplierCtrl, multiplierFlip ? -1.0 : 1.0));
+		multState.push_back(std::make_pair(multiplierCtrl->getIndex(), multiplierFlip ? -1.0 : 1.0));
 	}
 	else {
 		// loop over the combos. Also, multiplier flip should *never* be negative here
@@ -45,8 +45,8 @@ Traversal::Traversal(
 	}
 
 	if (progressCtrl->sliderType()) {
-		progStartState.push_back(std::make_pair((Slider*)progressCtrl, 0.0));
-		progDeltaState.push_back(std::make_pair((Slider*)progressCtrl, valueFlip ? -1.0 : 1.0));
+		progStartState.push_back(std::make_pair(progressCtrl->getIndex(), 0.0));
+		progDeltaState.push_back(std::make_pair(progressCtrl->getIndex(), valueFlip ? -1.0 : 1.0));
 	}
 	else {
 		// loop over the combos. Also, multiplier flip should *never* be negative here
@@ -59,12 +59,13 @@ Traversal::Traversal(
 }
 
 Traversal::Traversal(
-		const std::string &name, Progression* prog, size_t index,
+		const std::string &name, size_t prog, size_t index,
 		const ComboPairs &startPairs, const ComboPairs &endPairs, ComboSolve solveType):
 		ShapeController(name, prog, index), exact(true){
 
-	std::unordered_map<Slider*, double> startSliders, endSliders;
-	std::unordered_set<Slider*> allSliders;
+	// Ordered by slider index, so the states come out the same every time
+	std::map<size_t, double> startSliders, endSliders;
+	std::set<size_t> allSliders;
 
 	this->solveType = solveType;
 
@@ -108,27 +109,45 @@ Traversal::Traversal(
 	}
 }
 
-void Traversal::storeValue(
-		const std::vector<double> &values,
-		const std::vector<double> &posValues,
-		const std::vector<double> &clamped,
-		const std::vector<bool> &inverses) {
+bool Traversal::readsSlider(size_t index) const {
+	// progDeltaState has the same sliders as progStartState
+	for (auto pit = progStartState.begin(); pit != progStartState.end(); ++pit){
+		if (pit->first == index) return true;
+	}
+	for (auto pit = multState.begin(); pit != multState.end(); ++pit){
+		if (pit->first == index) return true;
+	}
+	return false;
+}
+
+void Traversal::sliderRemoved(size_t index) {
+	simplex::sliderRemoved(progStartState, index);
+	simplex::sliderRemoved(progDeltaState, index);
+	simplex::sliderRemoved(multState, index);
+}
 
+void Traversal::storeValue(SolverState &state) const {
 	if (!enabled) return;
 
 	double mul = 0.0, val = 0.0;
-	solveState(multState, solveType, exact, mul);
+	const double *ctrlValues = state.ctrlValues.data();
+	solveState(multState, ctrlValues, solveType, exact, mul);
+	solveState(progStartState, progDeltaState, ctrlValues, solveType, exact, val);
 
-	std::vector<double> vals, tars;
+	state.ctrlValues[slot] = val;
+	state.ctrlMultipliers[slot] = mul;
+}
 
-	for (size_t i = 0; i < progStartState.size(); ++i) {
-		vals.push_back(progStartState[i].first->getValue() - progStartState[i].second);
-		tars.push_back(progDeltaState[i].second);
-	}
-	solveState(vals, tars, solveType, exact, val);
+void Traversal::storeGradient(const SolverState &state, double &value, double &mul, ComboPairs &valueGradient, ComboPairs &multGradient) const {
+	valueGradient.clear();
+	multGradient.clear();
+	if (!enabled) return;
 
-	value = val;
-	multiplier = mul;
+	mul = 0.0;
+	value = 0.0;
+	const double *ctrlValues = state.ctrlValues.data();
+	solveStateGradient(multState, ctrlValues, solveType, exact, mul, multGradient);
+	solveStateGradient(progStartState, progDeltaState, ctrlValues, solveType, exact, value, valueGradient);
 }
 
 bool Traversal::parseJSONv1(const rapidjson::Value &val, size_t index, Simplex *simp){
@@ -180,7 +199,7 @@ bool Traversal::parseJSONv2(const rapidjson::Value &val, size_t index, Simplex *
 
 	bool enabled = getEnabled(val);
 	
-	simp->traversals.push_back(Traversal(name, &simp->progs[pidx], index, pcItem, mcItem, pcFlip, mcFlip));
+	simp->traversals.push_back(Traversal(name, pidx, index, pcItem, mcItem, pcFlip, mcFlip));
 	simp->traversals.back().setEnabled(enabled);
 	return true;
 }
@@ -205,7 +224,7 @@ bool Traversal::parseJSONv3(const rapidjson::Value &val, size_t index, Simplex *
 	if (pidx >= simp->progs.size()) return false;
 
 	bool enabled = getEnabled(val);
-	simp->traversals.push_back(Traversal(name, &simp->progs[pidx], index, startPairs, endPairs, solveType));
+	simp->traversals.push_back(Traversal(name, pidx, index, startPairs, endPairs, solveType));
 	simp->traversals.back().setEnabled(enabled);
 	return true;
 }
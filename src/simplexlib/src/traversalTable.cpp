@@ -0,0 +1,197 @@
+/*
+Copyright 2016, Blur Studio
+
+This file is part of Simplex.
+
+Simplex is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Simplex is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Simplex.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "simplex.h"
+#include "traversalTable.h"
+
+#include "math.h"
+
+#include <limits>  // for numeric_limits
+#include <vector>
+
+using namespace simplex;
+
+namespace {
+// Reduce one state of the rows in [begin, end) with the arithmetic of solveState.
+// Leaves the result in scratch.value wherever scratch.valid is set
+// Without starts, the slider values are used directly
+void reduceState(size_t count, size_t begin, size_t end, size_t arity, const unsigned *sliders,
+		const double *starts, const double *signs, const double *ctrlValues,
+		ComboSolve solveType, bool exact, ComboScratch &scratch) {
+	double *mn = scratch.mn.data();
+	double *mx = scratch.mx.data();
+	double *mul = scratch.mul.data();
+	double *sum = scratch.sum.data();
+	unsigned char *valid = scratch.valid.data();
+	double *value = scratch.value.data();
+
+	const double inf = std::numeric_limits<double>::infinity();
+	for (size_t r = begin; r < end; ++r){
+		mn[r] = inf;
+		mx[r] = -inf;
+		mul[r] = 1.0;
+		sum[r] = 0.0;
+		valid[r] = 1;
+	}
+
+	for (size_t j = 0; j < arity; ++j){
+		const unsigned *idx = &sliders[j * count];
+		const double *sgn = &signs[j * count];
+		const double *start = starts ? &starts[j * count] : nullptr;
+		for (size_t r = begin; r < end; ++r){
+			double x = ctrlValues[idx[r]];
+			if (start) x -= start[r];
+			// The value has to be on the same side of zero as the target
+			unsigned char valNeg = !isPositive(x);
+			unsigned char tarNeg = sgn[r] < 0.0;
+			valid[r] &= (unsigned char)(valNeg == tarNeg);
+
+			double v = sgn[r] * x;
+			v = (v > MAXVAL) ? MAXVAL : v;
+			mul[r] *= v;
+			sum[r] += v;
+			mn[r] = (v < mn[r]) ? v : mn[r];
+			mx[r] = (v > mx[r]) ? v : mx[r];
+		}
+	}
+
+	switch (solveType) {
+	case ComboSolve::allMul:
+		for (size_t r = begin; r < end; ++r)
+			value[r] = mul[r];
+		break;
+	case ComboSolve::extMul:
+		for (size_t r = begin; r < end; ++r)
+			value[r] = mx[r] * mn[r];
+		break;
+	case ComboSolve::mulAvgExt:
+		for (size_t r = begin; r < end; ++r){
+			double den = mx[r] + mn[r];
+			value[r] = isZero(den) ? 0.0 : 2 * (mx[r] * mn[r]) / den;
+		}
+		break;
+	case ComboSolve::mulAvgAll:
+		for (size_t r = begin; r < end; ++r)
+			value[r] = isZero(sum[r]) ? 0.0 : arity * mul[r] / sum[r];
+		break;
+	default: // min and None
+		if (exact){
+			for (size_t r = begin; r < end; ++r)
+				value[r] = mn[r];
+		}
+		else {
+			for (size_t r = begin; r < end; ++r)
+				value[r] = doSoftMin(mx[r], mn[r]);
+		}
+	}
+}
+
+void solveRange(const TraversalTable &table, size_t begin, size_t end,
+		double *ctrlValues, double *ctrlMultipliers, ComboScratch &scratch) {
+	size_t count = table.rows.size();
+	const double *value = scratch.value.data();
+	const unsigned char *valid = scratch.valid.data();
+
+	// A failed solve stores 0.0, just like Traversal::storeValue
+	// The states only read sliders, so writing the multipliers first is safe
+	reduceState(count, begin, end, table.multArity, table.multSliders.data(), nullptr,
+			table.multSigns.data(), ctrlValues, table.solveType, table.exact, scratch);
+	for (size_t r = begin; r < end; ++r)
+		ctrlMultipliers[table.rows[r]] = valid[r] ? value[r] : 0.0;
+
+	reduceState(count, begin, end, table.progArity, table.progSliders.data(), table.progStarts.data(),
+			table.progSigns.data(), ctrlValues, table.solveType, table.exact, scratch);
+	for (size_t r = begin; r < end; ++r)
+		ctrlValues[table.rows[r]] = valid[r] ? value[r] : 0.0;
+}
+
+// Transpose a row-major block of count rows into column-major
+template <typename T>
+void toColumns(std::vector<T> &items, size_t count, size_t arity){
+	std::vector<T> cols(items.size());
+	for (size_t r = 0; r < count; ++r){
+		for (size_t j = 0; j < arity; ++j){
+			cols[j * count + r] = items[r * arity + j];
+		}
+	}
+	items.swap(cols);
+}
+} // namespace
+
+void TraversalTable::addRow(const Traversal *trav){
+	// Stored row-major until finalize()
+	rows.push_back(trav->getSlot());
+	for (auto pit = trav->multState.begin(); pit != trav->multState.end(); ++pit){
+		multSliders.push_back(unsigned(pit->first));
+		multSigns.push_back(isPositive(pit->second) ? 1.0 : -1.0);
+	}
+	for (size_t i = 0; i < trav->progStartState.size(); ++i){
+		progSliders.push_back(unsigned(trav->progStartState[i].first));
+		progStarts.push_back(trav->progStartState[i].second);
+		progSigns.push_back(isPositive(trav->progDeltaState[i].second) ? 1.0 : -1.0);
+	}
+}
+
+void TraversalTable::finalize(){
+	size_t count = rows.size();
+	toColumns(multSliders, count, multArity);
+	toColumns(multSigns, count, multArity);
+	toColumns(progSliders, count, progArity);
+	toColumns(progStarts, count, progArity);
+	toColumns(progSigns, count, progArity);
+}
+
+void TraversalTable::solve(double *ctrlValues, double *ctrlMultipliers, ComboScratch &scratch) const {
+	solveRange(*this, 0, rows.size(), ctrlValues, ctrlMultipliers, scratch);
+}
+
+void TraversalTable::solveRow(size_t row, double *ctrlValues, double *ctrlMultipliers, ComboScratch &scratch) const {
+	solveRange(*this, row, row + 1, ctrlValues, ctrlMultipliers, scratch);
+}
+
+std::vector<TraversalTable> TraversalTable::buildTables(const std::vector<Traversal> &traversals,
+		std::vector<std::pair<size_t, size_t>> &rowOf){
+	std::vector<TraversalTable> tables;
+	rowOf.assign(traversals.size(), std::make_pair(size_t(-1), size_t(0)));
+	for (size_t t = 0; t < traversals.size(); ++t){
+		const Traversal &trav = traversals[t];
+		// Disabled traversals keep their cleared value
+		if (!trav.enabled) continue;
+
+		size_t multArity = trav.multState.size();
+		size_t progArity = trav.progStartState.size();
+		size_t found = tables.size();
+		for (size_t i = 0; i < tables.size(); ++i){
+			const TraversalTable &table = tables[i];
+			if (table.solveType == trav.solveType && table.exact == trav.exact &&
+					table.multArity == multArity && table.progArity == progArity){
+				found = i;
+				break;
+			}
+		}
+		if (found == tables.size())
+			tables.push_back(TraversalTable(trav.solveType, trav.exact, multArity, progArity));
+		rowOf[t] = std::make_pair(found, tables[found].size());
+		tables[found].addRow(&trav);
+	}
+
+	for (auto tit = tables.begin(); tit != tables.end(); ++tit)
+		tit->finalize();
+	return tables;
+}
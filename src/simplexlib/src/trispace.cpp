@@ -29,13 +29,229 @@ along with Simplex.  If not, see <http://www.gnu.org/licenses/>.
 
 using namespace simplex;
 
+namespace {
+// Fixed-size barycentric solve for the common low dimension spaces
+template <int D>
+void fixedBary(const double *inverse, const double *last, const double *p, double *out){
+	typedef Eigen::Matrix<double, D, D, Eigen::RowMajor> Mat;
+	typedef Eigen::Matrix<double, D, 1> Vec;
+	Vec lastVec = Eigen::Map<const Vec>(p) - Eigen::Map<const Vec>(last);
+	Eigen::Map<Vec> x(out);
+	x.noalias() = Eigen::Map<const Mat>(inverse) * lastVec;
+}
+
+// Any other size, without an allocating dynamic Eigen type
+void dynamicBary(size_t dim, const double *inverse, const double *last, const double *p, double *out){
+	for (size_t i=0; i<dim; ++i){
+		double x = 0.0;
+		for (size_t j=0; j<dim; ++j){
+			x += inverse[i*dim + j] * (p[j] - last[j]);
+		}
+		out[i] = x;
+	}
+}
+
+// The common small cases solve much faster as fixed-size matrices
+template <int D>
+void fixedQrSolve(const Eigen::MatrixXd &M, const Eigen::VectorXd &b, Eigen::VectorXd &x){
+	Eigen::Matrix<double, D, D> m = M;
+	Eigen::Matrix<double, D, 1> v = b;
+	x = m.colPivHouseholderQr().solve(v);
+}
+
+// Scratch storage shared by the whole triangulation, so nothing is copied
+// per recursion level or per split. Simplices are stored as dim+1 indices
+// into one flat array of corner points
+class TriangulateArena {
+	public:
+		size_t dim;
+
+		// Adjacent simplex search
+		std::vector<bool> used;
+		std::vector<size_t> mxs; // dim candidates for each recursion level
+		std::vector<int> simp;
+
+		// Simplex splitting
+		std::vector<double> points; // dim values per point
+		std::vector<int> pointUsers; // the user point index of each point, or -1
+		std::vector<size_t> simps;
+		std::vector<size_t> nextSimps;
+		std::vector<double> currVec;
+		std::vector<double> bary;
+		Eigen::MatrixXd M;
+		Eigen::VectorXd lastVec;
+		Eigen::VectorXd x;
+		Eigen::ColPivHouseholderQR<Eigen::MatrixXd> qr;
+
+		explicit TriangulateArena(size_t dim):
+			dim(dim), used(dim), mxs(dim * dim), currVec(dim), bary(dim + 1),
+			M(dim, dim), lastVec(dim), x(dim), qr(dim, dim) {
+			simp.reserve(dim + 1);
+		}
+
+		const double *point(size_t idx) const { return &points[idx * dim]; }
+		size_t addPoint(const double *p, int user){
+			points.insert(points.end(), p, p + dim);
+			pointUsers.push_back(user);
+			return pointUsers.size() - 1;
+		}
+
+		// Fill bary with the barycentric coordinates of p in the given simplex
+		void barycentric(const size_t *corners, const double *p){
+			const double *last = point(corners[dim]);
+
+			// lastVec = (p - last)
+			for (size_t i=0; i<dim; ++i){
+				lastVec(i) = p[i] - last[i];
+			}
+
+			// M = (s - last)[:-1].transpose()
+			for (size_t i=0; i<dim; ++i){
+				const double *corner = point(corners[i]);
+				for (size_t j=0; j<dim; ++j){
+					M(j,i) = corner[j] - last[j];
+				}
+			}
+
+			// solve for the coordinates
+			switch (dim){
+			case 2:
+				fixedQrSolve<2>(M, lastVec, x);
+				break;
+			case 3:
+				fixedQrSolve<3>(M, lastVec, x);
+				break;
+			case 4:
+				fixedQrSolve<4>(M, lastVec, x);
+				break;
+			default:
+				qr.compute(M);
+				x = qr.solve(lastVec);
+			}
+			for (size_t i=0; i<dim; ++i){
+				bary[i] = x(i);
+			}
+			double sum = std::accumulate(bary.begin(), bary.begin() + dim, 0.0);
+			bary[dim] = 1.0 - sum; // 1-sum = missing value
+		}
+};
+
+// Search for simplices that are near the point
+// This allows for splitting the simplex, or snapping a
+// point to a nearby progression
+// The coordinates that haven't been used yet are the remaining sub-point
+void adjacentSimplices(const double *point, size_t depth, double eps, TriangulateArena &arena, std::vector<std::vector<int>> &out){
+	size_t dim = arena.dim;
+	if (depth == dim){
+		out.push_back(arena.simp);
+		return;
+	}
+
+	double maxabs = 0.0;
+	bool first = true;
+	for (size_t i=0; i<dim; ++i){
+		if (arena.used[i]) continue;
+		double aa = fabs(point[i]);
+		if (first || aa > maxabs){
+			maxabs = aa;
+			first = false;
+		}
+	}
+
+	size_t *mxs = &arena.mxs[depth * dim];
+	size_t mxCount = 0;
+	for (size_t i=0; i<dim; ++i){
+		if (arena.used[i]) continue;
+		if (maxabs - fabs(point[i]) < eps){
+			mxs[mxCount++] = i;
+		}
+	}
+
+	bool mvZero = isZero(maxabs);
+	for (size_t i=0; i<mxCount; ++i){
+		// zero is both positive and negative
+		// so I need to do both directions
+		size_t mx = mxs[i];
+		int directions[2] = {-1, 1};
+		size_t dirCount = 2;
+		if (!mvZero){
+			directions[0] = (isPositive(point[mx])) ? 1 : -1;
+			dirCount = 1;
+		}
+
+		for (size_t d=0; d<dirCount; ++d){
+			arena.used[mx] = true;
+			arena.simp.push_back(int(mx + 1) * directions[d]);
+			adjacentSimplices(point, depth + 1, eps, arena, out);
+			arena.simp.pop_back();
+			arena.used[mx] = false;
+		}
+	}
+}
+
+// Split the simplex by each of the given user points in turn
+// The pieces are left in arena.simps
+void splitSimplex(
+		const std::vector<int> &simplex,
+		const std::vector<size_t> &userIdxs,
+		const std::vector<std::vector<double>> &userPoints,
+		const std::vector<int> &userFirst,
+		const std::unordered_map<std::vector<double>, size_t, vectorHash<double>> &pointIndex,
+		TriangulateArena &arena
+){
+	size_t dim = arena.dim;
+	arena.points.clear();
+	arena.pointUsers.clear();
+	arena.simps.clear();
+
+	// Build the corners of the simplex. A corner that lands on
+	// a user point is treated as that user point
+	std::fill(arena.currVec.begin(), arena.currVec.end(), 0.0);
+	std::vector<double> key(dim);
+	for (size_t i=0; i<simplex.size(); ++i){
+		int s = simplex[i];
+		if (s != 0){
+			size_t idx = (s > 0) ? s : -s;
+			arena.currVec[idx - 1] = (s > 0) ? 1.0 : -1.0;
+		}
+		key.assign(arena.currVec.begin(), arena.currVec.end());
+		auto findIt = pointIndex.find(key);
+		int user = (findIt == pointIndex.end()) ? -1 : int(findIt->second);
+		arena.simps.push_back(arena.addPoint(arena.currVec.data(), user));
+	}
+
+	size_t width = dim + 1;
+	for (auto uit = userIdxs.begin(); uit != userIdxs.end(); ++uit){
+		const double *p = userPoints[*uit].data();
+		size_t pIdx = arena.addPoint(p, userFirst[*uit]);
+		arena.nextSimps.clear();
+		for (size_t j=0; j<arena.simps.size(); j += width){
+			const size_t *corners = &arena.simps[j];
+			arena.barycentric(corners, p);
+			if (std::all_of(arena.bary.begin(), arena.bary.end(), isPositive)) {
+				for (size_t k=0; k<width; ++k){
+					if (isZero(arena.bary[k])) continue;
+					size_t start = arena.nextSimps.size();
+					arena.nextSimps.insert(arena.nextSimps.end(), corners, corners + width);
+					arena.nextSimps[start + k] = pIdx;
+				}
+			}
+			else {
+				arena.nextSimps.insert(arena.nextSimps.end(), corners, corners + width);
+			}
+		}
+		arena.simps.swap(arena.nextSimps);
+	}
+}
+} // namespace
+
 // Check if the stateList of one floater is equal to another
 bool stateEq(
-		std::vector<std::pair<Slider*, double>> lhs,
-		std::vector<std::pair<Slider*, double>> rhs
+		const ComboPairs &lhs,
+		const ComboPairs &rhs
 ){
 	for (size_t i=0; i<lhs.size(); ++i){
-		// pointers compare equal if they point to the same object
+		// the same slider index is the same slider
 		if (lhs[i].first != rhs[i].first) return false;
 	}
 	return true;
@@ -84,280 +300,207 @@ TriSpace::TriSpace(std::vector<Floater*> floaters):floaters(floaters){
 }
 
 void TriSpace::triangulate(){
+	size_t dim = floaters[0]->stateList.size();
+	TriangulateArena arena(dim);
+
+	// The user points that touch each adjacent simplex
 	std::unordered_map<
 		std::vector<int>,
-		std::vector<std::vector<double>>,
+		std::vector<size_t>,
 		vectorHash<int>
 	> d;
+	// The first index of each distinct user point
+	std::unordered_map<std::vector<double>, size_t, vectorHash<double>> pointIndex;
+	std::vector<int> userFirst;
+	std::vector<std::vector<int>> rawSimps;
 
-	for ( auto fit = floaters.begin(); fit != floaters.end(); ++fit){
-		//for (auto f : floaters){
+	for (auto fit = floaters.begin(); fit != floaters.end(); ++fit){
 		auto &f = *fit;
 		std::vector<double> userPoint;
 		for (auto sit = f->stateList.begin(); sit != f->stateList.end(); ++sit){
-			//for (auto sp : stateList){
-			auto &sp = *sit;
-			userPoint.push_back(sp.second);
+			userPoint.push_back(sit->second);
 		}
+		size_t userIdx = userPoints.size();
 		userPoints.push_back(userPoint);
-		std::vector<std::vector<int>> rawSimps = pointToAdjSimp(userPoint);
-		for ( auto rit = rawSimps.begin(); rit != rawSimps.end(); ++rit){
-			//for (auto &rawSimp : rawSimps){
-			auto &rawSimp = *rit;
-			d[rawSimp].push_back(userPoint);
+		userFirst.push_back(int(pointIndex.emplace(userPoint, userIdx).first->second));
+
+		rawSimps.clear();
+		arena.simp.assign(1, 0);
+		adjacentSimplices(userPoint.data(), 0, 0.01, arena, rawSimps);
+		for (auto rit = rawSimps.begin(); rit != rawSimps.end(); ++rit){
+			d[*rit].push_back(userIdx);
 		}
 	}
 
+	size_t width = dim + 1;
 	for (auto pit = d.begin(); pit != d.end(); ++pit){
-		//for (auto p : d){
-		auto p = *pit;
-		overrideSimplices.push_back(p.first);
-		std::vector<std::vector<int>> singleSimp;
-		singleSimp.push_back(p.first);
-		auto ext = splitSimps(p.second, singleSimp);
-		for (auto uit = ext.begin(); uit != ext.end(); ++uit){
-			//for (auto &userSimplex : ext){
-			auto &userSimplex = *uit;
-			std::vector<int> newSimp;
-			for (size_t cIdx=0; cIdx<userSimplex.size(); ++cIdx){
-				auto findIt = std::find(userPoints.begin(), userPoints.end(), userSimplex[cIdx]);
-				if (findIt == userPoints.end()){ // not found
-					newSimp.push_back(p.first[cIdx]);
-				}
-				else{
-					size_t idx = findIt - userPoints.begin();
-					newSimp.push_back(int(p.first.size() + idx));
-				}
+		const std::vector<int> &simplex = pit->first;
+		overrideSimplices.push_back(simplex);
+		splitSimplex(simplex, pit->second, userPoints, userFirst, pointIndex, arena);
+
+		std::vector<std::vector<int>> &userSimps = simplexMap[simplex];
+		for (size_t j=0; j<arena.simps.size(); j += width){
+			std::vector<int> newSimp(width);
+			for (size_t cIdx=0; cIdx<width; ++cIdx){
+				int user = arena.pointUsers[arena.simps[j + cIdx]];
+				newSimp[cIdx] = (user == -1) ? simplex[cIdx] : int(width + user);
 			}
-			simplexMap[p.first].push_back(newSimp);
+			userSimps.push_back(newSimp);
 		}
 	}
+	buildBarySolves();
 }
 
-void TriSpace::storeValue(
-		const std::vector<double> &values,
-		const std::vector<double> &posValues,
-		const std::vector<double> &clamped,
-		const std::vector<bool> &inverses
-){
-	std::vector<bool> subInverse;
-	std::vector<double> vec;
-	// All floats in a trispace share the same span
-	// so I only need to check one of them
-	for (auto pit = floaters[0]->stateList.begin(); pit != floaters[0]->stateList.end(); ++pit){
-		//for (auto &p : floaters[0]->stateList) {
-		auto &p = *pit;
-		size_t idx = p.first->getIndex();
-		subInverse.push_back(inverses[idx]);
-		double cval = clamped[idx];
-		if (isZero(cval)) return;
-		vec.push_back(cval);
-	}
-	if (floaters[0]->inverted != subInverse) return;
-
-	std::vector<int> majorSimp = pointToSimp(vec);
-	size_t c = simplexMap.count(majorSimp);
-	if (c == 0) return;
-
-	std::vector<std::vector<int>> &simps = simplexMap[majorSimp];
-
-
-	for (auto sit = simps.begin(); sit != simps.end(); ++sit){
-		//for (auto &simp : simps){
-		auto &simp = *sit;
-		std::vector<std::vector<double>> expanded;
-		std::vector<int> floaterCorners;
-		// TODO: Didn't fill "expanded" properly
-		userSimplexToCorners(simp, majorSimp, expanded, floaterCorners);
-
-		std::vector<double> b = barycentric(expanded, vec);
-		if (std::all_of(b.begin(), b.end(), isPositive)){
-			for (size_t i = 0; i < b.size(); ++i) {
-				int fcIdx = floaterCorners[i];
-				if (fcIdx != -1) {
-					floaters[fcIdx]->value = b[i];
-				}
-			}
-			break;
+void TriSpace::buildBarySolves(){
+	std::vector<std::vector<double>> corners;
+	std::vector<int> floaterCorners;
+	std::vector<double> currVec;
+	for (auto mit = simplexMap.begin(); mit != simplexMap.end(); ++mit){
+		std::vector<BarySolve> &solves = barySolves[mit->first];
+		for (auto sit = mit->second.begin(); sit != mit->second.end(); ++sit){
+			userSimplexToCorners(*sit, mit->first, corners, floaterCorners, currVec);
+			solves.push_back(BarySolve(corners, floaterCorners));
 		}
 	}
 }
 
-std::vector<std::vector<int>> TriSpace::pointToAdjSimp(
-		const std::vector<double> &pt,
-		double eps
-) {
-	//Search for simplices that are near the point
-	//This allows for splitting the simplex, or snapping a
-	//point to a nearby progression
-
-	// Point, OrderedValues, CurrentSimplex, Output
-
-	std::vector<std::vector<int> > out;
-	std::vector<int> rn, simp;
-	rn.resize(pt.size());
-	for (int i=0; i<pt.size(); ++i){
-		rn[i] = i;
-	}
-	simp.push_back(0);
-	TriSpace::rec(pt, rn, simp, out, eps);
-	return out;
-}
-
-void TriSpace::rec(
-		const std::vector<double> &point,
-		const std::vector<int> &oVals,
-		const std::vector<int> &simp,
-		std::vector<std::vector<int> > &out,
-		double eps
-) const {
-	if (point.empty()){
-		out.push_back(simp);
-		return;
-	}
+BarySolve::BarySolve(const std::vector<std::vector<double>> &corners, const std::vector<int> &floaterCorners):
+		floaterCorners(floaterCorners), last(corners.back()){
+	size_t dim = last.size();
 
-	double maxabs = fabs(point[0]);
-	for (size_t i=0; i<point.size(); ++i){
-		double aa = fabs(point[i]);
-		if (aa > maxabs){
-			maxabs = aa;
+	// M = (s - last)[:-1].transpose()
+	Eigen::MatrixXd M(dim, dim);
+	for (size_t i=0; i<dim; ++i){
+		for (size_t j=0; j<dim; ++j){
+			M(j,i) = corners[i][j] - last[j];
 		}
 	}
 
-	std::vector<size_t> mxs;
-	for (size_t i=0; i<point.size(); ++i){
-		if (maxabs - fabs(point[i]) < eps){
-			mxs.push_back(i);
+	// Solving against the identity keeps the same behavior as
+	// solving each point directly, even if M is degenerate
+	Eigen::MatrixXd inv = M.colPivHouseholderQr().solve(Eigen::MatrixXd::Identity(dim, dim));
+	inverse.resize(dim * dim);
+	for (size_t i=0; i<dim; ++i){
+		for (size_t j=0; j<dim; ++j){
+			inverse[i*dim + j] = inv(i, j);
 		}
 	}
+}
 
-	std::vector<double> subpoint;
-	std::vector<int> subvals, nSimp;
-	bool mvZero = isZero(maxabs);
+void BarySolve::solve(const double *p, double *out) const {
+	size_t dim = last.size();
+	switch (dim){
+	case 2:
+		fixedBary<2>(inverse.data(), last.data(), p, out);
+		break;
+	case 3:
+		fixedBary<3>(inverse.data(), last.data(), p, out);
+		break;
+	case 4:
+		fixedBary<4>(inverse.data(), last.data(), p, out);
+		break;
+	default:
+		dynamicBary(dim, inverse.data(), last.data(), p, out);
+	}
+	double sum = std::accumulate(out, out + dim, 0.0);
+	out[dim] = 1.0 - sum; // 1-sum = missing value
+}
 
-	for (size_t i=0; i<mxs.size(); ++i){
-		std::vector<int> searchDirection;
-		// zero is both positive and negative
-		// so I need to do both directions
-		size_t mx = mxs[i];
-		if (mvZero){
-			searchDirection.push_back(-1); 
-			searchDirection.push_back(1); 
-		}
-		else {
-			int p = (isPositive(point[mx])) ? 1 : -1;
-			searchDirection.push_back(p);
-		}
+const BarySolve *TriSpace::findSolve(SolverState &state) const {
+	const std::vector<double> &clamped = state.clamped;
+	const std::vector<bool> &inverses = state.inverses;
+	TriSpaceScratch &scratch = state.spaceScratch;
+	std::vector<bool> &subInverse = scratch.inverse;
+	std::vector<double> &vec = scratch.vec;
+	subInverse.clear();
+	vec.clear();
+	// All floats in a trispace share the same span
+	// so I only need to check one of them
+	for (auto pit = floaters[0]->stateList.begin(); pit != floaters[0]->stateList.end(); ++pit){
+		//for (auto &p : floaters[0]->stateList) {
+		auto &p = *pit;
+		size_t idx = p.first;
+		subInverse.push_back(inverses[idx]);
+		double cval = clamped[idx];
+		if (isZero(cval)) return nullptr;
+		vec.push_back(cval);
+	}
+	if (floaters[0]->inverted != subInverse) return nullptr;
 
-		//for (int direction : searchDirection){
-		for (auto dit = searchDirection.begin(); dit != searchDirection.end(); ++dit) {
-			int direction = *dit;
-			int newval = (oVals[mx] + 1) * direction;
+	std::vector<int> &majorSimp = scratch.simp;
+	pointToSimp(vec, majorSimp, scratch.sort);
+	auto mapIt = barySolves.find(majorSimp);
+	if (mapIt == barySolves.end()) return nullptr;
 
-			// Copy
-			nSimp = simp;
-			subpoint = point;
-			subvals = oVals;
+	const std::vector<BarySolve> &simps = mapIt->second;
+	std::vector<double> &b = scratch.bary;
+	b.resize(vec.size() + 1);
+	SIMPLEX_PROFILE_COUNT(state.profile, spacesSearched, 1);
 
-			nSimp.insert(nSimp.end(), newval);
-			subpoint.erase(subpoint.begin()+mx);
-			subvals.erase(subvals.begin()+mx);
-			TriSpace::rec(subpoint, subvals, nSimp, out, eps);
+	for (auto sit = simps.begin(); sit != simps.end(); ++sit){
+		SIMPLEX_PROFILE_COUNT(state.profile, simplicesTested, 1);
+		sit->solve(vec.data(), b.data());
+		if (std::all_of(b.begin(), b.end(), isPositive)){
+			return &(*sit);
 		}
 	}
+	return nullptr;
 }
 
-std::vector<std::vector<double> > TriSpace::simplexToCorners(
-		const std::vector<int> &simplex
-) const {
-	std::vector<double> currVec(simplex.size() - 1, 0.0);
-	std::vector<std::vector<double> > out;
-	for (size_t i = 0; i<simplex.size(); ++i) {
-		int s = simplex[i];
-		if (s == 0) {
-			out.push_back(currVec);
-			continue;
-		}
-		int idx = (s > 0) ? s : -s;
-		double val = (s > 0) ? 1.0 : -1.0;
+void TriSpace::storeValue(SolverState &state) const {
+	const BarySolve *solve = findSolve(state);
+	if (solve == nullptr) return;
 
-		if (idx >= simplex.size()) {
-			idx = idx - int(simplex.size());
-			out.push_back(this->userPoints[idx]);
-		}
-		else {
-			currVec[idx - 1] = val;
-			out.push_back(currVec);
+	const std::vector<double> &b = state.spaceScratch.bary;
+	for (size_t i = 0; i < b.size(); ++i) {
+		int fcIdx = solve->floaterCorners[i];
+		if (fcIdx != -1) {
+			state.ctrlValues[floaters[fcIdx]->getSlot()] = b[i];
+			SIMPLEX_PROFILE_COUNT(state.profile, floatersSolved, 1);
 		}
 	}
-	return out;
 }
 
-std::vector<std::vector<std::vector<double> > > TriSpace::splitSimps(
-		const std::vector<std::vector<double> > &pts,
-		const std::vector<std::vector<int> > &simps
-) const {
-	std::vector<std::vector<std::vector<double> > > out, tmpList;
-	for (size_t i = 0; i<simps.size(); ++i) {
-		out.push_back(simplexToCorners(simps[i]));
-	}
-
-	for (size_t i = 0; i<pts.size(); ++i) {
-		const std::vector<double> &p = pts[i];
-		tmpList.clear();
-		for (size_t j = 0; j<out.size(); ++j) {
-			std::vector<double> bary = barycentric(out[j], p);
-			if (std::all_of(bary.begin(), bary.end(), isPositive)) {
-				for (size_t k = 0; k<bary.size(); ++k) {
-					double b = bary[k];
-					if (!isZero(b)) {
-						std::vector<std::vector<double>> ns = out[j];
-						ns[k] = p;
-						tmpList.push_back(std::move(ns));
-					}
-				}
+void TriSpace::storeGradient(SolverState &state, std::vector<ComboPairs> &gradients) const {
+	const BarySolve *solve = findSolve(state);
+	if (solve == nullptr) return;
+
+	// The first dim coordinates are the inverse times the point minus the
+	// last corner, and the last coordinate is one minus their sum
+	// Each point value is a slider's clamped absolute value
+	const ComboPairs &stateList = floaters[0]->stateList;
+	size_t dim = stateList.size();
+	const double *inverse = solve->inverse.data();
+	for (size_t i = 0; i <= dim; ++i) {
+		int fcIdx = solve->floaterCorners[i];
+		if (fcIdx == -1) continue;
+		ComboPairs &gradient = gradients[floaters[fcIdx]->getSlot()];
+		gradient.clear();
+		for (size_t j = 0; j < dim; ++j) {
+			size_t idx = stateList[j].first;
+			if (state.posValues[idx] > MAXVAL) continue;
+			double db = 0.0;
+			if (i < dim) {
+				db = inverse[i*dim + j];
 			}
 			else {
-				tmpList.push_back(out[j]);
+				for (size_t k = 0; k < dim; ++k) db -= inverse[k*dim + j];
 			}
+			if (state.inverses[idx]) db = -db;
+			if (db != 0.0) gradient.push_back(std::make_pair(idx, db));
 		}
-		out = tmpList;
 	}
-	return out;
 }
 
-std::vector<double> TriSpace::barycentric(
-		const std::vector<std::vector<double>> &simplex,
-		const std::vector<double> &p
-) const {
-
-	std::vector<double> last = simplex.back();
-
-	// lastVec = (p - last)
-	Eigen::VectorXd lastVec(p.size());
-	for (size_t i=0; i<last.size(); ++i){
-		lastVec(i) = p[i] - last[i];
-	}
-
-	// M = (s - last)[:-1].transpose()
-	Eigen::MatrixXd M(simplex.size()-1, simplex.size()-1);
-	for (size_t i=0; i<simplex.size()-1; ++i){ // [:-1]
-		for (size_t j=0; j<simplex[i].size(); ++j){
-			// transpose // ji = ij
-			M(j,i) = simplex[i][j] - last[j];
-		}
+size_t TriSpace::simplexCount() const {
+	size_t count = 0;
+	for (auto mit = barySolves.begin(); mit != barySolves.end(); ++mit){
+		count += mit->second.size();
 	}
-
-	// solve for the coordinates
-	Eigen::VectorXd x = M.colPivHouseholderQr().solve(lastVec);
-	double * outArray = x.data(); // x.data isn't a vector, so convert it
-	std::vector<double> out(&outArray[0],&outArray[p.size()]);
-	double sum = accumulate(out.begin(), out.end(), 0.0);
-	out.push_back(1.0 - sum); // 1-sum = missing value
-	return out;
+	return count;
 }
 
-std::vector<int> TriSpace::pointToSimp(const std::vector<double> &pt) {
+void TriSpace::pointToSimp(const std::vector<double> &pt, std::vector<int> &out, std::vector<std::pair<int, double>> &sortScratch) {
 	/*
 		Each simplex can be represented as a permutation of [(+-)(i+1) for i in range(len(dim))]
 		So I will encode these values by the pos/neg direction along a dimension number.
@@ -365,7 +508,8 @@ std::vector<int> TriSpace::pointToSimp(const std::vector<double> &pt) {
 
 		The resultant simplex is called a "Schlafli Orthoscheme"
 	*/
-	std::vector<std::pair<int, double> > abspt;
+	std::vector<std::pair<int, double> > &abspt = sortScratch;
+	abspt.clear();
 	double v;
 	int idx, i, n;
 	for (i=0; i<pt.size(); ++i){
@@ -380,28 +524,31 @@ std::vector<int> TriSpace::pointToSimp(const std::vector<double> &pt) {
 		}
 	);
 
-	std::vector<int> out;
+	out.clear();
 	out.push_back(0);
 	for (i=int(abspt.size()); i>0; --i){
 		out.push_back(abspt[i-1].first);
 	}
-	return out;
 }
 
 void TriSpace::userSimplexToCorners(
 		const std::vector<int> &simplex,
 		const std::vector<int> &original,
 		std::vector<std::vector<double>> &out,
-		std::vector<int> &floaterCorners // TODO
-		) const{ 
-
-	std::vector<double> currVec (simplex.size()-1, 0.0);
+		std::vector<int> &floaterCorners,
+		std::vector<double> &currVec
+		) const {
+
+	// Assign into the existing rows so their storage gets re-used
+	out.resize(simplex.size());
+	floaterCorners.resize(simplex.size());
+	currVec.assign(simplex.size()-1, 0.0);
 	for (size_t i=0; i<simplex.size(); ++i){
 		int s = simplex[i];
 		int os = original[i];
 		if (s == 0){
-			out.push_back(currVec);
-			floaterCorners.push_back(-1);
+			out[i] = currVec;
+			floaterCorners[i] = -1;
 			continue;
 		}
 		// get the user idx
@@ -421,14 +568,13 @@ void TriSpace::userSimplexToCorners(
 		if (idx >= simplex.size()){
 			// grab a user point
 			idx = idx - int(simplex.size());
-			out.push_back(this->userPoints[idx]);
-			floaterCorners.push_back(idx);
+			out[i] = this->userPoints[idx];
+			floaterCorners[i] = idx;
 		}
 		else {
 			// get the currVec		
-			out.push_back(currVec);
-			floaterCorners.push_back(-1);
+			out[i] = currVec;
+			floaterCorners[i] = -1;
 		}
 	}
 }
-
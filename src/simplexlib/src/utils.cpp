@@ -37,10 +37,10 @@ void rectify(
 	inverses.resize(rawVec.size());
 	for (size_t i=0; i<rawVec.size(); ++i){
 		double v = rawVec[i];
-		if (v < 0){
-			v = -v;
-			inverses[i] = true;
-		}
+		bool inv = v < 0;
+		if (inv) v = -v;
+		// always assign, the output buffers may be re-used between solves
+		inverses[i] = inv;
 		values[i] = v;
 		clamped[i] = (v > MAXVAL) ? MAXVAL : v;
 	}
@@ -60,4 +60,29 @@ double doSoftMin(double X, double Y) {
 	double z = pow(pow(X, p) + h, q) + pow(pow(Y, p) + h, q) - pow(pow(X - Y, p) + h, q);
 	return (z - s) / d;
 }
+
+double doSoftMin(double X, double Y, double &dX, double &dY) {
+	dX = 0.0;
+	dY = 0.0;
+	if (isZero(X) || isZero(Y)) return 0.0;
+	bool swapped = X < Y;
+	if (swapped) std::swap(X, Y);
+
+	double h = 0.025;
+	double p = 2.0;
+	double q = 1.0 / p;
+
+	double d = 2.0 * (pow(1.0 + h, q) - pow(h, q));
+	double s = pow(h, q);
+	double z = pow(pow(X, p) + h, q) + pow(pow(Y, p) + h, q) - pow(pow(X - Y, p) + h, q);
+
+	// d/du (u^p + h)^q
+	auto slope = [&](double u) { return q * pow(pow(u, p) + h, q - 1.0) * p * pow(u, p - 1.0); };
+	double dXY = slope(X - Y);
+	double dMax = (slope(X) - dXY) / d;
+	double dMin = (slope(Y) + dXY) / d;
+	dX = swapped ? dMin : dMax;
+	dY = swapped ? dMax : dMin;
+	return (z - s) / d;
+}
 } // namespace simplex
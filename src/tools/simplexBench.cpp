@@ -0,0 +1,500 @@
+/*
+Copyright 2016, Blur Studio
+
+This file is part of Simplex.
+
+Simplex is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Simplex is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Simplex.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "simplex.h"
+#include "sparseWeights.h"
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Count every allocation, so the solve phases can report allocations per frame
+static std::atomic<size_t> allocCount(0);
+
+// The replacements go through helpers that are never inlined. Otherwise the
+// compiler sees the malloc and free behind a new and delete that it inlined,
+// and warns they don't match (-Wmismatched-new-delete)
+#if defined(_MSC_VER)
+#define BENCH_NOINLINE __declspec(noinline)
+#else
+#define BENCH_NOINLINE __attribute__((noinline))
+#endif
+
+static BENCH_NOINLINE void *countedAlloc(std::size_t size){
+	allocCount.fetch_add(1, std::memory_order_relaxed);
+	if (void *ptr = std::malloc(size ? size : 1)) return ptr;
+	throw std::bad_alloc();
+}
+static BENCH_NOINLINE void countedFree(void *ptr) noexcept { std::free(ptr); }
+
+void* operator new(std::size_t size){ return countedAlloc(size); }
+void operator delete(void *ptr) noexcept { countedFree(ptr); }
+void operator delete(void *ptr, std::size_t) noexcept { countedFree(ptr); }
+
+namespace {
+
+struct RigOptions {
+	size_t shapes = 0; // a minimum. Extra shapes become slider in-betweens
+	size_t sliders = 100;
+	size_t combos = 300;
+	size_t floaters = 30;
+	size_t traversals = 20;
+	unsigned seed = 1;
+};
+
+struct BenchOptions {
+	size_t iterations = 10; // for the parse and build phases
+	size_t frames = 1000;
+	size_t passes = 10; // over the frames, for the solve phases
+	bool validate = false; // compare the float solve against the double one
+	double tolerance = 1e-5;
+	double active = 1.0; // fraction of the sliders that aren't zero in a frame
+};
+
+// Writes a synthetic encodingVersion 3 definition
+class RigWriter {
+	public:
+		std::ostringstream shapes, progs, sliders, combos, traversals;
+		size_t shapeCount = 1, progCount = 0;
+		std::mt19937 rng;
+
+		explicit RigWriter(unsigned seed):rng(seed){
+			shapes << "{\"name\":\"Rest\"}";
+		}
+		// The parser wants the pair values as doubles, so always write a decimal point
+		static std::string num(double v){
+			char buf[32];
+			std::snprintf(buf, sizeof(buf), "%.17g", v);
+			std::string out = buf;
+			if (out.find_first_of(".e") == std::string::npos) out += ".0";
+			return out;
+		}
+		static void sep(std::ostringstream &s){
+			if (s.tellp() > 0) s << ",";
+		}
+		size_t newShape(const std::string &name){
+			shapes << ",{\"name\":\"" << name << "\"}";
+			return shapeCount++;
+		}
+		// A progression with one new shape per non-zero time
+		size_t newProg(const std::string &name, const std::vector<double> &times, const char *interp){
+			sep(progs);
+			progs << "{\"name\":\"" << name << "\",\"interp\":\"" << interp << "\",\"pairs\":[[0,0.0]";
+			for (size_t i = 0; i < times.size(); ++i){
+				progs << ",[" << newShape(name + "_" + std::to_string(i)) << "," << num(times[i]) << "]";
+			}
+			progs << "]}";
+			return progCount++;
+		}
+		static void writePairs(std::ostringstream &s, const std::vector<std::pair<size_t, double>> &pairs){
+			s << "[";
+			for (size_t i = 0; i < pairs.size(); ++i){
+				if (i) s << ",";
+				s << "[" << pairs[i].first << "," << num(pairs[i].second) << "]";
+			}
+			s << "]";
+		}
+		size_t pick(size_t count){
+			return std::uniform_int_distribution<size_t>(0, count - 1)(rng);
+		}
+		double sign(){
+			return pick(2) ? 1.0 : -1.0;
+		}
+		// Distinct slider indices
+		std::vector<size_t> sample(size_t count, size_t sliderCount){
+			std::vector<size_t> out;
+			while (out.size() < count && out.size() < sliderCount){
+				size_t s = pick(sliderCount);
+				bool found = false;
+				for (size_t o : out) found = found || o == s;
+				if (!found) out.push_back(s);
+			}
+			return out;
+		}
+		std::string str() const {
+			return "{\"encodingVersion\":3,\"shapes\":[" + shapes.str() +
+				"],\"progressions\":[" + progs.str() +
+				"],\"sliders\":[" + sliders.str() +
+				"],\"combos\":[" + combos.str() +
+				"],\"traversals\":[" + traversals.str() + "]}";
+		}
+};
+
+const char *solveTypes[] = {"min", "allMul", "extMul", "mulAvgExt", "mulAvgAll", "None"};
+
+// A prefix and a number, like "S12". This appends rather than using
+// "S" + std::to_string(i), which GCC 12 warns about (-Wrestrict) when it's inlined
+std::string itemName(const char *prefix, size_t i){
+	std::string out(prefix);
+	out += std::to_string(i);
+	return out;
+}
+
+std::string generateRig(const RigOptions &opt){
+	RigWriter w(opt.seed);
+	size_t sliderCount = opt.sliders ? opt.sliders : 1;
+
+	// Spread any shapes beyond the one per control over the sliders
+	size_t minimum = 1 + sliderCount + opt.combos + opt.floaters + opt.traversals;
+	size_t extra = opt.shapes > minimum ? opt.shapes - minimum : 0;
+	for (size_t i = 0; i < sliderCount; ++i){
+		size_t count = 1 + extra / sliderCount + (i < extra % sliderCount ? 1 : 0);
+		std::vector<double> times;
+		const char *interp = "spline";
+		if (count % 2 == 0){
+			// Split the shapes evenly over both sides of zero
+			size_t half = count / 2;
+			for (size_t j = 1; j <= half; ++j){
+				times.push_back(double(j) / half);
+				times.push_back(-double(j) / half);
+			}
+			interp = "splitspline";
+		}
+		else {
+			for (size_t j = 1; j <= count; ++j) times.push_back(double(j) / count);
+			if (w.pick(4) == 0) interp = "linear";
+		}
+		std::string name = itemName("S", i);
+		size_t prog = w.newProg(name, times, interp);
+		RigWriter::sep(w.sliders);
+		w.sliders << "{\"name\":\"" << name << "\",\"prog\":" << prog << "}";
+	}
+
+	static const size_t arities[] = {2, 2, 2, 3, 3, 4, 5};
+	for (size_t i = 0; i < opt.combos; ++i){
+		std::vector<std::pair<size_t, double>> pairs;
+		for (size_t s : w.sample(arities[w.pick(7)], sliderCount)) pairs.push_back(std::make_pair(s, w.sign()));
+		std::string name = itemName("C", i);
+		size_t prog = w.newProg(name, {1.0}, "spline");
+		RigWriter::sep(w.combos);
+		w.combos << "{\"name\":\"" << name << "\",\"prog\":" << prog <<
+			",\"solveType\":\"" << solveTypes[w.pick(6)] << "\",\"pairs\":";
+		RigWriter::writePairs(w.combos, pairs);
+		w.combos << "}";
+	}
+
+	// Floaters come in groups that share a set of sliders, so they
+	// get triangulated together into one space
+	static const double depths[] = {0.25, 0.5, 0.75, 1.0};
+	for (size_t i = 0; i < opt.floaters; i += 3){
+		std::vector<size_t> group = w.sample(2 + w.pick(2), sliderCount);
+		std::vector<double> signs;
+		for (size_t j = 0; j < group.size(); ++j) signs.push_back(w.sign());
+		for (size_t j = i; j < i + 3 && j < opt.floaters; ++j){
+			std::vector<std::pair<size_t, double>> pairs;
+			for (size_t k = 0; k < group.size(); ++k) pairs.push_back(std::make_pair(group[k], signs[k] * depths[w.pick(4)]));
+			// Keep it off the corner of the space, or it wouldn't be a floater
+			pairs[0].second = signs[0] * 0.5;
+			std::string name = itemName("F", j);
+			size_t prog = w.newProg(name, {1.0}, "spline");
+			RigWriter::sep(w.combos);
+			w.combos << "{\"name\":\"" << name << "\",\"prog\":" << prog << ",\"pairs\":";
+			RigWriter::writePairs(w.combos, pairs);
+			w.combos << "}";
+		}
+	}
+
+	for (size_t i = 0; i < opt.traversals && sliderCount > 1; ++i){
+		std::vector<size_t> sl = w.sample(2 + w.pick(2), sliderCount);
+		std::vector<std::pair<size_t, double>> start, end;
+		double mulSign = w.sign();
+		start.push_back(std::make_pair(sl[0], mulSign));
+		end.push_back(std::make_pair(sl[0], mulSign));
+		end.push_back(std::make_pair(sl[1], w.sign()));
+		if (sl.size() > 2) start.push_back(std::make_pair(sl[2], 1.0));
+		std::string name = itemName("T", i);
+		size_t prog = w.newProg(name, {0.5, 1.0}, "spline");
+		RigWriter::sep(w.traversals);
+		w.traversals << "{\"name\":\"" << name << "\",\"prog\":" << prog <<
+			",\"solveType\":\"" << solveTypes[w.pick(6)] << "\",\"start\":";
+		RigWriter::writePairs(w.traversals, start);
+		w.traversals << ",\"end\":";
+		RigWriter::writePairs(w.traversals, end);
+		w.traversals << "}";
+	}
+	return w.str();
+}
+
+// Slider values with plenty of zeros and exact key values
+// so every branch of the solve gets hit
+// Below an active fraction of 1, the rest of the sliders are left at zero,
+// like a face that's only posing a few controls at a time
+std::vector<double> generateFrames(size_t frames, size_t sliderCount, unsigned seed, double active){
+	static const double keys[] = {-1.0, -0.5, 0.0, 0.0, 0.0, 0.25, 0.5, 0.75, 1.0};
+	std::mt19937 rng(seed + 1000);
+	std::uniform_real_distribution<double> any(-1.1, 1.2);
+	std::uniform_real_distribution<double> unit(0.0, 1.0);
+	std::vector<double> out(frames * sliderCount);
+	for (double &v : out){
+		if (active < 1.0 && unit(rng) >= active) v = 0.0;
+		else v = (rng() % 2) ? keys[rng() % 9] : any(rng);
+	}
+	return out;
+}
+
+class Timer {
+	private:
+		std::chrono::steady_clock::time_point start;
+		size_t allocStart;
+	public:
+		Timer():start(std::chrono::steady_clock::now()), allocStart(allocCount.load()) {}
+		double ns() const {
+			return double(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+		}
+		size_t allocs() const { return allocCount.load() - allocStart; }
+};
+
+void report(const char *phase, size_t count, const char *unit, const Timer &t){
+	double ns = t.ns();
+	size_t allocs = t.allocs();
+	std::printf("  %-12s %14.1f ns/%-6s %10.2f allocs/%s\n", phase, ns / count, unit, double(allocs) / count, unit);
+}
+
+// Check every weight of the float solve against the double solve of the same frames
+bool validateFloat(simplex::Simplex &simp, const std::vector<double> &frames, const std::vector<float> &floatFrames, const BenchOptions &opt){
+	size_t sliderCount = simp.sliderLen(), shapeCount = simp.shapeLen();
+	std::vector<double> out(shapeCount);
+	std::vector<float> floatOut(shapeCount);
+	double maxErr = 0.0, sumErr = 0.0;
+	size_t worstFrame = 0, worstShape = 0, failed = 0;
+	for (size_t f = 0; f < opt.frames; ++f){
+		simp.solve(&frames[f * sliderCount], sliderCount, out.data());
+		simp.solve(&floatFrames[f * sliderCount], sliderCount, floatOut.data());
+		for (size_t s = 0; s < shapeCount; ++s){
+			double err = std::fabs(out[s] - double(floatOut[s]));
+			sumErr += err;
+			if (err > opt.tolerance) ++failed;
+			if (err > maxErr){
+				maxErr = err;
+				worstFrame = f;
+				worstShape = s;
+			}
+		}
+	}
+	std::printf("  float vs double: max error %g (frame %zu, shape %zu), mean error %g, %zu weights over %g\n",
+		maxErr, worstFrame, worstShape, sumErr / double(opt.frames * shapeCount), failed, opt.tolerance);
+	return failed == 0;
+}
+
+bool runBench(const std::string &label, const std::string &json, const BenchOptions &opt, unsigned seed){
+	simplex::Simplex simp;
+	if (!simp.parseJSON(json) || !simp.loaded){
+		if (simp.hasParseError){
+			std::cerr << label << ": JSON PARSE ERROR: " << simp.parseError <<
+				" \n    At offset: " << std::to_string(simp.parseErrorOffset) << "\n";
+		}
+		else {
+			std::cerr << label << ": Invalid simplex definition\n";
+		}
+		return false;
+	}
+	simp.build();
+
+	size_t sliderCount = simp.sliderLen(), shapeCount = simp.shapeLen();
+	std::printf("%s\n  %zu shapes, %zu sliders, %zu combos, %zu floaters, %zu traversals, %zu spaces\n",
+		label.c_str(), shapeCount, sliderCount, simp.combos.size(), simp.floaters.size(),
+		simp.traversals.size(), simp.spaces.size());
+
+	{
+		Timer t;
+		for (size_t i = 0; i < opt.iterations; ++i){
+			simplex::Simplex s;
+			s.parseJSON(json);
+		}
+		report("parseJSON", opt.iterations, "parse", t);
+	}
+	{
+		// Only time the build, not the parse that has to come before it
+		double ns = 0.0;
+		size_t allocs = 0;
+		for (size_t i = 0; i < opt.iterations; ++i){
+			simplex::Simplex s;
+			s.parseJSON(json);
+			Timer t;
+			s.build();
+			ns += t.ns();
+			allocs += t.allocs();
+		}
+		std::printf("  %-12s %14.1f ns/%-6s %10.2f allocs/%s\n", "build", ns / opt.iterations, "build",
+			double(allocs) / opt.iterations, "build");
+	}
+	{
+		std::string bin;
+		simp.toBinary(bin);
+		Timer t;
+		for (size_t i = 0; i < opt.iterations; ++i){
+			simplex::Simplex s;
+			s.parseBinary(bin.data(), bin.size());
+		}
+		report("parseBinary", opt.iterations, "parse", t);
+	}
+
+	std::vector<double> frames = generateFrames(opt.frames, sliderCount, seed, opt.active);
+	std::vector<double> out(shapeCount);
+	simplex::SparseWeights sparse;
+	size_t solves = opt.frames * opt.passes;
+
+	// One untimed pass, so the solver state is sized before the timing starts
+	for (size_t f = 0; f < opt.frames; ++f) simp.solve(&frames[f * sliderCount], sliderCount, out.data());
+	{
+		Timer t;
+		for (size_t p = 0; p < opt.passes; ++p){
+			for (size_t f = 0; f < opt.frames; ++f) simp.solve(&frames[f * sliderCount], sliderCount, out.data());
+		}
+		report("solve", solves, "frame", t);
+	}
+
+	for (size_t f = 0; f < opt.frames; ++f) simp.solveSparse(&frames[f * sliderCount], sliderCount, sparse);
+	{
+		Timer t;
+		for (size_t p = 0; p < opt.passes; ++p){
+			for (size_t f = 0; f < opt.frames; ++f) simp.solveSparse(&frames[f * sliderCount], sliderCount, sparse);
+		}
+		report("solveSparse", solves, "frame", t);
+	}
+
+	std::vector<float> floatFrames(frames.begin(), frames.end());
+	std::vector<float> floatOut(shapeCount);
+	for (size_t f = 0; f < opt.frames; ++f) simp.solve(&floatFrames[f * sliderCount], sliderCount, floatOut.data());
+	{
+		Timer t;
+		for (size_t p = 0; p < opt.passes; ++p){
+			for (size_t f = 0; f < opt.frames; ++f) simp.solve(&floatFrames[f * sliderCount], sliderCount, floatOut.data());
+		}
+		report("solveFloat", solves, "frame", t);
+	}
+
+	if (!opt.validate) return true;
+	return validateFloat(simp, frames, floatFrames, opt);
+}
+
+bool readValue(int argc, char *argv[], int &i, double &value){
+	if (i + 1 >= argc) return false;
+	char *end = nullptr;
+	value = std::strtod(argv[++i], &end);
+	return end && *end == '\0';
+}
+
+bool readCount(int argc, char *argv[], int &i, size_t &value){
+	if (i + 1 >= argc) return false;
+	char *end = nullptr;
+	value = std::strtoull(argv[++i], &end, 10);
+	return end && *end == '\0';
+}
+
+void usage(){
+	std::cerr << "usage: simplex_bench [options] [definition.json ...]\n"
+		"  Benchmarks the given definitions, or a synthetic rig when none are given\n"
+		"  --shapes N       minimum number of shapes in the synthetic rig\n"
+		"  --sliders N      (default 100)\n"
+		"  --combos N       (default 300)\n"
+		"  --floaters N     (default 30)\n"
+		"  --traversals N   (default 20)\n"
+		"  --seed N         seed for the synthetic rig and the input frames\n"
+		"  --iterations N   parses and builds to time (default 10)\n"
+		"  --frames N       input frames per solve pass (default 1000)\n"
+		"  --passes N       solve passes over the frames (default 10)\n"
+		"  --active X       fraction of the sliders posed in each frame (default 1)\n"
+		"  --validate       check the float solve against the double solve, and fail\n"
+		"                   when any weight is off by more than the tolerance\n"
+		"  --tolerance X    for --validate (default 1e-5)\n"
+		"  --dump PATH      write the synthetic rig out as json\n";
+}
+
+} // namespace
+
+int main(int argc, char *argv[]){
+	RigOptions rigOpt;
+	BenchOptions benchOpt;
+	std::vector<std::string> paths;
+	std::string dumpPath;
+
+	for (int i = 1; i < argc; ++i){
+		std::string arg = argv[i];
+		size_t seed = rigOpt.seed;
+		bool ok = true;
+		if (arg == "--shapes") ok = readCount(argc, argv, i, rigOpt.shapes);
+		else if (arg == "--sliders") ok = readCount(argc, argv, i, rigOpt.sliders);
+		else if (arg == "--combos") ok = readCount(argc, argv, i, rigOpt.combos);
+		else if (arg == "--floaters") ok = readCount(argc, argv, i, rigOpt.floaters);
+		else if (arg == "--traversals") ok = readCount(argc, argv, i, rigOpt.traversals);
+		else if (arg == "--iterations") ok = readCount(argc, argv, i, benchOpt.iterations);
+		else if (arg == "--frames") ok = readCount(argc, argv, i, benchOpt.frames);
+		else if (arg == "--passes") ok = readCount(argc, argv, i, benchOpt.passes);
+		else if (arg == "--validate") benchOpt.validate = true;
+		else if (arg == "--tolerance") ok = readValue(argc, argv, i, benchOpt.tolerance);
+		else if (arg == "--active") ok = readValue(argc, argv, i, benchOpt.active);
+		else if (arg == "--seed"){
+			ok = readCount(argc, argv, i, seed);
+			rigOpt.seed = unsigned(seed);
+		}
+		else if (arg == "--dump"){
+			ok = i + 1 < argc;
+			if (ok) dumpPath = argv[++i];
+		}
+		else if (arg == "--help" || arg == "-h"){
+			usage();
+			return 0;
+		}
+		else if (!arg.empty() && arg[0] == '-') ok = false;
+		else paths.push_back(arg);
+
+		if (!ok){
+			usage();
+			return 2;
+		}
+	}
+	if (benchOpt.iterations == 0) benchOpt.iterations = 1;
+	if (benchOpt.frames == 0) benchOpt.frames = 1;
+	if (benchOpt.passes == 0) benchOpt.passes = 1;
+
+	bool ok = true;
+	if (paths.empty()){
+		std::string json = generateRig(rigOpt);
+		if (!dumpPath.empty()){
+			std::ofstream outFile(dumpPath, std::ios::binary);
+			outFile << json;
+			if (!outFile){
+				std::cerr << "Unable to write " << dumpPath << "\n";
+				return 1;
+			}
+		}
+		ok = runBench("synthetic (seed " + std::to_string(rigOpt.seed) + ")", json, benchOpt, rigOpt.seed);
+	}
+	for (const std::string &path : paths){
+		std::ifstream inFile(path, std::ios::binary);
+		if (!inFile){
+			std::cerr << "Unable to open " << path << "\n";
+			ok = false;
+			continue;
+		}
+		std::stringstream buffer;
+		buffer << inFile.rdbuf();
+		ok = runBench(path, buffer.str(), benchOpt, rigOpt.seed) && ok;
+	}
+	return ok ? 0 : 1;
+}
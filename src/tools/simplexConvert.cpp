@@ -0,0 +1,63 @@
+/*
+Copyright 2016, Blur Studio
+
+This file is part of Simplex.
+
+Simplex is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Simplex is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with Simplex.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "simplex.h"
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+// Convert a simplex json definition (encodingVersion 1 through 3)
+// into the precompiled binary format
+int main(int argc, char *argv[]){
+	if (argc != 3){
+		std::cerr << "usage: simplex_convert <input.json> <output.smpx>\n";
+		return 2;
+	}
+
+	std::ifstream inFile(argv[1], std::ios::binary);
+	if (!inFile){
+		std::cerr << "Unable to open " << argv[1] << "\n";
+		return 1;
+	}
+	std::stringstream buffer;
+	buffer << inFile.rdbuf();
+
+	simplex::Simplex simp;
+	simp.parseJSON(buffer.str());
+	if (simp.hasParseError){
+		std::cerr << "JSON PARSE ERROR: " << simp.parseError <<
+			" \n    At offset: " << std::to_string(simp.parseErrorOffset) << "\n";
+		return 1;
+	}
+	if (!simp.loaded){
+		std::cerr << "Invalid simplex definition in " << argv[1] << "\n";
+		return 1;
+	}
+
+	std::string out;
+	simp.toBinary(out);
+	std::ofstream outFile(argv[2], std::ios::binary);
+	outFile.write(out.data(), std::streamsize(out.size()));
+	if (!outFile){
+		std::cerr << "Unable to write " << argv[2] << "\n";
+		return 1;
+	}
+	return 0;
+}